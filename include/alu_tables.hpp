@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.hpp"
+
+/**
+ * @brief Precomputed results and flags for the 8 bit ALU
+ *
+ * Used by the instruction handlers when built with CPU_ALU_TABLES, as an
+ * alternative to computing (or deferring) the flags. Every entry packs the
+ * result in the low byte and Z/N/H/C in the high byte, laid out as in F,
+ * so a handler is one load, a register store and write_flags(entry >> 8).
+ *
+ * The tables are built by the constexpr generators in alu_tables.cpp from
+ * the same expressions the computing handlers use, and are shared
+ * read-only by every CPU in the process.
+ *
+ * - add, sub:  ADD/ADC and SUB/SBC/CP A, by alu_index(a, b, carry)
+ * - inc, dec:  INC/DEC r8 by operand; C is not part of the entry
+ * - daa:       DAA by alu_daa_index(a, f)
+ * - shift:     CB 0x00-0x3F (RLC RRC RL RR SLA SRA SWAP SRL) by
+ *              alu_shift_index(op, carry, value)
+ */
+struct AluTables {
+    u16 add[0x20000];
+    u16 sub[0x20000];
+    u16 inc[0x100];
+    u16 dec[0x100];
+    u16 daa[0x800];
+    u16 shift[0x1000];
+};
+
+extern const AluTables alu_tables;
+
+// ===== INDEXING =====
+
+inline u32 alu_index(u8 a, u8 b, u8 carry) {
+    return (static_cast<u32>(carry) << 16) | (a << 8) | b;
+}
+
+// N, H and C of f select one of eight 256 entry blocks
+inline u32 alu_daa_index(u8 a, u8 f) {
+    return ((f & (FLAG_N | FLAG_H | FLAG_C)) << 4) | a;
+}
+
+inline u32 alu_shift_index(u8 op, u8 carry, u8 value) {
+    return (op << 9) | (carry << 8) | value;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.hpp"
+#include <cstddef>
+
+/**
+ * @brief Bump allocator holding one machine's variable-size state
+ *
+ * Machine::load reserves a single zero-filled block sized exactly for the
+ * loaded cartridge (RAM banks, mapper, battery buffers) and the PPU frame
+ * buffer, and the components carve their storage out of it. Nothing is
+ * freed individually; the block goes away with the arena, so once a ROM is
+ * loaded the emulation thread never calls the allocator again.
+ *
+ * Every allocation is rounded up to ALIGN bytes, so sizes computed ahead
+ * of reserve() must use round_up().
+ */
+class Arena {
+public:
+    static constexpr size_t ALIGN = 64;  // cache line
+
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    Arena() : block(nullptr), capacity(0), offset(0) {}
+    ~Arena() { release(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // ===== LIFETIME =====
+    bool reserve(size_t bytes);
+    void release();
+
+    // ===== ALLOCATION =====
+    void* alloc(size_t bytes);
+    template <typename T>
+    T* alloc_array(size_t count) { return static_cast<T*>(alloc(sizeof(T) * count)); }
+
+    static constexpr size_t round_up(size_t bytes) { return (bytes + ALIGN - 1) & ~(ALIGN - 1); }
+
+    // ===== STATISTICS =====
+    size_t get_capacity() const { return capacity; }
+    size_t get_used() const { return offset; }
+
+private:
+    u8* block;
+    size_t capacity;
+    size_t offset;
+};
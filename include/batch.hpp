@@ -0,0 +1,95 @@
+#pragma once
+
+#include "common.hpp"
+#include "machine.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief One machine and how far a batch may run it
+ *
+ * The job ends at whichever budget is reached first; a budget of 0 is
+ * unlimited, but at least one of the two must be set. Results are written
+ * back by the worker that ran the job.
+ */
+struct BatchJob {
+    Machine* machine = nullptr;
+    u32 frame_budget = 0;   // frames to complete
+    u64 cycle_budget = 0;   // T-cycles to execute
+    FrameReduce reduce = FrameReduce::ALL;  // frames of frame_budget to render
+
+    // ===== RESULTS =====
+    u32 frames = 0;
+    u64 cycles = 0;
+    bool ok = false;        // false if the CPU stopped on an invalid opcode
+};
+
+/**
+ * @brief Runs many headless machines on a fixed pool of worker threads
+ *
+ * The workers are started once and sleep between batches. run() deals the
+ * jobs out evenly, one contiguous range per worker; a worker takes jobs
+ * from the front of its own range and, once that is empty, steals from the
+ * back of another worker's, so uneven budgets or ROMs still keep every
+ * core busy until the batch is done.
+ *
+ * Jobs are never split: each machine is stepped by exactly one thread at a
+ * time, which is all the core needs, since machines share nothing mutable.
+ * Throttled machines would sleep in the PPU; run them with throttle off.
+ */
+class BatchRunner {
+public:
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    // 0 workers sizes the pool to the host's hardware threads
+    explicit BatchRunner(u32 workers = 0);
+    ~BatchRunner();
+
+    BatchRunner(const BatchRunner&) = delete;
+    BatchRunner& operator=(const BatchRunner&) = delete;
+
+    // ===== EXECUTION =====
+    // Blocks until every job has used up its budget or failed. Returns the
+    // number of jobs that completed without error
+    u32 run(BatchJob* jobs, u32 count);
+
+    // ===== STATISTICS =====
+    u32 get_workers() const { return static_cast<u32>(threads.size()); }
+    u64 get_steals() const { return steals.load(std::memory_order_relaxed); }
+
+    static u32 default_workers();
+
+private:
+    /**
+     * @brief A worker's share of the current batch, [begin, end) in jobs
+     */
+    struct alignas(CACHE_LINE) Queue {
+        std::mutex mutex;
+        u32 begin = 0;
+        u32 end = 0;
+    };
+
+    void worker_main(u32 index);
+    bool take(u32 index, u32& job);
+    bool steal(u32 thief, u32& job);
+
+    static void run_job(BatchJob& job);
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Queue[]> queues;
+
+    // Batch hand-off, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    BatchJob* jobs = nullptr;
+    u64 generation = 0;
+    u32 active = 0;       // workers still inside the current batch
+    bool stopping = false;
+
+    std::atomic<u32> completed{0};
+    std::atomic<u64> steals{0};
+};
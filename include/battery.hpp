@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.hpp"
+
+/**
+ * @brief Battery-backed RAM save file written in the background
+ *
+ * Holds a shadow image of the save file. The emulation thread copies dirty
+ * pages into the shadow with update() and calls commit(); a shared writer
+ * thread then snapshots the shadow and replaces the file on disk by writing
+ * a temporary file and renaming it over the old one. Several commits that
+ * arrive while a write is in flight are coalesced into a single write.
+ * A snapshot only copies the bytes updated since the previous one, so the
+ * writer holds the lock shared with the emulation thread for about as
+ * long as update() does.
+ *
+ * The path and the shadow and staging buffers belong to the caller (the
+ * machine arena), and the writer queue is intrusive, so commits never
+ * allocate.
+ */
+class BatteryFile {
+public:
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    BatteryFile();
+    ~BatteryFile();
+
+    // ===== LIFETIME =====
+    bool open(const char* path, u32 size, u8* shadow_buffer, u8* staging_buffer);
+    void close();
+    bool is_open() const { return shadow != nullptr; }
+
+    // ===== EMULATION THREAD INTERFACE =====
+    void update(u32 offset, const u8* data, u32 len);
+    void commit();
+
+    // ===== WRITER THREAD INTERFACE =====
+    void write_snapshot();
+
+private:
+    friend class BatteryWriter;
+
+    const char* path;
+    u8* shadow;   // latest contents, updated by the emulation thread
+    u8* staging;  // snapshot being written by the writer thread
+    u32 size;
+    u32 dirty_begin; // shadow bytes updated since the last snapshot
+    u32 dirty_end;
+    bool queued;  // waiting in the writer queue
+    bool writing; // snapshot currently being written
+    BatteryFile* next_queued; // writer queue link
+};
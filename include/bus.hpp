@@ -3,6 +3,7 @@
 #include "common.hpp"
 #include "ram.hpp"
 #include "dma.hpp"
+#include "watch.hpp"
 
 // Forward declarations
 class Cartridge;
@@ -25,6 +26,10 @@ class DMA;
  */
 class Bus {
 public:
+    // ===== CONSTRUCTORS =====
+    Bus();
+    ~Bus();
+
     // ===== COMPONENT CONNECTIONS =====
     void set_cartridge(Cartridge* cart);
     void set_ram(RAM* ram);
@@ -32,14 +37,83 @@ public:
     void set_io(IO* io);
     void set_ppu(PPU* ppu);
     void set_dma(DMA* dma);
+    // Watched pages are left out of the page table; nullptr for none
+    void set_watchpoints(Watchpoints* w);
     
     // ===== MEMORY ACCESS =====
+    // Defined below so the page table lookup inlines into every caller
     u8 read(u16 address);
     void write(u16 address, u8 value);
     void write16(u16 address, u16 value);
     u16 read16(u16 address);
+    // Opcode fetch: a read that also hits PC breakpoints
+    u8 fetch(u16 address);
+    // For tracing and debuggers: hits no watchpoint and ignores the DMA
+    // lockout
+    u8 peek(u16 address);
+
+    // ===== PAGE TABLE =====
+    void map_cartridge();
+    // Rebuilds the whole table, e.g. after pages became shared by a fork;
+    // while a DMA runs that is left to the end of the transfer
+    void remap() { if (!dma_end) map_memory(); }
+    // After connecting a forked machine: maps its memory, or keeps it
+    // locked like parent's while a DMA runs
+    void fork_from(const Bus& parent);
+    // While on, every store to RAM takes the slow path, where the
+    // components keep the state hash up to date
+    void set_hashing(bool enabled) { hashing = enabled; remap(); }
+
+    // ===== OAM DMA =====
+    void lock_dma(u64 end_tick);
+    const u8* dma_source(u8 page);
+    u8 read_device(u16 address);
 
 private:
+    // ===== SLOW PATH =====
+    u8 read_slow(u16 address);
+    u8 fetch_slow(u16 address);
+    u8 load_slow(u16 address);
+    void write_slow(u16 address, u8 value);
+    void write_device(u16 address, u8 value);
+    bool dma_allows(u16 address);
+
+    // ===== PAGE TABLE =====
+    void map_memory();
+    void map_wram();
+    void map_vram();
+    void map_page(u8 page);
+    u8* ram_write_page(u8* page, bool shared) const { return hashing || shared ? nullptr : page; }
+    u8* cart_write_page(u8 page) const;
+    // Pages with a watched address stay on the slow path
+    const u8* watch_read_page(u8 page, const u8* memory) const {
+        return watch && (watch->page_kinds(page) & (WATCH_READ | WATCH_EXEC)) ? nullptr : memory;
+    }
+    u8* watch_write_page(u8 page, u8* memory) const {
+        return watch && (watch->page_kinds(page) & WATCH_WRITE) ? nullptr : memory;
+    }
+
+    // ===== PAGE TABLE =====
+    // One entry per 256 byte page. A non-null entry points at plain memory
+    // backing that page; nullptr sends the access through the slow path,
+    // which handles registers, side effects and unmapped regions.
+    //
+    // RAM pages shared with a forked machine are only mapped for reading.
+    // This is the write barrier of copy on write: the first store takes the
+    // slow path, the component swaps in a private copy of the page, and the
+    // page is mapped again, now for both. State hashing keeps all RAM off
+    // the fast write path the same way, and watchpoints keep the pages
+    // they watch off the path they watch.
+    const u8* read_map[256];
+    u8* write_map[256];
+
+    // While an OAM DMA runs the table is emptied and every access takes
+    // the slow path, which only lets 0xFF00-0xFFFF through until this
+    // CPU tick. 0 when no transfer is running.
+    u64 dma_end;
+    bool hashing;
+    Watchpoints* watch;  // nullptr when none are attached
+
     // ===== COMPONENT REFERENCES =====
     Cartridge* cartridge;
     RAM* ram;
@@ -47,4 +121,51 @@ private:
     IO* io;
     PPU* ppu;
     DMA* dma;
-}; 
\ No newline at end of file
+};
+
+// ===== MEMORY ACCESS =====
+
+inline u8 Bus::read(u16 address) {
+    const u8* page = read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return read_slow(address);
+}
+
+// Same table as read(): breakpoint pages are unmapped for reading too
+inline u8 Bus::fetch(u16 address) {
+    const u8* page = read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return fetch_slow(address);
+}
+
+inline u8 Bus::peek(u16 address) {
+    const u8* page = read_map[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return read_device(address);
+}
+
+inline void Bus::write(u16 address, u8 value) {
+    u8* page = write_map[address >> 8];
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+    write_slow(address, value);
+}
+
+inline void Bus::write16(u16 addr, u16 value) {
+    write(addr, value & 0xFF);         // low byte
+    write(addr + 1, (value >> 8) & 0xFF); // high byte
+}
+
+inline u16 Bus::read16(u16 addr) {
+    u8 lo = read(addr);
+    u8 hi = read(addr + 1);
+    return lo | (hi << 8);
+}
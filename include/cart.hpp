@@ -1,6 +1,13 @@
 #pragma once
 
 #include "common.hpp"
+#include "rom_image.hpp"
+#include "battery.hpp"
+#include "mapper.hpp"
+#include "arena.hpp"
+#include "state_hash.hpp"
+
+class CPU;
 
 class RomHeader {
 public:
@@ -21,44 +28,74 @@ public:
 
 class Cartridge {
 private:
-    char filename[1024];
-    u32 rom_size;
-    u8* rom_data;
-    RomHeader* header;
-
-    static const char* ROM_TYPES[];
-    static const char* LIC_CODE[];
-
-    bool ram_enabled;
-    bool ram_banking;
-
-    u8 *rom_bank_x;
-    u8 banking_mode;
-
-    u8 rom_bank_value;
-    u8 ram_bank_value;
+    void bind_ram_banks(PageStore& store);
+    u32 ram_slot(u16 offset) const;  // store slot of a current bank offset
 
-    u8 *ram_bank; //current selected ram bank
-    u8 *ram_banks[16]; //all ram banks
+    // Used by bank switches and cartridge RAM writes
+    Mapper* mapper; //bank controller, owns the current bank pointers
+    const u8* rom_data;
+    u32 rom_size;
+    u32 ram_bank_size;
+    u8 ram_bank_count;
 
     //for battery
     bool battery; //has battery
     bool need_save; //should save battery backup
+    u32 ram_dirty[16]; //dirty 256 byte pages, one bit per page per bank
+    Pages ram_banks[16]; //all ram banks, slots of the machine's PageStore
+    PageStore* pages;
+    StateHash* hash;  // updated by RAM writes, nullptr when off
+
+    // Only needed while loading and saving
+    const RomImage* rom;   // shared, read-only ROM mapping
+    RomHeader* header;
+    RomHeader header_copy; // private copy, the title is patched here
+    BatteryFile battery_file; //background writer for the .battery file
+    const char* filename;  // load()'s argument, only used until setup_banking()
+    char* battery_path;    // "<rom>.battery" in the arena, battery carts only
+    bool persistent; //load and save the .battery file for battery carts
+
+    static const char* ROM_TYPES[];
+    static const char* LIC_CODE[];
 
 public:
     Cartridge();
     ~Cartridge();
     
     bool load(const char* cart);
+    // Before load(): false keeps battery RAM in memory only, so every load
+    // starts from the same state and instances never share a save file
+    void set_persistent(bool enabled) { persistent = enabled; }
     const char* get_lic_name() const;
     const char* get_type_name() const; 
+    // After load(): the private header copy, title terminated
+    const RomHeader& get_header() const { return *header; }
 
     bool is_mbc1();
-    void setup_banking();
+    size_t storage_size() const;  // arena bytes setup_banking() needs
+    u32 ram_pages() const;        // PageStore slots the RAM banks take
+    // RAM banks are the store's slots from CART_RAM_PAGE on
+    bool setup_banking(Arena& arena, PageStore& store);
+    // After load(): shares the ROM image, copies the banking state into a
+    // mapper in the arena and takes the RAM banks from store, which holds
+    // the parent's pages. Battery RAM of the copy is never saved
+    bool fork_from(const Cartridge& parent, Arena& arena, PageStore& store);
+    static size_t fork_storage_size() { return Arena::round_up(mapper_storage_size()); }
+    void set_cpu(CPU* cpu);
+    void set_state_hash(StateHash* h) { hash = h; }
     bool get_need_save();
     void battery_load();
     void battery_save();
 
     u8 read(u16 address);
     void write(u16 address, u8 value);
+
+    // ===== BUS PAGE TABLE =====
+    // Pointers for one 256 byte page of 0x0000-0x7FFF or 0xA000-0xBFFF,
+    // nullptr when accesses must go through read()/write()
+    const u8* read_page(u8 page) const;
+    u8* write_page(u8 page) const;
+
+    // ROM bank currently mapped at 0x4000-0x7FFF
+    u32 get_rom_bank() const { return mapper ? mapper->rom_bankx_index() : 1; }
 }; 
\ No newline at end of file
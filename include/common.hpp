@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdbool>
 #include <cstdio>
@@ -20,6 +21,30 @@ using u64 = uint64_t;
 // Debug mode flag - set to 1 to enable debug features, 0 to disable
 #define DEBUG_MODE 0
 
+// Per-opcode execution and cycle counters in the CPU (see cpu_profile.hpp).
+// Enabled with the GBEMU_CPU_PROFILE CMake option; costs nothing when 0
+#ifndef CPU_PROFILE
+#define CPU_PROFILE 0
+#endif
+
+// Deferred Z/N/H/C evaluation in the ALU handlers (see FlagOp in cpu.hpp).
+// On by default: over the bench_emu ROMs about half of the flag records are
+// replaced before anything reads F, so their flags are never computed.
+// 0 materializes flags right after every operation, for A/B comparisons
+#ifndef CPU_LAZY_FLAGS
+#define CPU_LAZY_FLAGS 1
+#endif
+
+// 8 bit ALU results and flags loaded from precomputed tables instead (see
+// alu_tables.hpp); 16 bit additions still go through the flag record
+#ifndef CPU_ALU_TABLES
+#define CPU_ALU_TABLES 0
+#endif
+
+// ===== MEMORY LAYOUT =====
+// Host cache line size, used to align the per-cycle component state
+constexpr size_t CACHE_LINE = 64;
+
 // ===== CPU FLAGS =====
 constexpr uint8_t FLAG_Z = 1 << 7; // Zero flag
 constexpr uint8_t FLAG_N = 1 << 6; // Subtract flag
@@ -32,10 +57,3 @@ constexpr uint8_t IT_LCD_STAT = 1 << 1;  // LCD Status interrupt
 constexpr uint8_t IT_TIMER = 1 << 2;     // Timer interrupt
 constexpr uint8_t IT_SERIAL = 1 << 3;    // Serial interrupt
 constexpr uint8_t IT_JOYPAD = 1 << 4;    // Joypad interrupt
-
-// ===== UTILITY FUNCTIONS =====
-/**
- * @brief Delay execution for specified milliseconds
- * @param ms Number of milliseconds to delay
- */
-void delay(u32 ms); 
\ No newline at end of file
@@ -4,12 +4,15 @@
 #include "instructions.hpp"
 #include "bus.hpp"
 #include "timer.hpp"
-#include "dma.hpp"
+#if CPU_PROFILE
+#include "cpu_profile.hpp"
+#endif
 
 class Bus;
 class Timer;
-class DMA;
 class PPU;
+class Profiler;
+class Trace;
 
 // Forward declaration for instruction processor function type
 using InstrFunc = void (*)(CPU* cpu, const Instruction* inst);
@@ -17,6 +20,25 @@ using InstrFunc = void (*)(CPU* cpu, const Instruction* inst);
 // Function declaration for instruction processor lookup
 InstrFunc inst_get_processor(InType type);
 
+/**
+ * @brief ALU operation whose flags have not been computed yet
+ *
+ * Arithmetic handlers record the operation and its operands instead of
+ * computing Z/N/H/C; CPU::sync_flags() folds the record into F when
+ * something reads it (conditions, PUSH AF, DAA, ADC/SBC, carry rotates,
+ * the trace). Flags an operation leaves unchanged are taken from F, which
+ * is synced before such an operation is recorded.
+ */
+enum class FlagOp : u8 {
+    NONE,    // F is up to date
+    ADD,     // ADD/ADC: lhs + rhs + carry
+    SUB,     // SUB/SBC/CP: lhs - rhs - carry
+    INC,     // INC r8: lhs is the result, C kept
+    DEC,     // DEC r8: lhs is the operand, C kept
+    ADD16,   // ADD HL,rr: Z kept
+    ADD_SP,  // ADD SP,e and LD HL,SP+e: rhs is the offset byte
+};
+
 /**
  * @brief CPU registers structure
  * 
@@ -39,6 +61,36 @@ public:
     u8 l;    // General purpose register
 };
 
+/**
+ * @brief Everything a CPU step touches, in the first cache line of the CPU
+ *
+ * CPU derives from it, so these are used as CPU members. A separate
+ * standard-layout struct so the static_assert below can check with
+ * offsetof that it fits the line Machine aligns the CPU to; keep new
+ * per-instruction fields here.
+ */
+struct CpuHotState {
+    Registers regs;
+    u16 fetched_data;
+    u16 mem_dest;
+    u8 cur_opcode;
+    bool dest_is_mem;
+    bool ime;              // Interrupt Master Enable flag
+    bool enabling_ime;
+    bool halted;
+    bool stopped;
+    u8 int_flags;
+    u8 ie_register;
+    u64 ticks;            // T-cycles executed since init
+    const Instruction* curr_inst;
+    Timer* timer = nullptr;
+    PPU* ppu = nullptr;
+    Bus* bus = nullptr;
+};
+
+static_assert(offsetof(CpuHotState, bus) + sizeof(Bus*) <= CACHE_LINE,
+              "the hot CPU state must fit in one cache line");
+
 /**
  * @brief Game Boy CPU emulator
  * 
@@ -48,7 +100,7 @@ public:
  * - Memory management
  * - Cycle-accurate timing
  */
-class CPU {
+class CPU : public CpuHotState {
 public:
     // ===== CONSTRUCTORS & DESTRUCTORS =====
     CPU();
@@ -63,8 +115,9 @@ public:
     // ===== COMPONENT CONNECTIONS =====
     void set_bus(Bus* b) { bus = b; }
     void set_timer(Timer* t) { timer = t; }
-    void set_dma(DMA* d) { dma = d; }
     void set_ppu(PPU* p) { ppu = p; }
+    void set_profiler(Profiler* p) { profiler = p; }
+    void set_trace(Trace* t) { trace = t; }
     
     // ===== REGISTER OPERATIONS =====
     u16 cpu_read_reg(RegType reg);
@@ -73,7 +126,15 @@ public:
     // ===== FLAG OPERATIONS =====
     void set_flags(u8 z, u8 n, u8 h, u8 c);
     void set_flag(u8 flag, bool value);
-    bool get_flag(u8 flag) const;
+    bool get_flag(u8 flag);
+
+    // ===== DEFERRED FLAGS =====
+    // Records an operation, its flags are computed when F is next read
+    void defer_flags(FlagOp op, u16 lhs, u16 rhs, u8 carry = 0);
+    // Replaces all four flags, znhc is the new upper nibble of F
+    void write_flags(u8 znhc);
+    // Brings regs.f up to date; call before reading it directly
+    void sync_flags() { if (flag_op != FlagOp::NONE) materialize_flags(); }
     
     // ===== STACK OPERATIONS =====
     void stack_push(u8 value);
@@ -97,44 +158,56 @@ public:
     
     // ===== UTILITY FUNCTIONS =====
     u16 little_to_big_endian(u16 little_endian);
+    u64 get_ticks() const { return ticks; }
+    u16 get_instruction_pc() const { return inst_pc; }  // of the instruction running
     
-    // ===== DEBUG FUNCTIONS =====
-    void dbg_update();
-    void dbg_print();
-
-    // ===== PUBLIC MEMBERS FOR INSTRUCTION EXECUTION =====
-    Registers regs;
-    Bus* bus;
-    u16 fetched_data;
-    u16 mem_dest;
-    bool dest_is_mem;
     void emu_cycles(int cycles);
-    bool ime;              // Interrupt Master Enable flag
-    bool enabling_ime;
-    u8 cur_opcode;
-    bool halted;
 
 private:
-    // ===== COMPONENT REFERENCES =====
-    Timer* timer;
-    DMA* dma;
-    PPU* ppu;
-    
-    // ===== CPU STATE =====
-    bool stopped;
-    int ticks;
-    
-    // ===== INSTRUCTION EXECUTION STATE =====
-    Instruction* curr_inst;
-    u8 int_flags;
-    u8 ie_register;
-    
+    // ===== DEFERRED FLAGS =====
+    // Open the second cache line, after the hot state; next to the hooks,
+    // the timer and the LCD
+    FlagOp flag_op;
+    u8 flag_carry;
+    u16 flag_lhs;
+    u16 flag_rhs;
+    u16 inst_pc;  // for watchpoint hits; fills the padding before the hooks
+
+    void materialize_flags();
+
+public:
+    // ===== OPTIONAL HOOKS =====
+    // Tested once per step
+    Profiler* profiler;    // guest sampling profiler, nullptr when off
+    Trace* trace;          // execution trace, nullptr when off
+
+#if CPU_PROFILE
+    CpuProfile profile;
+#endif
+
+private:
     // ===== INSTRUCTION FETCHING =====
     void fetch_instruction();
     void fetch_data();
     void execute();
-    
-    // ===== DEBUG STATE =====
-    char dbg_msg[1024];
-    int msg_size;
 };
+
+// ===== DEFERRED FLAGS =====
+
+inline void CPU::defer_flags(FlagOp op, u16 lhs, u16 rhs, u8 carry) {
+    if (op == FlagOp::INC || op == FlagOp::DEC || op == FlagOp::ADD16) {
+        sync_flags();  // the kept flag comes from the previous operation
+    }
+    flag_op = op;
+    flag_lhs = lhs;
+    flag_rhs = rhs;
+    flag_carry = carry;
+#if !CPU_LAZY_FLAGS
+    materialize_flags();
+#endif
+}
+
+inline void CPU::write_flags(u8 znhc) {
+    flag_op = FlagOp::NONE;
+    regs.f = (regs.f & 0x0F) | znhc;
+}
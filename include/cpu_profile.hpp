@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.hpp"
+#include "instructions.hpp"
+
+/**
+ * @brief Per-opcode execution and cycle counters for the CPU
+ *
+ * Compiled in only with CPU_PROFILE set (the GBEMU_CPU_PROFILE CMake
+ * option); otherwise the CPU has no profile member and CPU::step carries no
+ * extra code. Each executed instruction adds one count and the M-cycles it
+ * took, including the opcode fetch, to its slot in the main or CB table.
+ * Per InType totals are derived from those tables when the profile is
+ * written, so the hot path only touches two counters.
+ */
+class CpuProfile {
+public:
+    static constexpr int TYPE_COUNT = static_cast<int>(InType::SET) + 1;
+
+    // ===== CONSTRUCTORS =====
+    CpuProfile() { reset(); }
+
+    // ===== RECORDING =====
+    void record(u8 opcode, u8 cb_opcode, u32 m_cycles) {
+        if (opcode == 0xCB) {
+            cb_count[cb_opcode]++;
+            cb_cycles[cb_opcode] += m_cycles;
+        } else {
+            count[opcode]++;
+            cycles[opcode] += m_cycles;
+        }
+    }
+    void record_halt(u32 m_cycles) { halt_cycles += m_cycles; }
+    void record_interrupt(u32 m_cycles) {
+        interrupts++;
+        interrupt_cycles += m_cycles;
+    }
+
+    void reset();
+    void merge(const CpuProfile& other);
+
+    // ===== OUTPUT =====
+    /**
+     * @brief Write the profile, as JSON if the path ends in ".json", else CSV
+     * @return false if the file could not be written
+     */
+    bool write(const char* path) const;
+    bool write_csv(FILE* fp) const;
+    bool write_json(FILE* fp) const;
+
+    // ===== QUERIES =====
+    u64 total_instructions() const;
+    u64 total_cycles() const;  // instructions only, HALT and interrupts excluded
+    static InType cb_type(u8 cb_opcode);
+
+    // ===== COUNTERS =====
+    u64 count[256];
+    u64 cycles[256];
+    u64 cb_count[256];
+    u64 cb_cycles[256];
+    u64 halt_cycles;
+    u64 interrupts;
+    u64 interrupt_cycles;
+
+private:
+    void type_totals(u64* type_count, u64* type_cycles) const;
+};
@@ -5,19 +5,40 @@
 #include "bus.hpp"
 
 class Bus;
+class CPU;
 
+/**
+ * @brief OAM DMA controller (0xFF46)
+ *
+ * A transfer is not stepped byte by byte. Starting it captures a direct
+ * pointer to the 160 source bytes and locks the bus for the length of the
+ * transfer; the bytes are block copied into OAM when something can observe
+ * them (the PPU scanning OAM, or the CPU touching the bus after the lock
+ * window). The copy covers only the bytes the hardware would have moved by
+ * that cycle, so a scan in the middle of a transfer still sees partial OAM.
+ */
 class DMA {
     public:
+        DMA();
         void start(u8 start);
-        void tick();
+        void sync(u64 now);
+        void finish();
         bool transferring();
         void set_ppu(PPU* ppu);
         void set_bus(Bus* bus);
+        void set_cpu(CPU* cpu);
+        // A running transfer carries on in the copy; connections are left
+        // to the caller
+        void fork_from(const DMA& parent);
+        void set_state_hash(StateHash* h) { hash = h; }  // nullptr: none
     private:
         bool active;
-        u8 byte;
-        u8 value;
-        u8 start_delay;
+        u8 copied;          // bytes already in OAM
+        u64 start_tick;     // CPU T-cycle of the 0xFF46 write
+        const u8* source;   // 160 source bytes
+        u8 snapshot[0xA0];  // source copy for pages without direct memory
         PPU* ppu;
         Bus* bus;
-};
\ No newline at end of file
+        CPU* cpu;
+        StateHash* hash;    // updated for the bytes copied into OAM
+};
@@ -1,17 +1,9 @@
 #pragma once
 
 #include "common.hpp"
-#include "cart.hpp"
-#include "bus.hpp"
-#include "cpu.hpp"
-#include "ram.hpp"
+#include "machine.hpp"
+#include "ram_search.hpp"
 #include "ui.hpp"
-#include "io.hpp"
-#include "timer.hpp"
-#include "ppu.hpp"
-#include "dma.hpp"
-#include "lcd.hpp"
-#include "joypad.hpp"
 #include <thread>
 #include <mutex>
 #include <atomic>
@@ -28,6 +20,9 @@ public:
     std::atomic<bool> running;  // Continue emulation
     std::atomic<bool> die;      // Signal to stop emulation
     std::atomic<u64> ticks;     // Total CPU ticks executed
+    std::atomic<bool> profile_dump;  // Write the CPU profile from the CPU thread
+    std::atomic<bool> trace_toggle;  // Start or pause tracing from the CPU thread
+    std::atomic<u8> search_step;     // SearchStep for the CPU thread to run, 0 for none
     std::mutex context_mutex;   // Mutex for complex operations
 };
 
@@ -65,21 +60,24 @@ private:
     EmuContext ctx;
     
     // ===== EMULATOR COMPONENTS =====
-    Cartridge cartridge;
-    RAM ram;
-    Bus bus;
-    CPU cpu;
+    Machine machine;
     UI ui;
-    IO io;
-    Timer timer;
-    PPU ppu;
-    DMA dma;
-    LCD lcd;
-    Joypad joypad;
     
     // ===== THREADING =====
     std::thread cpu_thread;
+
+    // ===== PROFILING =====
+    const char* folded_path;  // guest sampling profile output, nullptr when off
+    const char* trace_path;   // execution trace output
+
+    // ===== RAM SEARCH =====
+    RamSearch* ram_search;  // created by the first F5
+
+    // ===== WATCHPOINTS =====
+    Watchpoints watchpoints;  // from --break and --watch, pause on a hit
     
     // ===== PRIVATE METHODS =====
     void cpu_run();  // CPU thread function
+    void write_profile();
+    void run_search_step(SearchStep step);
 }; 
\ No newline at end of file
@@ -0,0 +1,162 @@
+#pragma once
+
+/**
+ * @brief C interface for stepping many emulator instances in lockstep
+ *
+ * Built as the gbe_env shared library for training loops and other
+ * non-C++ hosts. One environment owns N instances of the same ROM and a
+ * BatchRunner pool; gbe_step() applies one action per instance, advances
+ * all of them in parallel and returns once every instance has reached the
+ * requested frame boundary.
+ *
+ * Instances run headless and unthrottled, and battery RAM is kept in
+ * memory only, so every reset starts from the same state.
+ *
+ * Frame, observation and WRAM pointers stay valid until the instance is
+ * reset or the environment destroyed. Calls on one environment must not
+ * overlap. No C++ exception leaves these functions: a failure inside,
+ * such as running out of memory, is printed and returns the function's
+ * error value (NULL, -1, or 0 for the counts).
+ */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define GBE_API __declspec(dllexport)
+#else
+#define GBE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ===== BUTTON MASK ===== */
+/* One byte per instance and step, bit set = held for the whole step */
+#define GBE_BUTTON_A      0x01
+#define GBE_BUTTON_B      0x02
+#define GBE_BUTTON_SELECT 0x04
+#define GBE_BUTTON_START  0x08
+#define GBE_BUTTON_RIGHT  0x10
+#define GBE_BUTTON_LEFT   0x20
+#define GBE_BUTTON_UP     0x40
+#define GBE_BUTTON_DOWN   0x80
+
+/* ===== FRAME REDUCTION ===== */
+/* Which of a step's frames reach the framebuffer; the others are emulated
+   exactly but produce no pixels */
+#define GBE_REDUCE_ALL          0  /* every frame, as gbe_step() */
+#define GBE_REDUCE_LAST         1  /* only the last frame */
+#define GBE_REDUCE_MAX_LAST_TWO 2  /* per channel max of the last two frames */
+
+/* ===== OBSERVATIONS ===== */
+/* Produced at VBlank of every rendered frame, see gbe_set_observation() */
+#define GBE_OBS_SHADE   0x01  /* GBE_WIDTH x GBE_HEIGHT bytes, DMG shade 0-3, 0 = lightest */
+#define GBE_OBS_GRAY    0x02  /* GBE_WIDTH x GBE_HEIGHT bytes, 8 bit luma */
+#define GBE_OBS_RESIZED 0x04  /* width x height bytes, area-averaged luma */
+
+/* ===== RAM SEARCH ===== */
+/* Regions a search covers, see gbe_search_start() */
+#define GBE_SEARCH_ROM      0x01  /* 0x0000-0x7FFF, banks as mapped */
+#define GBE_SEARCH_VRAM     0x02  /* 0x8000-0x9FFF */
+#define GBE_SEARCH_CART_RAM 0x04  /* 0xA000-0xBFFF, the bank mapped */
+#define GBE_SEARCH_WRAM     0x08  /* 0xC000-0xDFFF */
+#define GBE_SEARCH_OAM      0x10  /* 0xFE00-0xFE9F */
+#define GBE_SEARCH_HRAM     0x20  /* 0xFF80-0xFFFE */
+#define GBE_SEARCH_RAM      (GBE_SEARCH_CART_RAM | GBE_SEARCH_WRAM | GBE_SEARCH_HRAM)
+
+/* Unsigned byte comparisons, current OP operand */
+#define GBE_CMP_EQ 0
+#define GBE_CMP_NE 1
+#define GBE_CMP_LT 2
+#define GBE_CMP_GT 3
+#define GBE_CMP_LE 4
+#define GBE_CMP_GE 5
+
+/* ===== SIZES ===== */
+#define GBE_WIDTH     160
+#define GBE_HEIGHT    144
+#define GBE_WRAM_SIZE 0x2000
+#define GBE_FRAME_BYTES (GBE_WIDTH * GBE_HEIGHT / 4)
+
+typedef struct gbe_env gbe_env;
+
+/* ===== LIFETIME ===== */
+/* n instances of rom_path on a pool sized to the host's hardware threads;
+   NULL if the ROM cannot be loaded */
+GBE_API gbe_env* gbe_create(const char* rom_path, uint32_t n);
+GBE_API void gbe_destroy(gbe_env* env);
+
+/* Reloads the listed instances from the ROM, all of them when ids is NULL.
+   Returns 0, or -1 if an id is out of range or a reload failed */
+GBE_API int gbe_reset(gbe_env* env, const uint32_t* ids, uint32_t count);
+
+/* ===== STEPPING ===== */
+/* actions holds one button mask per instance. Every instance runs for
+   frames_per_action frames; returns the number of instances that stopped
+   early on an invalid opcode (0 on success), or -1 on a failure */
+GBE_API int gbe_step(gbe_env* env, const uint8_t* actions, uint32_t frames_per_action);
+
+/* As gbe_step(), with each action held for all frames_per_action frames and
+   the framebuffer produced per reduce (GBE_REDUCE_*) */
+GBE_API int gbe_step_repeat(gbe_env* env, const uint8_t* actions, uint32_t frames_per_action, int reduce);
+
+/* ===== STATE ===== */
+GBE_API uint32_t gbe_num_envs(const gbe_env* env);
+GBE_API uint32_t gbe_num_workers(const gbe_env* env);
+
+/* The frame as rendered: GBE_FRAME_BYTES, one DMG shade (0-3, 0 = lightest)
+   per 2 bits, four pixels per byte with the leftmost in the low bits, rows
+   GBE_WIDTH / 4 bytes apart. Updated in place as frames are rendered */
+GBE_API const uint8_t* gbe_frame(gbe_env* env, uint32_t id);
+
+/* GBE_WIDTH x GBE_HEIGHT pixels, 0xAARRGGBB, row major: gbe_frame() converted
+   on each call into a buffer the environment keeps, so it is a snapshot
+   until the next call */
+GBE_API const uint32_t* gbe_framebuffer(gbe_env* env, uint32_t id);
+
+/* Enables a set of GBE_OBS_* outputs on every instance, including ones
+   reset later; width and height size GBE_OBS_RESIZED (e.g. 84 x 84) and
+   may not exceed GBE_WIDTH x GBE_HEIGHT. Returns 0, or -1 on a bad size or
+   out of memory, with the previous outputs still in place */
+GBE_API int gbe_set_observation(gbe_env* env, uint32_t outputs, uint32_t width, uint32_t height);
+
+/* One GBE_OBS_* plane of an instance, NULL if that output is off */
+GBE_API const uint8_t* gbe_observation(gbe_env* env, uint32_t id, uint32_t output);
+
+/* 0xC000-0xDFFF, writable */
+GBE_API uint8_t* gbe_wram(gbe_env* env, uint32_t id);
+
+/* ===== RAM SEARCH ===== */
+/* Finds the addresses of an instance that hold a game variable. A search
+   keeps the instance's latest memory snapshot, the one before it and a set
+   of candidate addresses; each filter drops the candidates that fail its
+   test and returns how many remain, or -1 for a bad id, a bad compare or
+   an instance without a search. Searches survive gbe_reset() */
+
+/* Snapshots the GBE_SEARCH_* regions and makes all their addresses
+   candidates. Returns the count, or -1 */
+GBE_API int gbe_search_start(gbe_env* env, uint32_t id, uint32_t regions);
+
+/* Keeps the latest snapshot as the previous one and takes a new one.
+   Returns 0, or -1 */
+GBE_API int gbe_search_snapshot(gbe_env* env, uint32_t id);
+
+/* Keeps candidates whose latest value compares (GBE_CMP_*) to their
+   previous one: GBE_CMP_NE for changed, GBE_CMP_LT for decreased */
+GBE_API int gbe_search_previous(gbe_env* env, uint32_t id, int compare);
+
+/* Keeps candidates whose latest value compares to value */
+GBE_API int gbe_search_value(gbe_env* env, uint32_t id, int compare, uint8_t value);
+
+/* Keeps candidates that changed by exactly delta since the previous
+   snapshot, wrapping at 256: 1 for increased by one, -1 for decreased */
+GBE_API int gbe_search_delta(gbe_env* env, uint32_t id, int delta);
+
+/* Writes up to max candidate addresses in ascending order, and their latest
+   values unless values is NULL. Returns the total count, or -1 */
+GBE_API int gbe_search_results(gbe_env* env, uint32_t id, uint16_t* addresses, uint8_t* values, uint32_t max);
+
+#ifdef __cplusplus
+}
+#endif
@@ -125,7 +125,7 @@ struct Instruction {
  * @param opcode 8-bit instruction opcode
  * @return Pointer to instruction definition
  */
-Instruction* instruction_by_opcode(u8 opcode);
+const Instruction* instruction_by_opcode(u8 opcode);
 
 /**
  * @brief Get instruction name as string
@@ -28,7 +28,9 @@ public:
     
     // Button state management
     void set_button_state(u8 button, bool pressed);
-    void update_from_sdl_key(int sdl_key, bool pressed);
+    // Bit set = pressed, laid out like button_state: A, B, Select, Start in
+    // bits 0-3, Right, Left, Up, Down in bits 4-7
+    void set_buttons(u8 mask);
     
     // Get current button state for debugging
     u8 get_button_state() const { return button_state; }
@@ -36,9 +36,10 @@ class LCD {
         DMA* dma_controller;
 
         //other data...
-        u32 bg_colors[4];
-        u32 sp1_colors[4];
-        u32 sp2_colors[4];
+        // Shade 0-3 of each color index, as set by the palette registers
+        u8 bg_shades[4];
+        u8 sp1_shades[4];
+        u8 sp2_shades[4];
 
         // LCD Control Register (LCDC) getters
         bool lcdc_bgw_enable() const { return BIT(lcdc, 0); }
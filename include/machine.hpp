@@ -0,0 +1,170 @@
+#pragma once
+
+#include "common.hpp"
+#include "cart.hpp"
+#include "bus.hpp"
+#include "cpu.hpp"
+#include "ram.hpp"
+#include "io.hpp"
+#include "timer.hpp"
+#include "ppu.hpp"
+#include "dma.hpp"
+#include "lcd.hpp"
+#include "joypad.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "observation.hpp"
+#include "state_hash.hpp"
+
+/**
+ * @brief Which frames of a multi-frame run reach the frame buffer
+ *
+ * Skipped frames are emulated exactly, only their pixels are not produced.
+ */
+enum class FrameReduce : u8 {
+    ALL,           // every frame, as run_frames(count)
+    LAST,          // only the final frame
+    MAX_LAST_TWO,  // per channel max of the last two frames emulated, in place
+};
+
+/**
+ * @brief Bytes one machine occupies, by component
+ *
+ * Each component object, then the arena storage owned by the PPU, the
+ * cartridge and the observation, and the RAM pages with every page shared
+ * with forks split evenly between its sharers. Data every machine shares
+ * is not counted: the ROM image and the instruction and handler tables.
+ * Profiler samples and trace buffers only exist while those run.
+ */
+struct Footprint {
+    struct Item {
+        const char* name;
+        size_t bytes;
+    };
+    static constexpr u32 MAX_ITEMS = 24;
+
+    Item items[MAX_ITEMS];
+    u32 count = 0;
+    size_t total = 0;
+
+    void add(const char* name, size_t bytes);
+};
+
+/**
+ * @brief Game Boy hardware without any front end
+ *
+ * Owns and wires every emulated component. The SDL front end drives it from
+ * its CPU thread; tools and benchmarks drive it directly, headless and
+ * unthrottled.
+ *
+ * There is deliberately no user-provided constructor: creating it with
+ * `new Machine()` value-initializes, which zero-fills the components that
+ * have no constructor of their own, so every run starts from the same state.
+ *
+ * The mapper, battery buffers and the frame buffer live in a per-machine
+ * arena reserved by load(), and WRAM, VRAM and cartridge RAM in its page
+ * store. From then on, with profiling and tracing off, stepping the machine
+ * performs no heap allocation, except for copying pages it shares with a
+ * fork.
+ */
+class Machine {
+public:
+    // ===== INITIALIZATION =====
+    bool load(const char* rom_path);
+
+    // ===== FORKING =====
+    // A new machine in the same state, to be deleted by the caller; nullptr
+    // if out of memory. RAM pages stay shared with this machine until
+    // either side writes them. The copy never saves battery RAM and runs
+    // without profiler, trace or watchpoints. Not while this machine is
+    // being stepped
+    Machine* fork();
+
+    // ===== MAIN EXECUTION =====
+    bool step();
+    bool run_frames(u32 count);
+    // Holds joypad_mask (see Joypad::set_buttons) for count frames
+    bool run_frames(u32 count, u8 joypad_mask, FrameReduce reduce);
+    // PPU output for a frame with remaining frames, itself included, left
+    void select_output(u32 remaining, FrameReduce reduce);
+
+    // ===== CONFIGURATION =====
+    void set_throttle(bool enabled) { ppu.set_throttle(enabled); }
+    void set_persistent(bool enabled) { cartridge.set_persistent(enabled); }  // before load()
+    // Before load(): false leaves out the frame buffer and renders nothing,
+    // for hosts that only read memory. Timing is unaffected
+    void set_frame_buffer(bool enabled) { with_frame_buffer = enabled; }
+    // OBS_* outputs produced at every rendered VBlank, 0 for none
+    bool set_observation(u8 outputs, u32 width = 0, u32 height = 0);
+
+    // ===== PROFILING =====
+    // Samples the guest PC every period T-cycles; sym_path may be nullptr
+    void start_profiler(u32 period, const char* sym_path);
+    void stop_profiler() { cpu.set_profiler(nullptr); }
+
+    // ===== TRACING =====
+    // Opens path on first use, later calls resume the same file
+    bool start_trace(const char* path);
+    void pause_trace() { cpu.set_trace(nullptr); }
+    void stop_trace();
+    bool is_tracing() const { return cpu.trace != nullptr; }
+
+    // ===== WATCHPOINTS =====
+    // Reports the accesses w watches to its callback while this machine
+    // steps, nullptr to detach. w belongs to the caller and must stay
+    // alive while attached
+    void set_watchpoints(Watchpoints* w) { bus.set_watchpoints(w); }
+
+    // ===== STATE HASH =====
+    // Off by default. While on, every store to WRAM, VRAM, OAM, HRAM and
+    // cartridge RAM updates a 64-bit hash of them, at the price of sending
+    // those stores through the bus slow path. Turning it on, after load(),
+    // hashes memory from scratch once; forks inherit it
+    void set_state_hash(bool enabled);
+    bool is_state_hashing() const { return bus_hashing; }
+    // O(1): the memory hash combined with the CPU registers, 0 while off.
+    // Equal hashes mean equal memory and registers with near certainty;
+    // timer, PPU and I/O state are not included
+    u64 state_hash();
+    // The same value computed from scratch, whether hashing is on or not
+    u64 compute_state_hash();
+
+    // ===== STATISTICS =====
+    u64 get_instructions() const { return instructions; }
+    Footprint footprint() const;
+
+    // ===== COMPONENTS =====
+    // Declared first so they outlive the components using their storage
+    Arena arena;
+    PageStore pages;
+
+    // Per-cycle state, in the order a T-cycle touches it. The hot fields of
+    // the CPU fill the first cache line; the timer and LCD registers sit
+    // right behind it in the second, and the PPU starts on a fresh line
+    alignas(CACHE_LINE) CPU cpu;
+    Timer timer;
+    LCD lcd;
+    alignas(CACHE_LINE) PPU ppu;
+    alignas(CACHE_LINE) Bus bus;
+
+    // Reached through the bus slow path or only per frame
+    DMA dma;
+    IO io;
+    Joypad joypad;
+    RAM ram;
+    Cartridge cartridge;
+    Profiler profiler;
+    Trace trace;
+    Observation observation;
+    StateHash memory_hash;
+
+private:
+    void connect();
+    void connect_state_hash(bool enabled);
+    StateHash hash_memory();
+    u64 register_hash();
+
+    u64 instructions = 0;  // instructions executed, HALT cycles excluded
+    bool with_frame_buffer = true;
+    bool bus_hashing = false;
+};
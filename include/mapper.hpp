@@ -0,0 +1,177 @@
+#pragma once
+
+#include "common.hpp"
+#include "pages.hpp"
+
+class CPU;
+
+/**
+ * @brief Cartridge memory bank controller (MBC)
+ *
+ * A mapper owns the banking registers of a cartridge and keeps cached
+ * pointers to the currently selected ROM and RAM banks. The pointers are
+ * only recomputed when a control register is written, so the bus can map
+ * them straight into its page table and normal reads never reach the
+ * mapper at all.
+ *
+ * - rom_bank0: bank visible at 0x0000-0x3FFF
+ * - rom_bankx: bank visible at 0x4000-0x7FFF
+ * - ram_bank:  pages of the bank visible at 0xA000-0xBFFF, nullptr when RAM
+ *              is disabled, absent or replaced by mapper registers (MBC3 RTC)
+ *
+ * RAM banks are page slots of the machine's PageStore, so the mapper sees
+ * a page that was copied on write without being told.
+ */
+class Mapper {
+public:
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    Mapper(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    virtual ~Mapper() {}
+
+    // ===== CONTROL REGISTERS (0x0000-0x7FFF) =====
+    virtual void write(u16 address, u8 value) = 0;
+
+    // ===== EXTERNAL RAM SLOW PATH (0xA000-0xBFFF) =====
+    virtual u8 read_ram(u16 address);
+    virtual void write_ram(u16 address, u8 value);
+
+    // ===== COMPONENT CONNECTIONS =====
+    void set_cpu(CPU* c) { cpu = c; }
+
+    // ===== FORKING =====
+    // Copy of this mapper placed in storage (mapper_storage_size() bytes),
+    // banking state included; point it at the new RAM banks with rebind()
+    virtual Mapper* clone(void* storage) const = 0;
+    void rebind(Pages* banks);
+
+    // Number of the bank at 0x4000-0x7FFF
+    u32 rom_bankx_index() const { return static_cast<u32>((rom_bankx - rom) / 0x4000); }
+
+    // ===== CACHED BANK STATE =====
+    const u8* rom_bank0;
+    const u8* rom_bankx;
+    Pages ram_bank;
+    u8 ram_bank_index;     // index of ram_bank in ram_banks, for dirty tracking
+    u16 ram_mask;          // offset mask inside a RAM bank (mirroring)
+    bool ram_direct_write; // plain byte stores are valid for ram_bank
+
+protected:
+    const u8* rom_bank_ptr(u32 bank) const;
+    void select_ram(u32 bank);
+
+    const u8* rom;
+    u32 rom_bank_count;
+    Pages* ram_banks;
+    u8 ram_bank_count;
+    bool ram_enabled;
+    CPU* cpu;
+};
+
+/**
+ * @brief Cartridges without a controller (ROM only, ROM+RAM)
+ */
+class NoMBC final : public Mapper {
+public:
+    NoMBC(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    void write(u16 address, u8 value) override;
+    Mapper* clone(void* storage) const override;
+};
+
+/**
+ * @brief MBC1: 5+2 bit ROM bank, up to 4 RAM banks, banking mode select
+ */
+class MBC1 final : public Mapper {
+public:
+    MBC1(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    void write(u16 address, u8 value) override;
+    Mapper* clone(void* storage) const override;
+
+private:
+    void update_banks();
+
+    u8 bank1;        // 2000-3FFF, 5 bits, 0 reads as 1
+    u8 bank2;        // 4000-5FFF, 2 bits
+    u8 banking_mode; // 6000-7FFF
+};
+
+/**
+ * @brief MBC2: 4 bit ROM bank, built-in 512 x 4 bit RAM
+ */
+class MBC2 final : public Mapper {
+public:
+    MBC2(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    void write(u16 address, u8 value) override;
+    Mapper* clone(void* storage) const override;
+    void write_ram(u16 address, u8 value) override;
+};
+
+/**
+ * @brief MBC3: 7 bit ROM bank, 4 RAM banks and a real time clock
+ *
+ * The clock is not ticked. It is stored as a second count taken at a CPU
+ * cycle stamp, and the registers are derived from the cycle counter only
+ * when the game latches or writes them.
+ */
+class MBC3 final : public Mapper {
+public:
+    MBC3(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    void write(u16 address, u8 value) override;
+    Mapper* clone(void* storage) const override;
+    u8 read_ram(u16 address) override;
+    void write_ram(u16 address, u8 value) override;
+
+private:
+    void update_banks();
+    u64 rtc_seconds() const;
+    void rtc_set_seconds(u64 seconds);
+
+    u8 rom_bank;
+    u8 ram_select;     // 0x00-0x03 RAM bank, 0x08-0x0C RTC register
+    u8 latch_state;    // last value written to 6000-7FFF
+    u8 latched[5];     // S, M, H, DL, DH as of the last latch
+
+    u64 rtc_base;      // clock value in seconds at rtc_stamp
+    u64 rtc_stamp;     // CPU cycle the base was taken at
+    bool rtc_halted;   // DH bit 6
+    bool rtc_carry;    // DH bit 7, day counter overflow
+};
+
+/**
+ * @brief MBC5: 9 bit ROM bank, 16 RAM banks
+ */
+class MBC5 final : public Mapper {
+public:
+    MBC5(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count);
+    void write(u16 address, u8 value) override;
+    Mapper* clone(void* storage) const override;
+
+private:
+    void update_banks();
+
+    u16 rom_bank;
+    u8 ram_bank_value;
+};
+
+/**
+ * @brief Construct the mapper for a cartridge type byte (header 0x147)
+ *
+ * The mapper is placed in `storage`, which must hold mapper_storage_size()
+ * bytes; destroy it with an explicit ~Mapper() call.
+ * @return The mapper, or nullptr for unsupported controllers
+ */
+Mapper* create_mapper(u8 type, const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count, void* storage);
+
+/**
+ * @brief Same as create_mapper, always a NoMBC
+ */
+Mapper* create_plain_mapper(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count, void* storage);
+
+/**
+ * @brief Bytes needed to construct any mapper
+ */
+size_t mapper_storage_size();
+
+/**
+ * @brief Size of one external RAM bank for a cartridge type
+ */
+u32 mapper_ram_bank_size(u8 type);
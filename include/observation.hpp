@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.hpp"
+#include "arena.hpp"
+#include "ppu.hpp"
+
+// ===== OUTPUT FLAGS =====
+constexpr u8 OBS_SHADE = 1 << 0;    // XRES x YRES, one DMG shade 0-3 per byte, 0 = lightest
+constexpr u8 OBS_GRAY = 1 << 1;     // XRES x YRES, 8 bit luma
+constexpr u8 OBS_RESIZED = 1 << 2;  // width x height, area-averaged 8 bit luma
+
+/**
+ * @brief Compact views of the frame buffer for consumers that don't need ARGB
+ *
+ * Filled once per rendered frame when the PPU enters VBlank, straight from
+ * the packed frame buffer while it is still in cache, so a consumer gets
+ * one byte per pixel without unpacking shades itself. Gray is the luma
+ * (77 R + 150 G + 29 B) / 256 of DMG_COLORS, i.e. 255, 170, 85 and 0.
+ *
+ * The resize is a box filter: each output pixel is the average of the
+ * source area it covers, with 8 bit fixed point weights precomputed by
+ * configure(). The vertical pass uses SSE2 where available.
+ *
+ * All buffers live in the observation's own arena, reserved by configure(),
+ * so capturing allocates nothing.
+ */
+class Observation {
+public:
+    // ===== CONFIGURATION =====
+    // outputs is a set of OBS_* flags, 0 to turn capturing off. width and
+    // height size OBS_RESIZED and may not exceed XRES x YRES; on a bad size
+    // the current configuration is kept
+    bool configure(u8 outputs, u32 width, u32 height);
+    static bool supports(u8 outputs, u32 width, u32 height) {
+        return !(outputs & OBS_RESIZED) || (width && height && width <= XRES && height <= YRES);
+    }
+    u8 get_outputs() const { return outputs; }
+    u32 get_width() const { return width; }
+    u32 get_height() const { return height; }
+    size_t get_storage() const { return arena.get_capacity(); }  // bytes reserved for the planes
+
+    // ===== CAPTURE =====
+    // frame is the packed frame buffer, see FRAME FORMAT in ppu.hpp
+    void capture(const u8* frame);
+
+    // ===== BUFFERS =====
+    // nullptr for outputs that are not enabled
+    const u8* shade() const { return shade_plane; }
+    const u8* gray() const { return (outputs & OBS_GRAY) ? gray_plane : nullptr; }
+    const u8* resized() const { return resized_plane; }
+
+private:
+    static void make_taps(u32 src, u32 dst, u32 taps, u16* start, u16* weights);
+    void resize();
+
+    Arena arena;
+    u8 outputs = 0;
+    u32 width = 0;
+    u32 height = 0;
+
+    // Planes; gray is filled whenever any output is on, the resize reads it
+    u8* gray_plane = nullptr;
+    u8* shade_plane = nullptr;
+    u8* resized_plane = nullptr;
+
+    // Box filter taps, weights sum to 256 per output pixel
+    u32 x_taps = 0;
+    u32 y_taps = 0;
+    u16* x_start = nullptr;
+    u16* x_weights = nullptr;  // width * x_taps
+    u16* y_start = nullptr;
+    u16* y_weights = nullptr;  // height * y_taps
+    u16* row_sum = nullptr;    // XRES, one output row before the horizontal pass
+};
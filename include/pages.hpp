@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.hpp"
+#include "arena.hpp"
+#include <atomic>
+
+// ===== PAGE LAYOUT =====
+// Pages are the size of a bus page table entry. Slots of a machine's store
+// in order: WRAM, VRAM, then the cartridge RAM banks
+constexpr u32 PAGE_SIZE = 0x100;
+constexpr u32 WRAM_PAGE = 0;
+constexpr u32 VRAM_PAGE = WRAM_PAGE + 0x2000 / PAGE_SIZE;
+constexpr u32 CART_RAM_PAGE = VRAM_PAGE + 0x2000 / PAGE_SIZE;
+
+// Consecutive slots of one region: pages[i] is its i-th page
+using Pages = u8**;
+
+/**
+ * @brief Guest RAM in 256 byte pages that forked machines share
+ *
+ * WRAM, VRAM and cartridge RAM live here rather than in their components.
+ * share() gives a forked machine every page of its parent; a page then
+ * stays shared until one side writes to it, and the writer first swaps in
+ * a private copy with writable(). The bus maps shared pages for reading
+ * only, so stores reach the copy through the write slow path and the fast
+ * path never sees a shared page. A fork therefore costs the slot tables,
+ * and a machine pays for a page only once it has written it.
+ *
+ * A loaded machine's pages come from one zeroed block, in slot order, and
+ * each copy is a block of its own; a block is freed when none of its pages
+ * is referenced any more. Reference counts are atomic because relatives
+ * may step on other threads. A machine must not be forked while stepping.
+ */
+class PageStore {
+public:
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    PageStore() = default;
+    PageStore(const PageStore&) = delete;
+    PageStore& operator=(const PageStore&) = delete;
+    ~PageStore() { release(); }
+
+    // ===== SETUP =====
+    // The slot tables are taken from the arena
+    static constexpr size_t table_size(u32 count) {
+        return Arena::round_up(count * sizeof(u8*)) + Arena::round_up(count * sizeof(void*));
+    }
+    bool init(Arena& arena, u32 count);                 // count zeroed private pages
+    bool share(Arena& arena, const PageStore& parent);  // every page of parent
+    void release();
+
+    // ===== ACCESS =====
+    u32 size() const { return count; }
+    Pages slots(u32 first) const { return data + first; }
+    bool shared(u32 slot) const { return pages[slot]->refs.load(std::memory_order_acquire) > 1; }
+    // The slot's page, copied first if shared; nullptr if the copy failed
+    u8* writable(u32 slot) { return shared(slot) ? unshare(slot) : data[slot]; }
+    // Start of count slots if they are private and back to back in memory
+    u8* contiguous(u32 first, u32 count) const;
+
+    // ===== STATISTICS =====
+    u32 shared_count() const;
+    // Page bytes with each shared page split evenly between its sharers
+    size_t amortized_bytes() const;
+
+private:
+    struct Block;
+    struct Page {
+        std::atomic<u32> refs;  // slots referencing the page, in any store
+        Block* block;
+    };
+
+    u8* unshare(u32 slot);
+    static Block* alloc_block(u32 count);
+    static void drop(Page* page);
+
+    u32 count = 0;
+    u8** data = nullptr;     // per slot
+    Page** pages = nullptr;  // per slot
+};
@@ -3,11 +3,16 @@
 #include "common.hpp"
 #include "lcd.hpp"
 #include "ppu_sm.hpp"
+#include "pages.hpp"
+#include "state_hash.hpp"
 #include "bus.hpp"
+#include "arena.hpp"
 
 class CPU;
 class Bus;
 class Cartridge;
+class DMA;
+class Observation;
 
 // ===== PPU CONSTANTS =====
 constexpr int LINES_PER_FRAME = 154;
@@ -15,6 +20,25 @@ constexpr int TICKS_PER_LINE = 456;
 constexpr int YRES = 144;
 constexpr int XRES = 160;
 
+// ===== FRAME FORMAT =====
+// The frame buffer holds each pixel's DMG shade after palette mapping (0-3,
+// 0 = lightest), four pixels per byte with the leftmost in the low bits and
+// rows FRAME_STRIDE bytes apart. Palettes are applied as pixels are pushed,
+// so mid-frame palette writes show exactly as on hardware; only the shade
+// to color mapping is left to whoever presents the frame.
+constexpr u32 FRAME_STRIDE = XRES / 4;
+constexpr u32 FRAME_BYTES = FRAME_STRIDE * YRES;
+constexpr u32 DMG_COLORS[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+
+inline u8 frame_shade(const u8* frame, u32 x, u32 y) {
+    return (frame[y * FRAME_STRIDE + x / 4] >> ((x % 4) * 2)) & 0b11;
+}
+
+// XRES x YRES pixels, palette[shade] each; SSE2 where available
+void frame_to_argb(const u8* frame, const u32 palette[4], u32* argb);
+// XRES x YRES bytes, values[shade] each
+void frame_to_bytes(const u8* frame, const u8 values[4], u8* out);
+
 /**
  * @brief Object Attribute Memory entry
  * 
@@ -54,21 +78,18 @@ enum fetch_state {
     FS_PUSH,   // Pushing pixels to FIFO
 };
 
-/**
- * @brief FIFO entry for pixel data
- */
-struct fifo_entry {
-    u32 value;
-    fifo_entry* next;
-};
-
 /**
  * @brief Pixel FIFO queue
+ *
+ * Fixed ring: the fetcher only adds 8 pixels while 8 or fewer are queued,
+ * so 16 slots always suffice.
  */
+constexpr u32 FIFO_CAPACITY = 16;
+
 struct fifo {
-    fifo_entry* head;
-    fifo_entry* tail;
+    u32 head;
     u32 size;
+    u8 data[FIFO_CAPACITY];  // shades
 };
 
 /**
@@ -76,7 +97,6 @@ struct fifo {
  */
 struct pixel_fifo {
     fetch_state cur_fetch_state;
-    fifo pixel_fifo;
     u8 line_x;
     u8 pushed_x;
     u8 fetch_x;
@@ -86,6 +106,20 @@ struct pixel_fifo {
     u8 map_x;
     u8 tile_y;
     u8 fifo_x;
+    fifo pixel_fifo;
+};
+
+/**
+ * @brief What the pixel pipeline does with finished pixels
+ *
+ * The fetcher and FIFO advance the same way in every mode, so the length
+ * of mode 3, and STAT, LY and the interrupts timed from it, are unchanged.
+ */
+enum class PixelOutput : u8 {
+    WRITE,  // store into the frame buffer
+    SKIP,   // drop; tile and sprite data are neither fetched nor mixed
+    MAX,    // the lighter of the pixel and the buffer contents (the previous
+            // frame), i.e. the per channel max once shown in gray
 };
 
 /**
@@ -113,27 +147,49 @@ public:
     ~PPU();
     
     // ===== INITIALIZATION =====
-    void init();
+    // The frame buffer is taken from the arena. Without one, frame_buffer
+    // is nullptr and every frame is run as PixelOutput::SKIP
+    static constexpr size_t STORAGE_SIZE = Arena::round_up(FRAME_BYTES);
+    void init(Arena& arena, bool with_frame_buffer = true);
+    // VRAM is the store's 32 slots from VRAM_PAGE on
+    void set_pages(PageStore* pages) { store = pages; vram = pages->slots(VRAM_PAGE); }
+    // In place of init(): parent's state, VRAM from store, which shares the
+    // parent's pages, and a copy of the frame buffer in the arena if the
+    // parent has one. Connections and the observation are left to the caller
+    void fork_from(const PPU& parent, Arena& arena, PageStore& pages);
     
     // ===== MAIN EXECUTION =====
     void tick();
     
     // ===== COMPONENT CONNECTIONS =====
-    void set_cpu(CPU* c) { cpu = c; }
+    void set_cpu(CPU* c) { cpu = c; ppu_sm.set_cpu(c); }
     void set_lcd(LCD* l) { lcd = l; }
     void set_bus(Bus* b) { bus = b; }
     void set_cart(Cartridge* c) { cart = c; }
+    void set_dma(DMA* d) { dma = d; }
+    void set_observation(Observation* o) { observation = o; }  // nullptr: none
+    void set_state_hash(StateHash* h) { hash = h; }            // nullptr: none
+
+    // ===== CONFIGURATION =====
+    // Throttling holds each frame to 60 Hz and prints the FPS counter
+    void set_throttle(bool enabled) { ppu_sm.throttle = enabled; }
+    // Takes effect from the next pixel; init() resets it to WRITE
+    void set_output(PixelOutput mode) { output = frame_buffer ? mode : PixelOutput::SKIP; }
     
     // ===== MEMORY ACCESS =====
     void oam_write(u16 address, u8 value);
     u8 oam_read(u16 address);
     void vram_write(u16 address, u8 value);
     u8 vram_read(u16 address);
+    // One 256 byte page, used to map VRAM into the bus page table
+    u8* vram_page(u32 page) const { return vram[page]; }
+    bool vram_shared(u32 page) const { return store->shared(VRAM_PAGE + page); }
+    u8* oam_data() { return reinterpret_cast<u8*>(oam); }
     void lcd_write(u16 address, u8 value);
     
     // ===== PIXEL FIFO OPERATIONS =====
-    void pixel_fifo_push(u32 value);
-    u32 pixel_fifo_pop();
+    void pixel_fifo_push(u8 shade);
+    u8 pixel_fifo_pop();
     
     // ===== PIPELINE OPERATIONS =====
     void pipeline_fetch();
@@ -146,34 +202,44 @@ public:
     void pipeline_load_window_tile();
     
     // ===== SPRITE OPERATIONS =====
-    u32 fetch_sprite_pixels(u8 bit, u32 color, u8 bg_color);
+    u8 fetch_sprite_pixels(u8 bit, u8 shade, u8 bg_color);
     
     // ===== WINDOW OPERATIONS =====
     bool window_visible();
 
     // ===== PUBLIC MEMBERS FOR EMULATOR ACCESS =====
+    // Per-dot state first: these and the fetcher state in pf start the
+    // object, which Machine aligns to a cache line. OAM, the line sprite
+    // list and VRAM follow; the frame pacing state is cold.
+    u32 line_ticks;
     u32 current_frame;
     LCD* lcd;
     CPU* cpu;
+    u8* frame_buffer;  // FRAME_BYTES, see FRAME FORMAT; may be nullptr
+    oam_line_entry* line_sprites;
     u8 window_line;
     u8 line_sprite_count;
-    oam_line_entry line_entry_array[10];
-    oam_entry oam[40];
-    oam_line_entry* line_sprites;
-    u32 line_ticks;
+    PixelOutput output;
+
+private:
+    u8 fetched_entry_count;
+    oam_entry fetched_entries[3];
+    Bus* bus;
+
+public:
     pixel_fifo pf;
+    oam_entry oam[40];
+    oam_line_entry line_entry_array[10];
     Cartridge* cart;
-    u32* video_buffer;
+    DMA* dma;
+    Observation* observation;  // filled at VBlank of every rendered frame
 
 private:
-    // ===== COMPONENT REFERENCES =====
+    // ===== COLD STATE =====
     PPU_SM ppu_sm;
-    Bus* bus;
-    
-    // ===== FETCH STATE =====
-    u8 fetched_entry_count;
-    oam_entry fetched_entries[3];
-    
+
     // ===== MEMORY =====
-    u8 vram[0x2000];
+    PageStore* store;
+    Pages vram;
+    StateHash* hash;  // updated by VRAM and OAM writes, nullptr when off
 }; 
\ No newline at end of file
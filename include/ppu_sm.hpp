@@ -1,7 +1,6 @@
 #pragma once
 
 #include "common.hpp"
-#include <SDL.h>
 
 class PPU;
 class CPU;
@@ -11,6 +10,7 @@ class PPU_SM {
         PPU* ppu;
         CPU* cpu;
 
+        bool throttle = true;
         u32 target_frame_time = 1000 / 60;
         long prev_frame_time = 0;
         long start_timer = 0;
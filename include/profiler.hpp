@@ -0,0 +1,84 @@
+#pragma once
+
+#include "common.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+class Cartridge;
+
+/**
+ * @brief Sampling profiler for guest code
+ *
+ * Every `period` T-cycles the CPU hands the profiler its PC, which is
+ * recorded together with a shadow call stack. The shadow stack follows
+ * CALL, RST and interrupt entry and is unwound on RET/RETI, and also
+ * whenever SP rises above a frame's return address slot, so code that pops
+ * its return address and jumps does not leave stale frames behind.
+ *
+ * Addresses are bank qualified (ROM bank for 0x4000-0x7FFF, WRAM bank 1 for
+ * 0xD000-0xDFFF, bank 0 elsewhere) and resolved through an RGBDS .sym file
+ * when one is loaded. write_folded() emits one "caller;callee;leaf count"
+ * line per distinct stack, the input format of flamegraph.pl, inferno and
+ * speedscope.
+ *
+ * The CPU only holds a pointer; when it is null the cost is one branch per
+ * step, plus one on each taken call and return.
+ */
+class Profiler {
+public:
+    static constexpr u32 DEFAULT_PERIOD = 1024;  // T-cycles between samples
+
+    // ===== SETUP =====
+    Profiler();
+    void set_cartridge(Cartridge* c) { cart = c; }
+    void set_period(u32 t_cycles) { period = t_cycles ? t_cycles : 1; }
+    bool load_symbols(const char* path);
+    // Drops all samples and reserves the shadow stack; before profiling
+    void reset();
+
+    // ===== CPU EVENTS =====
+    void on_call(u16 target, u16 sp);
+    void on_interrupt(u16 vector, u16 sp);
+    void on_return(u16 sp) { unwind(sp); }
+    void sample(u64 ticks, u16 pc, u16 sp) {
+        if (ticks >= next_sample) {
+            record(pc, sp);
+            next_sample = ticks + period;
+        }
+    }
+
+    // ===== OUTPUT =====
+    bool write_folded(const char* path) const;
+    u64 get_samples() const { return samples; }
+
+private:
+    static constexpr size_t MAX_DEPTH = 256;
+    static constexpr u32 INTERRUPT_FRAME = 1u << 24;
+
+    struct Frame {
+        u32 address;  // INTERRUPT_FRAME | bank << 16 | address
+        u16 sp;       // SP after the return address was pushed
+    };
+
+    struct Symbol {
+        u32 address;  // bank << 16 | address
+        std::string name;
+    };
+
+    void record(u16 pc, u16 sp);
+    void push(u32 address, u16 sp);
+    void unwind(u32 sp);
+    u32 qualify(u16 address) const;
+    std::string name(u32 address) const;
+
+    Cartridge* cart;
+    u32 period;
+    u64 next_sample;
+    u64 samples;
+
+    std::vector<Frame> frames;
+    std::map<std::vector<u32>, u64> stacks;  // root first, leaf last
+    std::vector<Symbol> symbols;             // sorted by address
+    std::vector<u32> key;                    // scratch for record()
+};
@@ -1,19 +1,34 @@
 #pragma once
 
 #include "common.hpp"
+#include "pages.hpp"
+#include "state_hash.hpp"
 
 class RAM {
 private:
-    // Work RAM (WRAM) - 8KB total
+    // Work RAM (WRAM) - 8KB total, 32 pages in the machine's PageStore
     // C000-CFFF: 4KB WRAM Bank 0
     // D000-DFFF: 4KB WRAM Bank 1 (switchable in CGB mode)
-    u8 wram[0xDFFF - 0xC000 + 1];  // 8KB total WRAM
+    PageStore* store;
+    Pages wram;
     
     // High RAM (HRAM) - 127 bytes
     // FF80-FFFE: High RAM
     u8 hram[0xFFFE - 0xFF80 + 1];   // 127 bytes HRAM
 
+    StateHash* hash;  // updated by every write, nullptr when off
+
 public:
+    // ===== BACKING STORAGE =====
+    void set_pages(PageStore* pages) { store = pages; wram = pages->slots(WRAM_PAGE); }
+    // One 256 byte page, used to map WRAM into the bus page table
+    u8* wram_page(u32 page) const { return wram[page]; }
+    bool wram_shared(u32 page) const { return store->shared(WRAM_PAGE + page); }
+    // All of WRAM as one block, nullptr once pages are shared with or
+    // copied from a forked machine
+    u8* wram_data() { return store->contiguous(WRAM_PAGE, 0x2000 / PAGE_SIZE); }
+    const u8* hram_data() const { return hram; }
+    void set_state_hash(StateHash* h) { hash = h; }
     
     // Read from RAM
     u8 read_wram(u16 address);
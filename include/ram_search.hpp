@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.hpp"
+
+class Machine;
+
+// ===== SEARCH REGIONS =====
+// Bus address ranges a search snapshots and starts with as candidates.
+// Cartridge RAM is the bank mapped at 0xA000 when the snapshot is taken
+constexpr u8 SEARCH_ROM = 1 << 0;       // 0x0000-0x7FFF, banks as mapped
+constexpr u8 SEARCH_VRAM = 1 << 1;      // 0x8000-0x9FFF
+constexpr u8 SEARCH_CART_RAM = 1 << 2;  // 0xA000-0xBFFF
+constexpr u8 SEARCH_WRAM = 1 << 3;      // 0xC000-0xDFFF
+constexpr u8 SEARCH_OAM = 1 << 4;       // 0xFE00-0xFE9F
+constexpr u8 SEARCH_HRAM = 1 << 5;      // 0xFF80-0xFFFE
+constexpr u8 SEARCH_RAM = SEARCH_CART_RAM | SEARCH_WRAM | SEARCH_HRAM;
+constexpr u8 SEARCH_ALL = SEARCH_ROM | SEARCH_VRAM | SEARCH_RAM | SEARCH_OAM;
+
+// Unsigned byte comparison of a filter, current OP operand
+enum class SearchCompare : u8 {
+    EQUAL,
+    NOT_EQUAL,
+    LESS,
+    GREATER,
+    LESS_EQUAL,
+    GREATER_EQUAL,
+};
+
+// One step of the emulator's RAM search hotkeys
+enum class SearchStep : u8 {
+    NONE,
+    START,      // F5: new search over SEARCH_RAM
+    UNCHANGED,  // F6
+    CHANGED,    // F7
+    DECREASED,  // F3
+    INCREASED,  // F4
+};
+
+/**
+ * @brief Finds the addresses that hold a game variable by narrowing snapshots
+ *
+ * A search keeps two images of the 64 KB bus address space, the latest
+ * snapshot and the one before it, and the set of candidate addresses as a
+ * bitset with one bit per address. Each filter compares the two images, or
+ * the latest one and a constant, and clears the bits of addresses that do
+ * not pass; a lives counter is found by snapshotting before and after a
+ * life is lost and keeping the addresses that decreased by one.
+ *
+ * Filters compare 64 addresses per bitset word, 16 bytes at a time with
+ * SSE2 where available, and skip words without candidates, so a filter
+ * over the whole address space costs a few microseconds and gets cheaper
+ * as the set narrows. Snapshots read memory directly rather than through
+ * the bus, so they have no side effects and see VRAM and OAM even while
+ * the PPU locks them. I/O registers, echo RAM and the unusable area are
+ * never searched.
+ *
+ * About 136 KB, allocate it on the heap. Not tied to a machine: every
+ * snapshot names the machine it reads.
+ */
+class RamSearch {
+public:
+    static constexpr u32 SPACE = 0x10000;
+    static constexpr u32 WORDS = SPACE / 64;
+
+    // ===== CONSTRUCTORS =====
+    // Not copyable, the image pointers point into the object
+    RamSearch() = default;
+    RamSearch(const RamSearch&) = delete;
+    RamSearch& operator=(const RamSearch&) = delete;
+
+    // ===== SEARCH =====
+    // Snapshots the regions (SEARCH_* flags) and makes all their addresses
+    // candidates; the previous image is the same snapshot
+    void start(Machine& machine, u8 regions = SEARCH_RAM);
+    // Keeps the latest snapshot as the previous one and takes a new one
+    void snapshot(Machine& machine);
+    u8 get_regions() const { return regions; }
+
+    // ===== FILTERS =====
+    // Each keeps the candidates that pass and returns how many remain
+    u32 filter_previous(SearchCompare op);          // current OP previous
+    u32 filter_value(SearchCompare op, u8 value);  // current OP value
+    // current == previous + delta, wrapping: increased by delta, or
+    // decreased by -delta
+    u32 filter_delta(int delta);
+
+    // ===== RESULTS =====
+    u32 count() const;
+    bool is_candidate(u16 address) const { return (candidates[address >> 6] >> (address & 63)) & 1; }
+    // Up to max candidate addresses in ascending order; returns the total
+    u32 results(u16* out, u32 max) const;
+    u8 value(u16 address) const { return current[address]; }
+    u8 previous_value(u16 address) const { return previous[address]; }
+    const u64* bits() const { return candidates; }  // WORDS words, bit n of word w is address w * 64 + n
+    // Prints the count and up to limit candidates with both values
+    void print(u32 limit) const;
+
+private:
+    void capture(Machine& machine);
+    u32 narrow(SearchCompare op, const u8* operand, bool splat, u8 bias);
+
+    alignas(16) u8 images[2][SPACE];
+    u8* current = images[0];
+    u8* previous = images[1];
+    u64 candidates[WORDS] = {};
+    u8 regions = 0;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.hpp"
+#include <cstddef>
+
+/**
+ * @brief Read-only ROM image shared between cartridges
+ *
+ * ROM files are mapped read-only with mmap(MAP_PRIVATE), so every process
+ * running the same game is backed by the same page cache pages. Inside one
+ * process images are kept in a refcounted registry keyed by file identity,
+ * so all instances of a file share a single mapping.
+ *
+ * The image is never written to; anything that needs a patched copy of ROM
+ * data (such as the header title) must copy it first.
+ */
+class RomImage {
+public:
+    // ===== REGISTRY =====
+    static const RomImage* acquire(const char* path);
+    static const RomImage* retain(const RomImage* image);  // one more holder
+    static void release(const RomImage* image);
+
+    // ===== DATA ACCESS =====
+    const u8* data() const { return bytes; }
+    u32 size() const { return length; }
+
+private:
+    RomImage();
+    ~RomImage();
+
+    bool open_file(const char* path, u64 file_size);
+
+    // ===== MAPPING STATE =====
+    const u8* bytes;     // Start of ROM data
+    u32 length;          // Usable ROM size in bytes
+    size_t map_length;   // Length passed to mmap, 0 if heap backed
+    u64 dev;             // Registry key: device id
+    u64 ino;             // Registry key: inode number
+    int refs;            // Cartridges currently holding the image
+};
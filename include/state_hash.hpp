@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.hpp"
+#include "pages.hpp"
+
+// ===== HASH LOCATIONS =====
+// Every hashed byte has a location. WRAM, VRAM and cartridge RAM bytes are
+// numbered by page store slot, slot * PAGE_SIZE + offset, so banked RAM is
+// told apart by bank rather than bus address; OAM and HRAM follow
+constexpr u32 OAM_LOCATION = 0x100000;
+constexpr u32 HRAM_LOCATION = OAM_LOCATION + 0xA0;
+
+/**
+ * @brief 64-bit hash of guest memory, kept up to date on every store
+ *
+ * Zobrist style: the hash is the XOR of key(location, byte) over every
+ * hashed byte, with key a 64-bit mix of both and 0 for a zero byte. A
+ * store replacing old with value XORs one key out and one in, so keeping
+ * the hash costs two mixes per store and reading it costs nothing. Equal
+ * memory contents always give equal hashes, whatever writes led there.
+ */
+class StateHash {
+public:
+    // murmur3's 64-bit finalizer
+    static u64 mix(u64 x) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        x ^= x >> 33;
+        return x;
+    }
+    static u64 key(u32 location, u8 byte) {
+        return byte ? mix((static_cast<u64>(location) << 8) | byte) : 0;
+    }
+
+    // ===== UPDATES =====
+    void update(u32 location, u8 old, u8 value) { hash ^= key(location, old) ^ key(location, value); }
+    // XORs in count bytes at consecutive locations, for hashing from scratch
+    void add(u32 location, const u8* bytes, u32 count) {
+        for (u32 i = 0; i < count; i++) {
+            hash ^= key(location + i, bytes[i]);
+        }
+    }
+    void reset() { hash = 0; }
+
+    u64 get() const { return hash; }
+
+private:
+    u64 hash = 0;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "common.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class Cartridge;
+class Registers;
+
+/**
+ * @brief One traced instruction, the CPU state before it executes
+ *
+ * Fixed 24 byte little-endian layout, shared with tools/trace_decode.
+ */
+struct TraceRecord {
+    u32 cycles;    // M-cycle stamp, low 32 bits
+    u16 pc;
+    u16 sp;
+    u8 a, f, b, c, d, e, h, l;
+    u8 pcmem[4];   // bytes at PC, opcode and operands
+    u8 bank;       // ROM bank at 0x4000-0x7FFF, 0 for PCs outside it
+    u8 reserved[3];
+};
+
+static_assert(sizeof(TraceRecord) == 24, "trace records are part of the file format");
+
+/**
+ * @brief Trace file header
+ */
+struct TraceHeader {
+    char magic[8];     // "GBTRACE\0"
+    u32 version;
+    u32 record_size;
+};
+
+/**
+ * @brief Formats a record as a Gameboy Doctor log line, without newline
+ *
+ * The line tools/trace_decode prints; cycles appends the M-cycle stamp and
+ * ROM bank, which Gameboy Doctor does not compare. 128 bytes always fit.
+ */
+inline int trace_format(const TraceRecord& r, bool cycles, char* out, size_t size) {
+    int n = snprintf(out, size, "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X "
+                     "PCMEM:%02X,%02X,%02X,%02X", r.a, r.f, r.b, r.c, r.d, r.e, r.h, r.l, r.sp, r.pc,
+                     r.pcmem[0], r.pcmem[1], r.pcmem[2], r.pcmem[3]);
+    if (cycles && n > 0 && static_cast<size_t>(n) < size) {
+        n += snprintf(out + n, size - n, " CY:%u BANK:%02X", r.cycles, r.bank);
+    }
+    return n;
+}
+
+/**
+ * @brief Binary execution trace written through a ring of chunks
+ *
+ * The CPU appends one TraceRecord per executed instruction into the chunk
+ * at the head of a fixed ring. Full chunks are handed to a writer thread
+ * that appends them to the file; the CPU only blocks when the writer has
+ * fallen a whole ring behind, so a trace is never missing records. The
+ * CPU holds a Trace pointer, null while tracing is paused.
+ *
+ *   tools/trace_decode trace.bin > trace.log   # Gameboy Doctor format
+ */
+class Trace {
+public:
+    static constexpr u32 CHUNK_RECORDS = 4096;
+    static constexpr u32 CHUNK_COUNT = 16;  // 1.5 MiB ring
+    static constexpr u32 VERSION = 1;
+
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    Trace();
+    ~Trace();
+
+    // ===== LIFETIME =====
+    bool open(const char* path);
+    void close();
+    bool is_open() const { return fp != nullptr; }
+    void set_cartridge(Cartridge* c) { cart = c; }
+
+    // ===== CPU THREAD INTERFACE =====
+    void record(const Registers& regs, u64 ticks, const u8* pcmem);
+    u64 get_records() const { return records; }
+
+private:
+    void submit();
+    void run();
+
+    FILE* fp;
+    Cartridge* cart;
+    TraceRecord* ring;
+    u32 head;     // chunk being filled by the CPU thread
+    u32 fill;     // records in the head chunk
+    u64 records;  // records written since open()
+
+    // Shared with the writer thread
+    std::mutex mutex;
+    std::condition_variable wake;   // chunk submitted or stopping
+    std::condition_variable space;  // chunk written
+    std::thread writer;
+    u32 tail;     // next chunk to write
+    u32 pending;  // full chunks not yet written
+    bool stopping;
+};
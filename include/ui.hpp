@@ -3,6 +3,8 @@
 #include "common.hpp"
 #include "bus.hpp"
 #include "joypad.hpp"
+#include "ppu.hpp"
+#include "ram_search.hpp"
 #include <SDL.h>
 #include <atomic>
 
@@ -51,6 +53,9 @@ public:
     
     // ===== EVENT HANDLING =====
     bool handle_events(std::atomic<bool>& running, std::atomic<bool>& paused);
+    bool take_profile_request();  // F9 pressed since the last call
+    bool take_trace_toggle();     // F8 pressed since the last call
+    SearchStep take_search_step();  // last of F3-F7 pressed since the last call
     
     // ===== UTILITY =====
     void delay(u32 ms);
@@ -76,8 +81,13 @@ private:
     // ===== STATE =====
     bool initialized;
     bool debug_enabled;
+    bool profile_requested;
+    bool trace_toggled;
+    SearchStep search_step;
     int scale;
+    u32 last_frame_time;  // limit_frame_rate() timestamp, per window
+    u32 frame_argb[XRES * YRES];  // the PPU's packed frame, converted by update()
     
     // ===== RENDERING CONSTANTS =====
-    unsigned long tile_colors[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
+    u32 tile_colors[4] = {DMG_COLORS[0], DMG_COLORS[1], DMG_COLORS[2], DMG_COLORS[3]};
 }; 
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "common.hpp"
+#include <vector>
+
+class Bus;
+
+// ===== WATCH KINDS =====
+constexpr u8 WATCH_READ = 1 << 0;   // CPU loads, including operand bytes
+constexpr u8 WATCH_WRITE = 1 << 1;  // CPU stores, including stack pushes
+constexpr u8 WATCH_EXEC = 1 << 2;   // opcode fetches, i.e. PC breakpoints
+
+/**
+ * @brief One watched access, passed to the hit callback
+ */
+struct WatchHit {
+    u64 ticks;    // CPU T-cycles at the access
+    u16 pc;       // address of the instruction making the access
+    u16 address;
+    u8 value;     // loaded, about to be stored, or the opcode fetched
+    u8 kind;      // the WATCH_* flag that matched
+};
+
+// Called on the thread stepping the machine; the access completes after
+// it returns
+using WatchCallback = void (*)(const WatchHit& hit, void* user);
+
+/**
+ * @brief Read, write and execution watchpoints on bus addresses
+ *
+ * Attached with Machine::set_watchpoints(). Rather than testing every
+ * access, the bus leaves each page holding a watched address out of its
+ * page table, for reads (and fetches) or writes as watched, so only those
+ * 256 byte pages take the slow path, where the address is checked against
+ * the watch list. Everything else runs on the unchanged fast path, and a
+ * machine without watchpoints does no extra work at all. Registers, OAM
+ * and HRAM are always on the slow path and can be watched the same way.
+ *
+ * Only CPU accesses are seen, by bus address: echo RAM does not hit a
+ * watch on the WRAM behind it, and neither do OAM DMA or the PPU. A
+ * breakpoint hits when its opcode is fetched, before the instruction
+ * runs; stores made by interrupt dispatch report the PC of the
+ * instruction before it. Forked machines start without watchpoints.
+ */
+class Watchpoints {
+public:
+    // ===== CONSTRUCTORS & DESTRUCTORS =====
+    Watchpoints() = default;
+    Watchpoints(const Watchpoints&) = delete;
+    Watchpoints& operator=(const Watchpoints&) = delete;
+    ~Watchpoints();  // detaches from the bus
+
+    // ===== CONFIGURATION =====
+    void set_callback(WatchCallback fn, void* data) { callback = fn; user = data; }
+    // Watches first..last inclusive for a set of WATCH_* kinds
+    void add(u16 first, u16 last, u8 kinds);
+    void add_breakpoint(u16 pc) { add(pc, pc, WATCH_EXEC); }
+    // Removes watches added with exactly these arguments
+    void remove(u16 first, u16 last, u8 kinds);
+    void clear();
+    u32 count() const { return static_cast<u32>(ranges.size()); }
+    u64 get_hits() const { return hits; }
+
+    // ===== BUS INTERFACE =====
+    // Kinds watched anywhere in a 256 byte page
+    u8 page_kinds(u8 page) const { return pages[page]; }
+    // Set by Bus::set_watchpoints; changes to the list remap that bus
+    void attach(Bus* b) { bus = b; }
+    // From the slow path, for addresses on a watched page
+    void check(u8 kind, u16 address, u8 value, u16 pc, u64 ticks);
+
+private:
+    struct Range {
+        u16 first;
+        u16 last;
+        u8 kinds;
+    };
+
+    void update_pages();
+
+    std::vector<Range> ranges;
+    u8 pages[256] = {};
+    WatchCallback callback = nullptr;
+    void* user = nullptr;
+    Bus* bus = nullptr;
+    u64 hits = 0;
+};
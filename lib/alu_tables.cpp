@@ -0,0 +1,130 @@
+#include "alu_tables.hpp"
+
+// ===== GENERATORS =====
+
+static constexpr u16 pack(u32 result, u8 flags) {
+    return static_cast<u16>((flags << 8) | (result & 0xFF));
+}
+
+static constexpr u16 add_entry(u32 a, u32 b, u32 c) {
+    u32 result = a + b + c;
+    u8 flags = 0;
+    flags |= (result & 0xFF) == 0 ? FLAG_Z : 0;
+    flags |= (a & 0xF) + (b & 0xF) + c > 0xF ? FLAG_H : 0;
+    flags |= result > 0xFF ? FLAG_C : 0;
+    return pack(result, flags);
+}
+
+static constexpr u16 sub_entry(u32 a, u32 b, u32 c) {
+    u32 result = a - b - c;
+    u8 flags = FLAG_N;
+    flags |= (result & 0xFF) == 0 ? FLAG_Z : 0;
+    flags |= (a & 0xF) < (b & 0xF) + c ? FLAG_H : 0;
+    flags |= a < b + c ? FLAG_C : 0;
+    return pack(result, flags);
+}
+
+static constexpr u16 inc_entry(u32 value) {
+    u32 result = (value + 1) & 0xFF;
+    u8 flags = 0;
+    flags |= result == 0 ? FLAG_Z : 0;
+    flags |= (result & 0xF) == 0 ? FLAG_H : 0;
+    return pack(result, flags);
+}
+
+static constexpr u16 dec_entry(u32 value) {
+    u32 result = (value - 1) & 0xFF;
+    u8 flags = FLAG_N;
+    flags |= result == 0 ? FLAG_Z : 0;
+    flags |= (value & 0xF) == 0 ? FLAG_H : 0;
+    return pack(result, flags);
+}
+
+// Step for step the adjustment proc_daa performs
+static constexpr u16 daa_entry(u8 a, bool n, bool h, bool c) {
+    if (!n) {
+        if (c || a > 0x99) {
+            a += 0x60;
+            c = true;
+        }
+        if (h || (a & 0x0F) > 0x09) {
+            a += 0x06;
+        }
+    } else {
+        if (c) {
+            a -= 0x60;
+        }
+        if (h) {
+            a -= 0x06;
+        }
+    }
+
+    u8 flags = 0;
+    flags |= a == 0 ? FLAG_Z : 0;
+    flags |= n ? FLAG_N : 0;
+    flags |= c ? FLAG_C : 0;
+    return pack(a, flags);
+}
+
+static constexpr u16 shift_entry(u8 op, u8 carry, u32 value) {
+    u32 result = 0;
+    bool c = false;
+
+    switch (op) {
+        case 0: result = (value << 1) | (value >> 7); c = value & 0x80; break;           // RLC
+        case 1: result = (value >> 1) | (value << 7); c = value & 0x01; break;           // RRC
+        case 2: result = (value << 1) | carry; c = value & 0x80; break;                  // RL
+        case 3: result = (value >> 1) | (carry << 7); c = value & 0x01; break;           // RR
+        case 4: result = value << 1; c = value & 0x80; break;                            // SLA
+        case 5: result = (value >> 1) | (value & 0x80); c = value & 0x01; break;         // SRA
+        case 6: result = (value << 4) | (value >> 4); break;                             // SWAP
+        case 7: result = value >> 1; c = value & 0x01; break;                            // SRL
+    }
+
+    u8 flags = 0;
+    flags |= (result & 0xFF) == 0 ? FLAG_Z : 0;
+    flags |= c ? FLAG_C : 0;
+    return pack(result, flags);
+}
+
+static constexpr AluTables make_alu_tables() {
+    AluTables t{};
+
+    for (u32 i = 0; i < 0x20000; i++) {
+        u32 c = i >> 16;
+        u32 a = (i >> 8) & 0xFF;
+        u32 b = i & 0xFF;
+        t.add[i] = add_entry(a, b, c);
+        t.sub[i] = sub_entry(a, b, c);
+    }
+
+    for (u32 v = 0; v < 0x100; v++) {
+        t.inc[v] = inc_entry(v);
+        t.dec[v] = dec_entry(v);
+    }
+
+    for (u32 i = 0; i < 0x800; i++) {
+        t.daa[i] = daa_entry(i & 0xFF, i & 0x400, i & 0x200, i & 0x100);
+    }
+
+    for (u32 i = 0; i < 0x1000; i++) {
+        t.shift[i] = shift_entry(i >> 9, (i >> 8) & 1, i & 0xFF);
+    }
+
+    return t;
+}
+
+// ===== TABLES =====
+
+// Constant-initialized into read-only data when the compiler's constexpr
+// evaluation budget covers the two 128K entry tables (GCC's default does);
+// otherwise it is filled once during static initialization.
+const AluTables alu_tables = make_alu_tables();
+
+// Spot checks of the generators against hand-computed values
+static_assert(add_entry(0x3A, 0x06, 0) == pack(0x40, FLAG_H), "ADD half carry");
+static_assert(add_entry(0xFF, 0x00, 1) == pack(0x00, FLAG_Z | FLAG_H | FLAG_C), "ADC carry in");
+static_assert(sub_entry(0x10, 0x0F, 1) == pack(0x00, FLAG_Z | FLAG_N | FLAG_H), "SBC borrow in");
+static_assert(dec_entry(0x01) == pack(0x00, FLAG_Z | FLAG_N), "DEC to zero");
+static_assert(daa_entry(0x9A, false, false, false) == pack(0x00, FLAG_Z | FLAG_C), "DAA wrap");
+static_assert(shift_entry(2, 1, 0x80) == pack(0x01, FLAG_C), "RL through carry");
@@ -0,0 +1,44 @@
+#include "arena.hpp"
+#include <cstring>
+#include <new>
+
+// ===== LIFETIME =====
+
+bool Arena::reserve(size_t bytes) {
+    release();
+
+    bytes = round_up(bytes);
+    block = static_cast<u8*>(::operator new(bytes, std::align_val_t(ALIGN), std::nothrow));
+    if (!block) {
+        printf("Arena: failed to reserve %zu bytes\n", bytes);
+        return false;
+    }
+
+    memset(block, 0, bytes);
+    capacity = bytes;
+    offset = 0;
+    return true;
+}
+
+void Arena::release() {
+    if (block) {
+        ::operator delete(block, std::align_val_t(ALIGN));
+    }
+    block = nullptr;
+    capacity = 0;
+    offset = 0;
+}
+
+// ===== ALLOCATION =====
+
+void* Arena::alloc(size_t bytes) {
+    bytes = round_up(bytes);
+    if (offset + bytes > capacity) {
+        printf("Arena: out of space (%zu of %zu bytes used, %zu requested)\n", offset, capacity, bytes);
+        return nullptr;
+    }
+
+    void* p = block + offset;
+    offset += bytes;
+    return p;
+}
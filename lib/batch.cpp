@@ -0,0 +1,156 @@
+#include "batch.hpp"
+
+// ===== CONSTRUCTORS & DESTRUCTORS =====
+
+BatchRunner::BatchRunner(u32 workers) {
+    if (workers == 0) {
+        workers = default_workers();
+    }
+
+    queues.reset(new Queue[workers]);
+    threads.reserve(workers);
+    for (u32 i = 0; i < workers; i++) {
+        threads.emplace_back(&BatchRunner::worker_main, this, i);
+    }
+}
+
+BatchRunner::~BatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+u32 BatchRunner::default_workers() {
+    u32 n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// ===== EXECUTION =====
+
+u32 BatchRunner::run(BatchJob* batch, u32 count) {
+    u32 workers = get_workers();
+
+    // Contiguous, even shares; the first count % workers get one extra
+    u32 next = 0;
+    for (u32 i = 0; i < workers; i++) {
+        u32 share = count / workers + (i < count % workers ? 1 : 0);
+        std::lock_guard<std::mutex> lock(queues[i].mutex);
+        queues[i].begin = next;
+        queues[i].end = next + share;
+        next += share;
+    }
+
+    completed.store(0, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs = batch;
+    active = workers;
+    generation++;
+    start.notify_all();
+
+    done.wait(lock, [this] { return active == 0; });
+    jobs = nullptr;
+    return completed.load(std::memory_order_relaxed);
+}
+
+void BatchRunner::worker_main(u32 index) {
+    u64 seen = 0;
+
+    while (true) {
+        BatchJob* batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            batch = jobs;
+        }
+
+        u32 job;
+        while (take(index, job) || steal(index, job)) {
+            run_job(batch[job]);
+            if (batch[job].ok) {
+                completed.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Every queue was empty when we looked, and jobs are only ever
+        // removed, so this worker has nothing left to do in this batch
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+// ===== WORK STEALING =====
+
+bool BatchRunner::take(u32 index, u32& job) {
+    Queue& q = queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.begin == q.end) {
+        return false;
+    }
+    job = q.begin++;
+    return true;
+}
+
+// Thieves work from the back, away from the owner, and try the workers
+// after themselves first so they don't all descend on the same victim
+bool BatchRunner::steal(u32 thief, u32& job) {
+    u32 workers = get_workers();
+
+    for (u32 i = 1; i < workers; i++) {
+        Queue& q = queues[(thief + i) % workers];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.begin == q.end) {
+            continue;
+        }
+        job = --q.end;
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void BatchRunner::run_job(BatchJob& job) {
+    Machine* m = job.machine;
+    u32 start_frame = m->ppu.current_frame;
+    u64 start_cycles = m->cpu.get_ticks();
+
+    u32 selected = ~0u;
+
+    job.ok = true;
+    while (true) {
+        job.frames = m->ppu.current_frame - start_frame;
+        job.cycles = m->cpu.get_ticks() - start_cycles;
+
+        if ((job.frame_budget && job.frames >= job.frame_budget) ||
+            (job.cycle_budget && job.cycles >= job.cycle_budget)) {
+            break;
+        }
+        if (!job.frame_budget && !job.cycle_budget) {
+            break;
+        }
+        if (job.frame_budget && job.frames != selected) {
+            selected = job.frames;
+            m->select_output(job.frame_budget - job.frames, job.reduce);
+        }
+        if (!m->step()) {
+            job.ok = false;
+            break;
+        }
+    }
+
+    m->ppu.set_output(PixelOutput::WRITE);
+}
@@ -0,0 +1,221 @@
+#include "battery.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Process-wide background thread that writes queued battery files
+ *
+ * One writer serves every cartridge in the process; the thread is started
+ * on first use. It is intentionally never torn down: cartridges flush their
+ * own last commit in BatteryFile::close(), so nothing depends on static
+ * destruction order at exit.
+ */
+class BatteryWriter {
+public:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            wake.wait(lock, [this] { return head != nullptr; });
+
+            // Marked busy before unlocking so close() waits for this write
+            BatteryFile* file = pop();
+            file->writing = true;
+
+            lock.unlock();
+            file->write_snapshot();
+            lock.lock();
+        }
+    }
+
+    void ensure_started() {
+        if (!thread.joinable()) {
+            thread = std::thread(&BatteryWriter::run, this);
+        }
+    }
+
+    // Intrusive FIFO through BatteryFile::next_queued, guarded by mutex
+    void push(BatteryFile* file) {
+        file->next_queued = nullptr;
+        if (tail) {
+            tail->next_queued = file;
+        } else {
+            head = file;
+        }
+        tail = file;
+    }
+
+    BatteryFile* pop() {
+        BatteryFile* file = head;
+        head = file->next_queued;
+        if (!head) {
+            tail = nullptr;
+        }
+        return file;
+    }
+
+    void remove(BatteryFile* file) {
+        BatteryFile* prev = nullptr;
+        for (BatteryFile* f = head; f; prev = f, f = f->next_queued) {
+            if (f != file) {
+                continue;
+            }
+            (prev ? prev->next_queued : head) = f->next_queued;
+            if (tail == f) {
+                tail = prev;
+            }
+            return;
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;  // signals the writer thread
+    std::condition_variable idle;  // signals close() that a write finished
+    BatteryFile* head = nullptr;
+    BatteryFile* tail = nullptr;
+    std::thread thread;
+};
+
+static BatteryWriter& writer = *new BatteryWriter();
+
+// ===== CONSTRUCTORS & DESTRUCTORS =====
+
+BatteryFile::BatteryFile() : path(nullptr), shadow(nullptr), staging(nullptr), size(0), dirty_begin(0),
+                             dirty_end(0), queued(false), writing(false), next_queued(nullptr) {
+}
+
+BatteryFile::~BatteryFile() {
+    close();
+}
+
+// ===== LIFETIME =====
+
+bool BatteryFile::open(const char* file_path, u32 file_size, u8* shadow_buffer, u8* staging_buffer) {
+    close();
+
+    path = file_path;
+    size = file_size;
+    shadow = shadow_buffer;
+    staging = staging_buffer;
+    memset(shadow, 0, size);
+    dirty_begin = 0;
+    dirty_end = size;
+
+    // Started here rather than on the first commit, which runs mid-frame
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.ensure_started();
+    return true;
+}
+
+void BatteryFile::close() {
+    if (!shadow) {
+        return;
+    }
+
+    bool flush;
+    {
+        std::unique_lock<std::mutex> lock(writer.mutex);
+
+        // Take the file back from the writer and finish the last commit here
+        if (queued) {
+            writer.remove(this);
+        }
+        writer.idle.wait(lock, [this] { return !writing; });
+
+        flush = queued;
+    }
+
+    if (flush) {
+        write_snapshot();
+    }
+
+    shadow = nullptr;
+    staging = nullptr;
+}
+
+// ===== EMULATION THREAD INTERFACE =====
+
+void BatteryFile::update(u32 offset, const u8* data, u32 len) {
+    if (!shadow || offset + len > size) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    memcpy(shadow + offset, data, len);
+    dirty_begin = offset < dirty_begin ? offset : dirty_begin;
+    dirty_end = offset + len > dirty_end ? offset + len : dirty_end;
+}
+
+void BatteryFile::commit() {
+    if (!shadow) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        if (queued) {
+            // Already waiting; the pending write will pick up this data too
+            return;
+        }
+        queued = true;
+        writer.push(this);
+    }
+    writer.wake.notify_one();
+}
+
+// ===== WRITER THREAD INTERFACE =====
+
+// Called by the writer thread, which has set writing, or by close() once
+// the writer is done with this file
+void BatteryFile::write_snapshot() {
+    {
+        // Staging already holds everything outside the dirty range
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        if (dirty_begin < dirty_end) {
+            memcpy(staging + dirty_begin, shadow + dirty_begin, dirty_end - dirty_begin);
+        }
+        dirty_begin = size;
+        dirty_end = 0;
+        queued = false;
+    }
+
+    char tmp[1040];
+    bool ok = false;
+    FILE* fp = nullptr;
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) < static_cast<int>(sizeof(tmp))) {
+        fp = fopen(tmp, "wb");
+    }
+    if (fp) {
+        ok = fwrite(staging, 1, size, fp) == size;
+        ok = fflush(fp) == 0 && ok;
+#ifndef _WIN32
+        ok = fsync(fileno(fp)) == 0 && ok;
+#endif
+        ok = fclose(fp) == 0 && ok;
+    }
+
+    if (ok) {
+#ifdef _WIN32
+        remove(path);
+#endif
+        ok = rename(tmp, path) == 0;
+    }
+
+    if (!ok) {
+        printf("Failed to write battery file: %s\n", path);
+        remove(tmp);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer.mutex);
+        writing = false;
+    }
+    writer.idle.notify_all();
+}
@@ -19,12 +19,27 @@
 // FFFF	FFFF	Interrupt Enable register (IE)	
 
 
+Bus::Bus() : dma_end(0), hashing(false), watch(nullptr), cartridge(nullptr), ram(nullptr), cpu(nullptr), io(nullptr), ppu(nullptr), dma(nullptr) {
+    for (int i = 0; i < 256; i++) {
+        read_map[i] = nullptr;
+        write_map[i] = nullptr;
+    }
+}
+
+Bus::~Bus() {
+    if (watch) {
+        watch->attach(nullptr);
+    }
+}
+
 void Bus::set_cartridge(Cartridge* cart) {
     cartridge = cart;
+    map_cartridge();
 }
 
 void Bus::set_ram(RAM* ram) {
     this->ram = ram;
+    map_wram();
 }
 
 void Bus::set_cpu(CPU* cpu) {
@@ -37,26 +52,186 @@ void Bus::set_io(IO* io) {
 
 void Bus::set_ppu(PPU* ppu) {
     this->ppu = ppu;
+    map_vram();
 }
 
 void Bus::set_dma(DMA* dma) {
     this->dma = dma;
 }
 
-u8 Bus::read(u16 address) {
+void Bus::set_watchpoints(Watchpoints* w) {
+    if (watch) {
+        watch->attach(nullptr);
+    }
+    watch = w;
+    if (watch) {
+        watch->attach(this);
+    }
+    remap();
+}
+
+// ===== PAGE TABLE =====
+
+void Bus::map_memory() {
+    if (cartridge) {
+        map_cartridge();
+    }
+    if (ram) {
+        map_wram();
+    }
+    if (ppu) {
+        map_vram();
+    }
+}
+
+void Bus::map_wram() {
+    for (int page = 0xC0; page <= 0xDF; page++) {
+        map_page(page);
+    }
+}
+
+void Bus::map_vram() {
+    for (int page = 0x80; page <= 0x9F; page++) {
+        map_page(page);
+    }
+}
+
+// After a slow path store to VRAM or WRAM, which may have copied a shared
+// page or found it no longer shared
+void Bus::map_page(u8 page) {
+    if (page >= 0x80 && page <= 0x9F) {
+        u8* memory = ppu->vram_page(page - 0x80);
+        read_map[page] = watch_read_page(page, memory);
+        write_map[page] = watch_write_page(page, ram_write_page(memory, ppu->vram_shared(page - 0x80)));
+    } else if (page >= 0xC0 && page <= 0xDF) {
+        u8* memory = ram->wram_page(page - 0xC0);
+        read_map[page] = watch_read_page(page, memory);
+        write_map[page] = watch_write_page(page, ram_write_page(memory, ram->wram_shared(page - 0xC0)));
+    }
+}
+
+u8* Bus::cart_write_page(u8 page) const {
+    return hashing ? nullptr : watch_write_page(page, cartridge->write_page(page));
+}
+
+// Called whenever the mapper may have switched banks. Control registers
+// only live on the slow path, so bank switches never happen behind the
+// table's back.
+void Bus::map_cartridge() {
+    if (dma_end) {
+        // Remapped when the DMA lock is released
+        return;
+    }
+
+    // ROM banks are contiguous 16 KiB blocks, one lookup per bank is enough
+    const u8* bank0 = cartridge->read_page(0x00);
+    const u8* bankx = cartridge->read_page(0x40);
+    for (int page = 0x00; page <= 0x3F; page++) {
+        read_map[page] = watch_read_page(page, bank0 + (page << 8));
+        read_map[page + 0x40] = watch_read_page(page + 0x40, bankx + (page << 8));
+    }
+    for (int page = 0xA0; page <= 0xBF; page++) {
+        read_map[page] = watch_read_page(page, cartridge->read_page(page));
+        write_map[page] = cart_write_page(page);
+    }
+}
+
+void Bus::fork_from(const Bus& parent) {
+    if (parent.dma_end) {
+        lock_dma(parent.dma_end);
+    } else {
+        dma_end = 0;
+        map_memory();
+    }
+}
+
+// ===== OAM DMA =====
+
+void Bus::lock_dma(u64 end_tick) {
+    dma_end = end_tick;
+    for (int i = 0; i < 256; i++) {
+        read_map[i] = nullptr;
+        write_map[i] = nullptr;
+    }
+}
+
+// Direct pointer to the page a transfer copies from. Sources from 0xE000 up
+// read the work RAM behind the echo area.
+const u8* Bus::dma_source(u8 page) {
+    if (page >= 0xE0) {
+        page -= 0x20;
+    }
+    if (page >= 0x80 && page <= 0x9F) {
+        return ppu->vram_page(page - 0x80);
+    }
+    if (page >= 0xC0) {
+        return ram->wram_page(page - 0xC0);
+    }
+    return cartridge->read_page(page);
+}
+
+// Checked on every slow path access while a transfer runs. The first access
+// after the window completes the copy and restores the page table.
+bool Bus::dma_allows(u16 address) {
+    if (cpu->get_ticks() >= dma_end) {
+        dma_end = 0;
+        dma->finish();
+        map_memory();
+        return true;
+    }
+    return address >= 0xFF00;
+}
+
+// ===== SLOW PATH =====
+
+u8 Bus::read_slow(u16 address) {
+    u8 value = load_slow(address);
+    if (watch && (watch->page_kinds(address >> 8) & WATCH_READ)) {
+        watch->check(WATCH_READ, address, value, cpu->get_instruction_pc(), cpu->get_ticks());
+    }
+    return value;
+}
+
+// Reached for breakpoint pages, and for every fetch while a DMA runs
+u8 Bus::fetch_slow(u16 address) {
+    u8 value = load_slow(address);
+    if (watch && (watch->page_kinds(address >> 8) & WATCH_EXEC)) {
+        watch->check(WATCH_EXEC, address, value, address, cpu->get_ticks());
+    }
+    return value;
+}
+
+u8 Bus::load_slow(u16 address) {
+    if (dma_end && !dma_allows(address)) {
+        return 0xFF;
+    }
+    return read_device(address);
+}
+
+void Bus::write_slow(u16 address, u8 value) {
+    if (watch && (watch->page_kinds(address >> 8) & WATCH_WRITE)) {
+        watch->check(WATCH_WRITE, address, value, cpu->get_instruction_pc(), cpu->get_ticks());
+    }
+    if (dma_end && !dma_allows(address)) {
+        return;
+    }
+    write_device(address, value);
+}
+
+u8 Bus::read_device(u16 address) {
     if (address < 0x8000) {
         return cartridge->read(address);
     }
     else if (address >= 0x8000 && address <= 0x9FFF) {
         return ppu->vram_read(address);
     }
+    else if (address >= 0xA000 && address <= 0xBFFF) {
+        return cartridge->read(address);
+    }
     else if (address >= 0xC000 && address <= 0xDFFF) {
         return ram->read_wram(address);
     }
     else if (address >= 0xFE00 && address <= 0xFE9F) {
-        if (dma->transferring()) {
-            return 0xFF;
-        }
         return ppu->oam_read(address);
     }
     else if (address >= 0xFF80 && address <= 0xFFFE) {
@@ -78,22 +253,31 @@ u8 Bus::read(u16 address) {
     return 0;
 }
 
-void Bus::write(u16 address, u8 value) {
+void Bus::write_device(u16 address, u8 value) {
     // Implement memory write logic
     if (address < 0x8000) {
         cartridge->write(address, value);
+        map_cartridge();
     }
     else if (address >= 0x8000 && address <= 0x9FFF) {
         ppu->vram_write(address, value);
+        map_page(address >> 8);
     }
-    else if (address >= 0xFE00 && address <= 0xFE9F) {
-        if (dma->transferring()) {
-            return;
+    else if (address >= 0xA000 && address <= 0xBFFF) {
+        cartridge->write(address, value);
+        // Same for cartridge RAM, where a copied page can have mirrors
+        u8 page = address >> 8;
+        if (watch_read_page(page, cartridge->read_page(page)) != read_map[page] ||
+            cart_write_page(page) != write_map[page]) {
+            map_cartridge();
         }
+    }
+    else if (address >= 0xFE00 && address <= 0xFE9F) {
         ppu->oam_write(address, value);
     }
      else if (address >= 0xC000 && address <= 0xDFFF) {
         ram->write_wram(address, value);
+        map_page(address >> 8);
     }
     else if (address >= 0xFF80 && address <= 0xFFFE) {
         ram->write_hram(address, value);
@@ -113,14 +297,3 @@ void Bus::write(u16 address, u8 value) {
     }
     
 }
-
-void Bus::write16(u16 addr, u16 value) {
-    write(addr, value & 0xFF);         // low byte
-    write(addr + 1, (value >> 8) & 0xFF); // high byte
-}
-
-u16 Bus::read16(u16 addr) {
-    u8 lo = read(addr);
-    u8 hi = read(addr + 1);
-    return lo | (hi << 8);
-} 
\ No newline at end of file
@@ -104,14 +104,32 @@ const char* Cartridge::LIC_CODE[0xA5] = {
     [0xA4] = "Konami (Yu-Gi-Oh!)"
 };
 
-Cartridge::Cartridge() : rom_data(nullptr), header(nullptr) {
-    filename[0] = '\0';
+Cartridge::Cartridge() : mapper(nullptr), rom_data(nullptr), ram_bank_size(0), ram_bank_count(0),
+    battery(false), need_save(false), rom(nullptr), header(nullptr), filename(nullptr),
+    battery_path(nullptr), persistent(true) {
+    pages = nullptr;
+    hash = nullptr;
     rom_size = 0;
+    for (int i = 0; i < 16; i++) {
+        ram_banks[i] = nullptr;
+    }
 }
 
 Cartridge::~Cartridge() {
-    if (rom_data) {
-        delete[] rom_data;
+    if (battery) {
+        battery_save();
+        battery_file.close();
+    }
+
+    // Mapper and RAM banks live in the machine's arena
+    if (mapper) {
+        mapper->~Mapper();
+        mapper = nullptr;
+    }
+
+    if (rom) {
+        RomImage::release(rom);
+        rom = nullptr;
         rom_data = nullptr;
     }
 }
@@ -131,30 +149,50 @@ const char* Cartridge::get_type_name() const {
 }
 
 bool Cartridge::load(const char* cart) {
-    std::snprintf(filename, sizeof(filename), "%s", cart);
+    filename = cart;
 
-    FILE* fp = fopen(cart, "r");
-    if (!fp) {
+    rom = RomImage::acquire(cart);
+    if (!rom) {
         printf("Failed to open: %s\n", cart);
         return false;
     }
 
     printf("Opened: %s\n", filename);
 
-    fseek(fp, 0, SEEK_END);
-    rom_size = ftell(fp);
-    rewind(fp);
-
-    rom_data = new u8[rom_size];
-    fread(rom_data, rom_size, 1, fp);
-    fclose(fp);
+    rom_size = rom->size();
+    rom_data = rom->data();
 
-    header = reinterpret_cast<RomHeader*>(rom_data + 0x100);
+    // The image is shared and read-only, so terminate the title on a copy
+    memcpy(&header_copy, rom_data + 0x100, sizeof(RomHeader));
+    header = &header_copy;
     header->title[15] = 0;
 
-    battery = header->type == 0x03;
+    switch (header->type) {
+        case 0x03: case 0x06: case 0x09: case 0x0D: case 0x0F:
+        case 0x10: case 0x13: case 0x1B: case 0x1E: case 0x22:
+            battery = persistent;
+            break;
+        default:
+            battery = false;
+            break;
+    }
     need_save = false;
 
+    ram_bank_size = mapper_ram_bank_size(header->type);
+    ram_bank_count = 0;
+
+    switch (header->ram_size) {
+        case 2: ram_bank_count = 1; break;
+        case 3: ram_bank_count = 4; break;
+        case 4: ram_bank_count = 16; break;
+        case 5: ram_bank_count = 8; break;
+    }
+
+    // MBC2 has its RAM built in and reports no external RAM in the header
+    if (ram_bank_size == 0x200) {
+        ram_bank_count = 1;
+    }
+
     printf("Cartridge Loaded:\n");
     printf("\t Title    : %s\n", header->title);
     printf("\t Type     : %2.2X (%s)\n", header->type, get_type_name());
@@ -163,12 +201,6 @@ bool Cartridge::load(const char* cart) {
     printf("\t LIC Code : %2.2X (%s)\n", header->lic_code, get_lic_name());
     printf("\t ROM Vers : %2.2X\n", header->version);
 
-    setup_banking();
-
-    if (battery) {
-        battery_load();
-    }
-
     u16 x = 0;
     for (u16 i = 0x0134; i <= 0x014C; i++) {
         x = x - rom_data[i] - 1;
@@ -181,88 +213,169 @@ bool Cartridge::load(const char* cart) {
 
 u8 Cartridge::read(u16 address) {
     if (address < 0x4000) {
-        return rom_data[address];
+        return mapper->rom_bank0[address];
     }
-    else if (address >= 0x4000 && address < 0x8000) {
-        if (!is_mbc1()) {
-            return rom_data[address];
-        }
-        return rom_bank_x[address - 0x4000];
+    else if (address < 0x8000) {
+        return mapper->rom_bankx[address - 0x4000];
     }
     else if (address >= 0xA000 && address <= 0xBFFF) {
-        if (!ram_enabled) {
-            return 0xFF;
-        }
-        return ram_bank[address - 0xA000];
+        return mapper->read_ram(address);
     }
-    return rom_bank_x[address - 0x4000];
+    return 0xFF;
 }
 
 void Cartridge::write(u16 address, u8 value) {
-    // Implement memory write logic
-    if (address < 0x2000) {
-        ram_enabled = (value & 0x0F) == 0x0A;
+    if (address < 0x8000) {
+        mapper->write(address, value);
     }
-    else if (address >= 0x2000 && address < 0x4000) {
-        if (value == 0) {
-            value = 1;
+    else if (address >= 0xA000 && address <= 0xBFFF) {
+        u16 offset = (address - 0xA000) & mapper->ram_mask;
+        // A page shared with a fork is copied before the mapper stores to it
+        u8* page = mapper->ram_bank ? pages->writable(ram_slot(offset)) : nullptr;
+        if (mapper->ram_bank && !page) {
+            return;
         }
-        value &= 0b11111;
-        rom_bank_value = value;
-        rom_bank_x = rom_data + (rom_bank_value * 0x4000);
-    }
-    else if (address >= 0x4000 && address < 0x6000) {
-        ram_bank_value = value & 0b111;
-        if (ram_banking) {
-            if (need_save) {
-                battery_save();
-            }
-            ram_bank = ram_banks[ram_bank_value];
+        u8 old = page ? page[offset & 0xFF] : 0;
+        mapper->write_ram(address, value);
+
+        // Hashes what was stored, MBC2 keeps only a nibble
+        if (hash && page) {
+            hash->update(ram_slot(offset) * PAGE_SIZE + (offset & 0xFF), old, page[offset & 0xFF]);
         }
-    }
-    else if (address >= 0x6000 && address < 0x8000) {
-        //banking mode select
-        banking_mode = value & 0b1;
 
-        ram_banking = banking_mode == 0;
-        if (ram_banking) {
-            if (need_save) {
-                battery_save();
-            }
-            ram_bank = ram_banks[ram_bank_value];
+        if (battery && mapper->ram_bank) {
+            ram_dirty[mapper->ram_bank_index] |= 1u << (offset >> 8);
+            need_save = true;
         }
     }
-    else if (address >= 0xA000 && address < 0xBFFF) {
-        if (!ram_enabled) {
-            return;
-        }
-        if (!ram_bank) {
-            return;
-        }
-        ram_bank[address - 0xA000] = value;
-        if (battery) {
-            need_save = true;
+}
+
+const u8* Cartridge::read_page(u8 page) const {
+    if (page < 0x40) {
+        return mapper->rom_bank0 + (page << 8);
+    }
+    if (page < 0x80) {
+        return mapper->rom_bankx + ((page - 0x40) << 8);
+    }
+    if (page >= 0xA0 && page <= 0xBF && mapper->ram_bank) {
+        return mapper->ram_bank[(((page - 0xA0) << 8) & mapper->ram_mask) >> 8];
+    }
+    return nullptr;
+}
+
+u8* Cartridge::write_page(u8 page) const {
+    // Battery RAM stays on the slow path so writes are seen by dirty tracking,
+    // and shared pages so the first write makes a copy
+    if (page >= 0xA0 && page <= 0xBF && mapper->ram_bank && mapper->ram_direct_write && !battery) {
+        u16 offset = ((page - 0xA0) << 8) & mapper->ram_mask;
+        if (!pages->shared(ram_slot(offset))) {
+            return mapper->ram_bank[offset >> 8];
         }
     }
+    return nullptr;
+}
+
+u32 Cartridge::ram_slot(u16 offset) const {
+    return CART_RAM_PAGE + mapper->ram_bank_index * (ram_bank_size / PAGE_SIZE) + (offset >> 8);
 }
 
 bool Cartridge::is_mbc1() {
     return header->type == 0x01 || header->type == 0x02 || header->type == 0x03;
 }
 
-void Cartridge::setup_banking() {
+void Cartridge::set_cpu(CPU* cpu) {
+    if (mapper) {
+        mapper->set_cpu(cpu);
+    }
+}
+
+size_t Cartridge::storage_size() const {
+    size_t size = Arena::round_up(mapper_storage_size());
+    if (battery) {
+        size += 2 * Arena::round_up(ram_bank_count * ram_bank_size);
+        size += Arena::round_up(strlen(filename) + sizeof(".battery"));
+    }
+    return size;
+}
+
+u32 Cartridge::ram_pages() const {
+    return ram_bank_count * (ram_bank_size / PAGE_SIZE);
+}
+
+void Cartridge::bind_ram_banks(PageStore& store) {
+    pages = &store;
     for (int i = 0; i < 16; i++) {
-        ram_banks[i] = nullptr;
+        ram_banks[i] = i < ram_bank_count ? store.slots(CART_RAM_PAGE + i * (ram_bank_size / PAGE_SIZE)) : nullptr;
+        ram_dirty[i] = 0;
+    }
+}
 
-        if (header->ram_size == 2 &&  i == 0 || 
-            header->ram_size == 3 && i < 4 ||
-            header->ram_size == 4 && i < 16 ||
-            header->ram_size == 5 && i < 8) {
-            ram_banks[i] = new u8[0x2000];
+// Takes the RAM banks from the store, which comes zero-filled, places the
+// mapper and the battery buffers in the arena, then loads the battery file
+bool Cartridge::setup_banking(Arena& arena, PageStore& store) {
+    bind_ram_banks(store);
+
+    void* storage = arena.alloc(mapper_storage_size());
+    if (!storage) {
+        return false;
+    }
+    mapper = create_mapper(header->type, rom_data, rom_size, ram_banks, ram_bank_count, storage);
+    if (!mapper) {
+        printf("\t Mapper   : %s is not supported, using plain ROM mapping\n", get_type_name());
+        mapper = create_plain_mapper(rom_data, rom_size, ram_banks, ram_bank_count, storage);
+    }
+
+    if (battery) {
+        u32 save_size = ram_bank_count * ram_bank_size;
+        u8* shadow = arena.alloc_array<u8>(save_size);
+        u8* staging = arena.alloc_array<u8>(save_size);
+        if (!shadow || !staging) {
+            return false;
         }
+
+        size_t length = strlen(filename) + sizeof(".battery");
+        battery_path = arena.alloc_array<char>(length);
+        if (!battery_path) {
+            return false;
+        }
+        snprintf(battery_path, length, "%s.battery", filename);
+
+        battery_file.open(battery_path, save_size, shadow, staging);
+        battery_load();
     }
-    ram_bank = ram_banks[0];
-    rom_bank_x = rom_data + 0x4000;
+
+    // The caller's string is not kept
+    filename = nullptr;
+    return true;
+}
+
+bool Cartridge::fork_from(const Cartridge& parent, Arena& arena, PageStore& store) {
+    rom = RomImage::retain(parent.rom);
+    if (!rom) {
+        printf("Cartridge: no loaded ROM to fork\n");
+        return false;
+    }
+    rom_data = parent.rom_data;
+    rom_size = parent.rom_size;
+    ram_bank_size = parent.ram_bank_size;
+    ram_bank_count = parent.ram_bank_count;
+    header_copy = parent.header_copy;
+    header = &header_copy;
+
+    // The parent alone owns the .battery file
+    battery = false;
+    need_save = false;
+    persistent = false;
+
+    bind_ram_banks(store);
+
+    void* storage = arena.alloc(mapper_storage_size());
+    if (!storage) {
+        return false;
+    }
+    mapper = parent.mapper->clone(storage);
+    mapper->rebind(ram_banks);
+    return true;
 }
 
 void Cartridge::battery_load() {
@@ -270,24 +383,34 @@ void Cartridge::battery_load() {
         return;
     }
 
-    char fn[1024];
-    sprintf(fn, "%s.battery", filename);
-    FILE *fp = fopen(fn, "rb");
+    FILE *fp = fopen(battery_path, "rb");
 
-    if (!fp) {
-        return;
+    u32 bank_pages = ram_bank_size / PAGE_SIZE;
+    if (fp) {
+        // Load all RAM banks, a page at a time
+        bool complete = true;
+        for (int i = 0; i < 16 && complete; i++) {
+            for (u32 page = 0; ram_banks[i] && page < bank_pages && complete; page++) {
+                complete = fread(ram_banks[i][page], PAGE_SIZE, 1, fp) == 1;
+            }
+        }
+        if (!complete) {
+            printf("Battery file is shorter than cart RAM: %s\n", battery_path);
+        }
+
+        fclose(fp);
     }
 
-    // Load all RAM banks
+    // Seed the writer's shadow copy so later commits only need dirty pages
     for (int i = 0; i < 16; i++) {
-        if (ram_banks[i]) {
-            fread(ram_banks[i], 0x2000, 1, fp);
+        for (u32 page = 0; ram_banks[i] && page < bank_pages; page++) {
+            battery_file.update(i * ram_bank_size + page * PAGE_SIZE, ram_banks[i][page], PAGE_SIZE);
         }
     }
-
-    fclose(fp);
 }
 
+// Hands dirty pages to the background writer. Called from the emulation
+// thread, so it only copies what changed and never touches the disk.
 void Cartridge::battery_save() {
     if (!battery) {
         return;
@@ -297,22 +420,33 @@ void Cartridge::battery_save() {
         return;
     }
 
-    char fn[1024];
-    sprintf(fn, "%s.battery", filename);
-    FILE *fp = fopen(fn, "wb");
+    for (int i = 0; i < 16; i++) {
+        u32 dirty = ram_dirty[i];
+        if (!dirty || !ram_banks[i]) {
+            continue;
+        }
 
-    if (!fp) {
-        return;
-    }
+        // Copy runs of dirty pages that are adjacent in memory in one go
+        int page = 0;
+        int bank_pages = ram_bank_size >> 8;
+        while (page < bank_pages) {
+            if (!(dirty & (1u << page))) {
+                page++;
+                continue;
+            }
 
-    // Save all RAM banks
-    for (int i = 0; i < 16; i++) {
-        if (ram_banks[i]) {
-            fwrite(ram_banks[i], 0x2000, 1, fp);
+            int first = page;
+            const u8* start = ram_banks[i][first];
+            while (page < bank_pages && (dirty & (1u << page)) && ram_banks[i][page] == start + (page - first) * 0x100) {
+                page++;
+            }
+
+            battery_file.update(i * ram_bank_size + first * 0x100, start, (page - first) * 0x100);
         }
+        ram_dirty[i] = 0;
     }
 
-    fclose(fp);
+    battery_file.commit();
     need_save = false;
 }
 
@@ -1,4 +1,3 @@
 #include "common.hpp"
 
 // Common utility functions that don't depend on UI
-// The delay function has been moved to the UI module 
\ No newline at end of file
@@ -1,133 +1,13 @@
 #include "cpu.hpp"
 #include "bus.hpp"
 #include "ppu.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 #include <cstdio>
-#include <cstring>
-
-#define CPU_DEBUG 0
-
-// Helper function to get register name as string
-static const char* reg_name(RegType reg) {
-    switch (reg) {
-        case RegType::A: return "A";
-        case RegType::B: return "B";
-        case RegType::C: return "C";
-        case RegType::D: return "D";
-        case RegType::E: return "E";
-        case RegType::H: return "H";
-        case RegType::L: return "L";
-        case RegType::F: return "F";
-        case RegType::AF: return "AF";
-        case RegType::BC: return "BC";
-        case RegType::DE: return "DE";
-        case RegType::HL: return "HL";
-        case RegType::SP: return "SP";
-        case RegType::PC: return "PC";
-        case RegType::NONE: return "";
-        default: return "?";
-    }
-}
-
-// Helper function to get condition name as string
-static const char* cond_name(CondType cond) {
-    switch (cond) {
-        case CondType::NZ: return "NZ";
-        case CondType::Z: return "Z";
-        case CondType::NC: return "NC";
-        case CondType::C: return "C";
-        case CondType::NONE: return "";
-        default: return "?";
-    }
-}
-
-// Helper function to format operand based on addressing mode and instruction
-static void format_operand(const Instruction* inst, u16 fetched_data, u16 mem_dest, char* buffer, size_t buffer_size) {
-    switch (inst->mode) {
-        case AddrMode::IMP:
-            // Special handling for POP and PUSH instructions
-            if (inst->type == InType::POP || inst->type == InType::PUSH) {
-                snprintf(buffer, buffer_size, "%s", reg_name(inst->reg_1));
-            } else {
-                snprintf(buffer, buffer_size, "");
-            }
-            break;
-        case AddrMode::R:
-            snprintf(buffer, buffer_size, "%s", reg_name(inst->reg_1));
-            break;
-        case AddrMode::R_R:
-            snprintf(buffer, buffer_size, "%s,%s", reg_name(inst->reg_1), reg_name(inst->reg_2));
-            break;
-        case AddrMode::R_D8:
-            snprintf(buffer, buffer_size, "%s,$%02X", reg_name(inst->reg_1), fetched_data);
-            break;
-        case AddrMode::R_D16:
-            snprintf(buffer, buffer_size, "%s,$%04X", reg_name(inst->reg_1), fetched_data);
-            break;
-        case AddrMode::MR_R:
-            if (inst->reg_1 == RegType::C) {
-                snprintf(buffer, buffer_size, "($FF00+C),%s", reg_name(inst->reg_2));
-            } else {
-                snprintf(buffer, buffer_size, "(%s),%s", reg_name(inst->reg_1), reg_name(inst->reg_2));
-            }
-            break;
-        case AddrMode::R_MR:
-            if (inst->reg_1 == RegType::C) {
-                snprintf(buffer, buffer_size, "%s,($FF00+C)", reg_name(inst->reg_2));
-            } else {
-                snprintf(buffer, buffer_size, "%s,(%s)", reg_name(inst->reg_1), reg_name(inst->reg_2));
-            }
-            break;
-        case AddrMode::R_HLI:
-            snprintf(buffer, buffer_size, "%s,(HL+)", reg_name(inst->reg_1));
-            break;
-        case AddrMode::R_HLD:
-            snprintf(buffer, buffer_size, "%s,(HL-)", reg_name(inst->reg_1));
-            break;
-        case AddrMode::HLI_R:
-            snprintf(buffer, buffer_size, "(HL+),%s", reg_name(inst->reg_2));
-            break;
-        case AddrMode::HLD_R:
-            snprintf(buffer, buffer_size, "(HL-),%s", reg_name(inst->reg_2));
-            break;
-        case AddrMode::R_A8:
-            snprintf(buffer, buffer_size, "%s,($FF00+$%02X)", reg_name(inst->reg_1), fetched_data);
-            break;
-        case AddrMode::A8_R:
-            snprintf(buffer, buffer_size, "($%04X),%s", mem_dest, reg_name(inst->reg_2));
-            break;
-        case AddrMode::HL_SPR:
-            snprintf(buffer, buffer_size, "HL,SP+%d", (int8_t)fetched_data);
-            break;
-        case AddrMode::D8:
-            snprintf(buffer, buffer_size, "$%02X", fetched_data);
-            break;
-        case AddrMode::D16:
-            snprintf(buffer, buffer_size, "$%04X", fetched_data);
-            break;
-        case AddrMode::D16_R:
-            snprintf(buffer, buffer_size, "($%04X),%s", fetched_data, reg_name(inst->reg_2));
-            break;
-        case AddrMode::MR_D8:
-            snprintf(buffer, buffer_size, "(%s),$%02X", reg_name(inst->reg_1), fetched_data);
-            break;
-        case AddrMode::MR:
-            snprintf(buffer, buffer_size, "(%s)", reg_name(inst->reg_1));
-            break;
-        case AddrMode::A16_R:
-            snprintf(buffer, buffer_size, "($%04X),%s", fetched_data, reg_name(inst->reg_2));
-            break;
-        case AddrMode::R_A16:
-            snprintf(buffer, buffer_size, "%s,($%04X)", reg_name(inst->reg_1), fetched_data);
-            break;
-        default:
-            snprintf(buffer, buffer_size, "?");
-            break;
-    }
-}
 
 // ===== CONSTRUCTORS & DESTRUCTORS =====
 
-CPU::CPU() : bus(nullptr) {
+CPU::CPU() : flag_op(FlagOp::NONE), inst_pc(0), profiler(nullptr), trace(nullptr) {
     // Initialize CPU state
 }
 
@@ -143,6 +23,7 @@ void CPU::init() {
     regs.sp = 0xFFFE;  // Stack pointer at top of high RAM
     regs.a  = 0x01;
     regs.f  = 0xB0;
+    flag_op = FlagOp::NONE;
     regs.b  = 0x00;
     regs.c  = 0x13;
     regs.d  = 0x00;
@@ -163,6 +44,9 @@ void CPU::init() {
     fetched_data = 0;
     mem_dest = 0;
     dest_is_mem = false;
+#if CPU_PROFILE
+    profile.reset();
+#endif
     
     printf("CPU: Initialized - PC=0x%04X, SP=0x%04X\n", regs.pc, regs.sp);
 }
@@ -176,7 +60,8 @@ void CPU::fetch_instruction() {
     }
     
     // Read the opcode from the current program counter
-    cur_opcode = bus->read(regs.pc++);
+    inst_pc = regs.pc;
+    cur_opcode = bus->fetch(regs.pc++);
     
     // Decode the opcode to get the instruction details
     curr_inst = instruction_by_opcode(cur_opcode);
@@ -381,112 +266,39 @@ void CPU::emu_cycles(int cycles) {
             timer->tick();
             ppu->tick();
         }
-
-        dma->tick();
     }
 }
 
 // ===== MAIN EXECUTION =====
 
 bool CPU::step() {
-    
-    // Gameboy Doctor logging - log CPU state BEFORE instruction execution
-        // Only log if CPU is not halted and executed an opcode
-        if (!halted) {
-            #if CPU_DEBUG
-            // Read 4 bytes from PC for PCMEM
-            u8 pcmem0 = bus->read(regs.pc);
-            u8 pcmem1 = bus->read(regs.pc + 1);
-            u8 pcmem2 = bus->read(regs.pc + 2);
-            u8 pcmem3 = bus->read(regs.pc + 3);
-            
-            // Log in Gameboy Doctor format: A:00 F:11 B:22 C:33 D:44 E:55 H:66 L:77 SP:8888 PC:9999 PCMEM:AA,BB,CC,DD
-            // F field should be hex value of flags register (not string)
-            printf("A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X PCMEM:%02X,%02X,%02X,%02X\n",
-                    regs.a, regs.f, regs.b, regs.c, regs.d, regs.e, regs.h, regs.l, regs.sp, regs.pc,
-                    pcmem0, pcmem1, pcmem2, pcmem3);
-            #endif
-        }
-        
-        // Don't increment PC here - it should be incremented after instruction execution
-        // The PC increment logic will be handled in the instruction processors
-    
+#if CPU_PROFILE
+    u64 start_ticks = ticks;
+#endif
+
     if (!halted) {
-        u16 pc = regs.pc;
+        if (trace) {
+            // Gameboy Doctor state before the instruction, see trace.hpp
+            u8 pcmem[4] = {bus->peek(regs.pc), bus->peek(regs.pc + 1),
+                           bus->peek(regs.pc + 2), bus->peek(regs.pc + 3)};
+            sync_flags();
+            trace->record(regs, ticks, pcmem);
+        }
+
         fetch_instruction();
         emu_cycles(1);
         fetch_data();
-        #if CPU_DEBUG
-        // Format the instruction with operands
-        char operand_buffer[64];
-        format_operand(curr_inst, fetched_data, mem_dest, operand_buffer, sizeof(operand_buffer));
-        
-        // Handle special cases for conditional instructions
-        const char* condition = "";
-        if (curr_inst->cond != CondType::NONE) {
-            condition = cond_name(curr_inst->cond);
-        }
-        
-        // Compose the instruction string into a buffer
-        char instr_buffer[128];
-        int instr_len = 0;
-        if (curr_inst->type == InType::RST) {
-            u8 rst_addr = (cur_opcode & 0x38) >> 3;
-            instr_len = snprintf(instr_buffer, sizeof(instr_buffer),
-                "Step %d: PC=0x%04X 0x%02X %s%s $%02X",
-                ticks, pc, cur_opcode, inst_name(curr_inst->type), condition, rst_addr * 8);
-        } else if (curr_inst->type == InType::JR) {
-            int8_t rel_addr = (int8_t)fetched_data;
-            u16 target_addr = regs.pc + rel_addr;
-            instr_len = snprintf(instr_buffer, sizeof(instr_buffer),
-                "Step %d: PC=0x%04X 0x%02X %s%s $%+d",
-                ticks, pc, cur_opcode, inst_name(curr_inst->type), condition, rel_addr);
-        } else if (curr_inst->type == InType::JP || curr_inst->type == InType::CALL) {
-            instr_len = snprintf(instr_buffer, sizeof(instr_buffer),
-                "Step %d: PC=0x%04X 0x%02X %s%s $%04X",
-                ticks, pc, cur_opcode, inst_name(curr_inst->type), condition, fetched_data);
-        } else if (curr_inst->type == InType::JPHL) {
-            instr_len = snprintf(instr_buffer, sizeof(instr_buffer),
-                "Step %d: PC=0x%04X 0x%02X %s (HL)",
-                ticks, pc, cur_opcode, inst_name(curr_inst->type));
-        } else {
-            instr_len = snprintf(instr_buffer, sizeof(instr_buffer),
-                "Step %d: PC=0x%04X 0x%02X %s%s %s",
-                ticks, pc, cur_opcode, inst_name(curr_inst->type), condition, operand_buffer);
-        }
-
-        // Print the instruction part
-        printf("%s", instr_buffer);
-
-        // Calculate how many spaces to print to align registers at column 40
-        int reg_column = 40;
-        if (instr_len < reg_column) {
-            for (int i = 0; i < reg_column - instr_len; ++i) putchar(' ');
-        } else {
-            putchar(' '); // Always at least one space
-        }
-
-        // Get flag states
-        bool z_flag = get_flag(FLAG_Z);
-        bool n_flag = get_flag(FLAG_N);
-        bool h_flag = get_flag(FLAG_H);
-        bool c_flag = get_flag(FLAG_C);
-
-        // Print registers
-        printf("A:%02X BC:%02X%02X DE:%02X%02X HL:%02X%02X SP:%04X F:%02X[%c%c%c%c]\n",
-               regs.a, regs.b, regs.c, regs.d, regs.e, regs.h, regs.l, regs.sp,
-               regs.f, z_flag ? 'Z' : '-', n_flag ? 'N' : '-', h_flag ? 'H' : '-', c_flag ? 'C' : '-');
-        
-        
-        dbg_update();
-        dbg_print();
-
-        #endif
         execute();
+#if CPU_PROFILE
+        profile.record(cur_opcode, static_cast<u8>(fetched_data), static_cast<u32>(ticks - start_ticks) / 4);
+#endif
 
     }
     else {
         emu_cycles(1);
+#if CPU_PROFILE
+        profile.record_halt(1);
+#endif
         
         if (int_flags) {
             halted = false;
@@ -494,34 +306,23 @@ bool CPU::step() {
     }
 
     if (ime) {
+#if CPU_PROFILE
+        start_ticks = ticks;
+        handle_interrupts();
+        if (ticks != start_ticks) {
+            profile.record_interrupt(static_cast<u32>(ticks - start_ticks) / 4);
+        }
+#else
         handle_interrupts();
+#endif
         enabling_ime = false;
     }
     if (enabling_ime) {
         ime = true;
     }
-    return true;  // Continue running instructions
-} 
-
-// ===== DEBUG FUNCTIONS =====
-
-void CPU::dbg_update() {
-    if (bus->read(0xFF02) == 0x81) {
-        char c = bus->read(0xFF01);
-
-        dbg_msg[msg_size++] = c;
-        bus->write(0xFF02, 0);
-    }
-}
 
-void CPU::dbg_print() {
-    if (dbg_msg[0]) {
-        printf("DBG: %s\n", dbg_msg);
-        
-        // Check if the debug message contains "failed"
-        if (strstr(dbg_msg, "Passed") != nullptr) {
-            printf("CPU: Debug message contains 'failed' - stopping program\n");
-            exit(1);
-        }
+    if (profiler) {
+        profiler->sample(ticks, regs.pc, regs.sp);
     }
+    return true;  // Continue running instructions
 }
@@ -1,5 +1,7 @@
 #include "cpu.hpp"
-#include <unordered_map>
+#include "alu_tables.hpp"
+#include "profiler.hpp"
+#include <array>
 #include <cstdio>
 #include <cstdlib>
 
@@ -41,6 +43,10 @@ static void goto_addr(CPU* cpu, u16 addr, bool push_pc, CondType cond) {
         }
             cpu->regs.pc = addr;
             cpu->emu_cycles(1);
+
+            if (push_pc && cpu->profiler) {
+                cpu->profiler->on_call(addr, cpu->regs.sp);
+            }
     }
 }
 
@@ -57,12 +63,8 @@ static void proc_ld(CPU* cpu, const Instruction* inst) {
         u16 result = sp + e8;
         cpu->cpu_set_reg(RegType::HL, result);
         
-        // Set flags: Z=0, N=0, H=half-carry, C=carry
-        // Check half-carry (bit 3 to bit 4)
-        bool half_carry = ((sp & 0xF) + (e8 & 0xF)) > 0xF;
-        // Check carry (bit 7 to bit 8)
-        bool carry = ((sp & 0xFF) + (e8 & 0xFF)) > 0xFF;
-        cpu->set_flags(0, 0, half_carry, carry);
+        // Flags: Z=0, N=0, H and C from the unsigned low byte addition
+        cpu->defer_flags(FlagOp::ADD_SP, sp, cpu->fetched_data & 0xFF);
         return;
     }
     // Special case: 16-bit bus write (e.g., LD (a16), SP)
@@ -116,6 +118,10 @@ static void proc_ret(CPU* cpu, const Instruction* inst) {
         cpu->regs.pc = n;
 
         cpu->emu_cycles(1);
+
+        if (cpu->profiler) {
+            cpu->profiler->on_return(cpu->regs.sp);
+        }
     }
 }
 
@@ -168,7 +174,12 @@ static void proc_inc(CPU* cpu, const Instruction* inst) {
         return;
     }
 
-    cpu->set_flags(val == 0, 0, (val & 0x0F) == 0, -1);
+#if CPU_ALU_TABLES
+    u8 carry = cpu->get_flag(FLAG_C) ? FLAG_C : 0;
+    cpu->write_flags((alu_tables.inc[(val - 1) & 0xFF] >> 8) | carry);
+#else
+    cpu->defer_flags(FlagOp::INC, val & 0xFF, 0);
+#endif
 }
 
 static void proc_dec(CPU* cpu, const Instruction* inst) {
@@ -178,9 +189,13 @@ static void proc_dec(CPU* cpu, const Instruction* inst) {
         u8 value = cpu->bus->read(addr);
         u8 result = value - 1;
         
-        // Set flags: Z=result==0, N=1, H=half-borrow, C=preserved
-        bool half_borrow = (value & 0x0F) == 0x00;  // Half-borrow occurs when lower nibble was 0x00 before subtraction
-        cpu->set_flags(result == 0, 1, half_borrow, cpu->get_flag(FLAG_C));
+        // Flags: Z=result==0, N=1, H=half-borrow, C=preserved
+#if CPU_ALU_TABLES
+        u8 carry = cpu->get_flag(FLAG_C) ? FLAG_C : 0;
+        cpu->write_flags((alu_tables.dec[value] >> 8) | carry);
+#else
+        cpu->defer_flags(FlagOp::DEC, value, 0);
+#endif
         
         cpu->bus->write(addr, result);
         cpu->emu_cycles(3); // Memory read + write + decrement
@@ -198,9 +213,13 @@ static void proc_dec(CPU* cpu, const Instruction* inst) {
             // 8-bit decrement
             u8 result = (value & 0xFF) - 1;
             
-            // Set flags: Z=result==0, N=1, H=half-borrow, C=preserved
-            bool half_borrow = (value & 0x0F) == 0x00;  // Half-borrow occurs when lower nibble was 0x00 before subtraction
-            cpu->set_flags(result == 0, 1, half_borrow, cpu->get_flag(FLAG_C));
+            // Flags: Z=result==0, N=1, H=half-borrow, C=preserved
+#if CPU_ALU_TABLES
+            u8 carry = cpu->get_flag(FLAG_C) ? FLAG_C : 0;
+            cpu->write_flags((alu_tables.dec[value & 0xFF] >> 8) | carry);
+#else
+            cpu->defer_flags(FlagOp::DEC, value & 0xFF, 0);
+#endif
             
             cpu->cpu_set_reg(inst->reg_1, result);
             cpu->emu_cycles(1);
@@ -211,44 +230,36 @@ static void proc_dec(CPU* cpu, const Instruction* inst) {
 static void proc_sub(CPU* cpu, const Instruction* inst) {
     u8 a = cpu->cpu_read_reg(inst->reg_1) & 0xFF;
     u8 b = cpu->fetched_data & 0xFF;
-    u16 val = a - b;
 
-    // Z flag: result is zero
-    int z = (val & 0xFF) == 0;
-    
-    // N flag: always 1 for subtraction
-    int n = 1;
-    
-    // H flag: half-carry (borrow from bit 3 to bit 4)
-    int h = (a & 0xF) < (b & 0xF);
-    
-    // C flag: carry (borrow from bit 7 to bit 8)
-    int c = a < b;
+#if CPU_ALU_TABLES
+    u16 entry = alu_tables.sub[alu_index(a, b, 0)];
+    cpu->cpu_set_reg(inst->reg_1, entry & 0xFF);
+    cpu->write_flags(entry >> 8);
+#else
+    u16 val = a - b;
 
+    // Z=result is zero, N=1, H=borrow from bit 4, C=borrow
     cpu->cpu_set_reg(inst->reg_1, val);
-    cpu->set_flags(z, n, h, c);
+    cpu->defer_flags(FlagOp::SUB, a, b);
+#endif
 }
 
 static void proc_sbc(CPU* cpu, const Instruction* inst) {
     u8 a = cpu->cpu_read_reg(inst->reg_1) & 0xFF;
     u8 b = cpu->fetched_data & 0xFF;
     u8 carry_in = cpu->get_flag(FLAG_C);
-    u16 val = a - b - carry_in;
 
-    // Z flag: result is zero
-    int z = (val & 0xFF) == 0;
-    
-    // N flag: always 1 for subtraction
-    int n = 1;
-    
-    // H flag: half-carry (borrow from bit 3 to bit 4)
-    int h = (a & 0xF) < ((b & 0xF) + carry_in);
-    
-    // C flag: carry (borrow from bit 7 to bit 8)
-    int c = a < (b + carry_in);
+#if CPU_ALU_TABLES
+    u16 entry = alu_tables.sub[alu_index(a, b, carry_in)];
+    cpu->cpu_set_reg(inst->reg_1, entry & 0xFF);
+    cpu->write_flags(entry >> 8);
+#else
+    u16 val = a - b - carry_in;
 
+    // Same as SUB with the carry subtracted as well
     cpu->cpu_set_reg(inst->reg_1, val);
-    cpu->set_flags(z, n, h, c);
+    cpu->defer_flags(FlagOp::SUB, a, b, carry_in);
+#endif
 }
 
 // CB instruction processor - reads next byte and dispatches to appropriate bit manipulation instruction
@@ -292,6 +303,17 @@ static void proc_cb(CPU* cpu, const Instruction* inst) {
     // Execute the bit manipulation operation
     switch (op) {
         case 0: // RLC, RRC, RL, RR, SLA, SRA, SWAP, SRL
+#if CPU_ALU_TABLES
+        {
+            // Only RL and RR shift the carry in
+            u8 carry = (bit == 2 || bit == 3) ? cpu->get_flag(FLAG_C) : 0;
+            u16 entry = alu_tables.shift[alu_shift_index(bit, carry, value)];
+            result = entry & 0xFF;
+            set_z = (entry >> 8) & FLAG_Z;
+            set_c = (entry >> 8) & FLAG_C;
+            break;
+        }
+#endif
             switch (bit) {
                 case 0: // RLC r
                     result = ((value << 1) | (value >> 7)) & 0xFF;
@@ -379,7 +401,7 @@ static void proc_cb(CPU* cpu, const Instruction* inst) {
     
     // Set flags if needed
     if (op == 0 || op == 1) { // Only set flags for rotation/shift and BIT operations
-        cpu->set_flags(set_z, set_n, set_h, set_c);
+        cpu->write_flags((set_z ? FLAG_Z : 0) | (set_n ? FLAG_N : 0) | (set_h ? FLAG_H : 0) | (set_c ? FLAG_C : 0));
     }
     
     cpu->emu_cycles(1); // Base cycle for CB instruction
@@ -390,11 +412,15 @@ static void proc_adc(CPU* cpu, const Instruction* inst) {
     u16 a = cpu->regs.a;
     u16 c = cpu->get_flag(FLAG_C);
 
+#if CPU_ALU_TABLES
+    u16 entry = alu_tables.add[alu_index(a, u, c)];
+    cpu->regs.a = entry & 0xFF;
+    cpu->write_flags(entry >> 8);
+#else
     cpu->regs.a = (a + u + c) & 0xFF;
 
-    cpu->set_flags(cpu->regs.a == 0, 0, 
-        (a & 0xF) + (u & 0xF) + c > 0xF,
-        a + u + c > 0xFF);
+    cpu->defer_flags(FlagOp::ADD, a, u, c);
+#endif
 }
 
 static void proc_add(CPU* cpu, const Instruction* inst) {
@@ -410,25 +436,22 @@ static void proc_add(CPU* cpu, const Instruction* inst) {
         val = cpu->cpu_read_reg(inst->reg_1) + (char)cpu->fetched_data;
     }
 
-    int z = (val & 0xFF) == 0;
-    int h = (cpu->cpu_read_reg(inst->reg_1) & 0xF) + (cpu->fetched_data & 0xF) >= 0x10;
-    int c = (int)(cpu->cpu_read_reg(inst->reg_1) & 0xFF) + (int)(cpu->fetched_data & 0xFF) >= 0x100;
-
-    if (is_16bit) {
-        z = -1;
-        h = (cpu->cpu_read_reg(inst->reg_1) & 0xFFF) + (cpu->fetched_data & 0xFFF) >= 0x1000;
-        u32 n = ((u32)cpu->cpu_read_reg(inst->reg_1)) + ((u32)cpu->fetched_data);
-        c = n >= 0x10000;
-    }
-
+    // ADD SP,e: Z=0, H and C from the low byte. ADD HL,rr: Z kept, H and C
+    // from bits 11 and 15. ADD A: all four from the 8 bit sum
+    u16 lhs = cpu->cpu_read_reg(inst->reg_1);
     if (inst->reg_1 == RegType::SP) {
-        z = 0;
-        h = (cpu->cpu_read_reg(inst->reg_1) & 0xF) + (cpu->fetched_data & 0xF) >= 0x10;
-        c = (int)(cpu->cpu_read_reg(inst->reg_1) & 0xFF) + (int)(cpu->fetched_data & 0xFF) >= 0x100;
+        cpu->defer_flags(FlagOp::ADD_SP, lhs, cpu->fetched_data & 0xFF);
+    } else if (is_16bit) {
+        cpu->defer_flags(FlagOp::ADD16, lhs, cpu->fetched_data);
+    } else {
+#if CPU_ALU_TABLES
+        cpu->write_flags(alu_tables.add[alu_index(lhs, cpu->fetched_data, 0)] >> 8);
+#else
+        cpu->defer_flags(FlagOp::ADD, lhs & 0xFF, cpu->fetched_data & 0xFF);
+#endif
     }
 
     cpu->cpu_set_reg(inst->reg_1, val & 0xFFFF);
-    cpu->set_flags(z, 0, h, c);
 }
 
 static void proc_jr(CPU* cpu, const Instruction* inst) {
@@ -443,27 +466,28 @@ static void proc_di(CPU* cpu, const Instruction* inst) {
 
 static void proc_and(CPU* cpu, const Instruction* inst) {
     cpu->regs.a &= cpu->fetched_data & 0xFF;
-    cpu->set_flags(cpu->regs.a == 0, 0, 1, 0);
+    cpu->write_flags((cpu->regs.a == 0 ? FLAG_Z : 0) | FLAG_H);
 }
 
 static void proc_or(CPU* cpu, const Instruction* inst) {
     cpu->regs.a |= cpu->fetched_data & 0xFF;
-    cpu->set_flags(cpu->regs.a == 0, 0, 0, 0);
+    cpu->write_flags(cpu->regs.a == 0 ? FLAG_Z : 0);
 }
 
 static void proc_xor(CPU* cpu, const Instruction* inst) {
     // & 0xFF to ensure only lower 8 bits are used
     cpu->regs.a ^= cpu->fetched_data & 0xFF;
-    cpu->set_flags(cpu->regs.a == 0, 0, 0, 0);
+    cpu->write_flags(cpu->regs.a == 0 ? FLAG_Z : 0);
 }
 
 static void proc_cp(CPU* cpu, const Instruction* inst) {
     u8 operand1 = cpu->cpu_read_reg(inst->reg_1);
     u8 operand2 = cpu->fetched_data;
-    u16 val = operand1 - operand2;
-    cpu->set_flags(val == 0, 1, 
-        (operand1 & 0x0F) < (operand2 & 0x0F),
-        operand1 < operand2);
+#if CPU_ALU_TABLES
+    cpu->write_flags(alu_tables.sub[alu_index(operand1, operand2, 0)] >> 8);
+#else
+    cpu->defer_flags(FlagOp::SUB, operand1, operand2);
+#endif
 }
 
 static void proc_rlca(CPU* cpu, const Instruction* inst) {
@@ -475,7 +499,7 @@ static void proc_rlca(CPU* cpu, const Instruction* inst) {
     cpu->regs.a = ((a << 1) | bit7) & 0xFF;
     
     // Set flags: Z=0, N=0, H=0, C=bit7
-    cpu->set_flags(0, 0, 0, bit7);
+    cpu->write_flags(bit7 ? FLAG_C : 0);
     cpu->emu_cycles(1);
 }
 
@@ -488,7 +512,7 @@ static void proc_rrca(CPU* cpu, const Instruction* inst) {
     cpu->regs.a = ((a >> 1) | (bit0 << 7)) & 0xFF;
     
     // Set flags: Z=0, N=0, H=0, C=bit0
-    cpu->set_flags(0, 0, 0, bit0);
+    cpu->write_flags(bit0 ? FLAG_C : 0);
     cpu->emu_cycles(1);
 }
 
@@ -502,7 +526,7 @@ static void proc_rla(CPU* cpu, const Instruction* inst) {
     cpu->regs.a = ((a << 1) | old_carry) & 0xFF;
     
     // Set flags: Z=0, N=0, H=0, C=bit7
-    cpu->set_flags(0, 0, 0, bit7);
+    cpu->write_flags(bit7 ? FLAG_C : 0);
     cpu->emu_cycles(1);
 }
 
@@ -516,11 +540,17 @@ static void proc_rra(CPU* cpu, const Instruction* inst) {
     cpu->regs.a = ((a >> 1) | (old_carry << 7)) & 0xFF;
     
     // Set flags: Z=0, N=0, H=0, C=bit0
-    cpu->set_flags(0, 0, 0, bit0);
+    cpu->write_flags(bit0 ? FLAG_C : 0);
     cpu->emu_cycles(1);
 }
 
 static void proc_daa(CPU* cpu, const Instruction* inst) {
+#if CPU_ALU_TABLES
+    cpu->sync_flags();
+    u16 entry = alu_tables.daa[alu_daa_index(cpu->regs.a, cpu->regs.f)];
+    cpu->regs.a = entry & 0xFF;
+    cpu->write_flags(entry >> 8);
+#else
     if (!cpu->get_flag(FLAG_N)) {
         // After an addition, adjust if (half-)carry occurred or if result is out of bounds
         if (cpu->get_flag(FLAG_C) || cpu->regs.a > 0x99) {
@@ -543,6 +573,7 @@ static void proc_daa(CPU* cpu, const Instruction* inst) {
     
     // These flags are always updated
     cpu->set_flags(cpu->regs.a == 0, cpu->get_flag(FLAG_N), 0, cpu->get_flag(FLAG_C));
+#endif
 }
 
 static void proc_cpl(CPU* cpu, const Instruction* inst) {
@@ -606,47 +637,55 @@ static void proc_stop(CPU* cpu, const Instruction* inst) {
 
 // ===== INSTRUCTION PROCESSOR LOOKUP =====
 
-static std::unordered_map<InType, InstrFunc> processors = {
-    {InType::NONE, proc_none},
-    {InType::NOP,  proc_nop},
-    {InType::LD,   proc_ld},
-    {InType::LDH,  proc_ldh},
-    {InType::JP,   proc_jp},
-    {InType::DI,   proc_di},
-    {InType::AND,  proc_and},
-    {InType::OR,   proc_or},
-    {InType::XOR,  proc_xor},
-    {InType::CP,   proc_cp},
-    {InType::PUSH, proc_push},
-    {InType::POP,  proc_pop},
-    {InType::CALL, proc_call},
-    {InType::JR,   proc_jr},
-    {InType::RET,  proc_ret},
-    {InType::RETI, proc_reti},
-    {InType::RST,  proc_rst},
-    {InType::INC,  proc_inc},
-    {InType::DEC,  proc_dec},
-    {InType::ADD,  proc_add},
-    {InType::ADC,  proc_adc},
-    {InType::SUB,  proc_sub},
-    {InType::SBC,  proc_sbc},
-    {InType::CB,   proc_cb},
-    {InType::RLCA, proc_rlca},
-    {InType::RRCA, proc_rrca},
-    {InType::RLA,  proc_rla},
-    {InType::RRA,  proc_rra},
-    {InType::DAA,  proc_daa},
-    {InType::CPL,  proc_cpl},
-    {InType::SCF,  proc_scf},
-    {InType::CCF,  proc_ccf},
-    {InType::HALT, proc_halt},
-    {InType::EI,   proc_ei}
-};
+static constexpr size_t PROCESSOR_COUNT = static_cast<size_t>(InType::SET) + 1;
 
-InstrFunc inst_get_processor(InType type) {
-    auto it = processors.find(type);
-    if (it != processors.end()) {
-        return it->second;
+// Indexed by InType; anything without a handler falls through to proc_none
+static constexpr std::array<InstrFunc, PROCESSOR_COUNT> make_processors() {
+    std::array<InstrFunc, PROCESSOR_COUNT> table = {};
+    for (auto& func : table) {
+        func = proc_none;
     }
-    return proc_none; // Default to error handler
+
+    table[static_cast<size_t>(InType::NONE)] = proc_none;
+    table[static_cast<size_t>(InType::NOP)]  = proc_nop;
+    table[static_cast<size_t>(InType::LD)]   = proc_ld;
+    table[static_cast<size_t>(InType::LDH)]  = proc_ldh;
+    table[static_cast<size_t>(InType::JP)]   = proc_jp;
+    table[static_cast<size_t>(InType::DI)]   = proc_di;
+    table[static_cast<size_t>(InType::AND)]  = proc_and;
+    table[static_cast<size_t>(InType::OR)]   = proc_or;
+    table[static_cast<size_t>(InType::XOR)]  = proc_xor;
+    table[static_cast<size_t>(InType::CP)]   = proc_cp;
+    table[static_cast<size_t>(InType::PUSH)] = proc_push;
+    table[static_cast<size_t>(InType::POP)]  = proc_pop;
+    table[static_cast<size_t>(InType::CALL)] = proc_call;
+    table[static_cast<size_t>(InType::JR)]   = proc_jr;
+    table[static_cast<size_t>(InType::RET)]  = proc_ret;
+    table[static_cast<size_t>(InType::RETI)] = proc_reti;
+    table[static_cast<size_t>(InType::RST)]  = proc_rst;
+    table[static_cast<size_t>(InType::INC)]  = proc_inc;
+    table[static_cast<size_t>(InType::DEC)]  = proc_dec;
+    table[static_cast<size_t>(InType::ADD)]  = proc_add;
+    table[static_cast<size_t>(InType::ADC)]  = proc_adc;
+    table[static_cast<size_t>(InType::SUB)]  = proc_sub;
+    table[static_cast<size_t>(InType::SBC)]  = proc_sbc;
+    table[static_cast<size_t>(InType::CB)]   = proc_cb;
+    table[static_cast<size_t>(InType::RLCA)] = proc_rlca;
+    table[static_cast<size_t>(InType::RRCA)] = proc_rrca;
+    table[static_cast<size_t>(InType::RLA)]  = proc_rla;
+    table[static_cast<size_t>(InType::RRA)]  = proc_rra;
+    table[static_cast<size_t>(InType::DAA)]  = proc_daa;
+    table[static_cast<size_t>(InType::CPL)]  = proc_cpl;
+    table[static_cast<size_t>(InType::SCF)]  = proc_scf;
+    table[static_cast<size_t>(InType::CCF)]  = proc_ccf;
+    table[static_cast<size_t>(InType::HALT)] = proc_halt;
+    table[static_cast<size_t>(InType::STOP)] = proc_stop;
+    table[static_cast<size_t>(InType::EI)]   = proc_ei;
+    return table;
+}
+
+static constexpr std::array<InstrFunc, PROCESSOR_COUNT> processors = make_processors();
+
+InstrFunc inst_get_processor(InType type) {
+    return processors[static_cast<size_t>(type)];
 } 
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "cpu.hpp"
+#include "profiler.hpp"
 #include <cstdio>
 
 // ===== INTERRUPT HANDLING =====
@@ -23,6 +24,10 @@ void CPU::request_interrupt(u8 interrupt_type) {
 void CPU::int_handle(u16 address) {
     stack_push16(regs.pc);
     regs.pc = address;
+
+    if (profiler) {
+        profiler->on_interrupt(address, regs.sp);
+    }
 }
 
 bool CPU::int_check(u16 address, u8 interrupt_type) {
@@ -0,0 +1,174 @@
+#include "cpu_profile.hpp"
+#include <cstring>
+
+// ===== RECORDING =====
+
+void CpuProfile::reset() {
+    memset(count, 0, sizeof(count));
+    memset(cycles, 0, sizeof(cycles));
+    memset(cb_count, 0, sizeof(cb_count));
+    memset(cb_cycles, 0, sizeof(cb_cycles));
+    halt_cycles = 0;
+    interrupts = 0;
+    interrupt_cycles = 0;
+}
+
+void CpuProfile::merge(const CpuProfile& other) {
+    for (int i = 0; i < 256; i++) {
+        count[i] += other.count[i];
+        cycles[i] += other.cycles[i];
+        cb_count[i] += other.cb_count[i];
+        cb_cycles[i] += other.cb_cycles[i];
+    }
+    halt_cycles += other.halt_cycles;
+    interrupts += other.interrupts;
+    interrupt_cycles += other.interrupt_cycles;
+}
+
+// ===== QUERIES =====
+
+InType CpuProfile::cb_type(u8 cb_opcode) {
+    static const InType ROTATES[8] = {
+        InType::RLC, InType::RRC, InType::RL, InType::RR,
+        InType::SLA, InType::SRA, InType::SWAP, InType::SRL
+    };
+
+    switch (cb_opcode >> 6) {
+        case 0: return ROTATES[(cb_opcode >> 3) & 0x07];
+        case 1: return InType::BIT;
+        case 2: return InType::RES;
+        default: return InType::SET;
+    }
+}
+
+u64 CpuProfile::total_instructions() const {
+    u64 total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += count[i] + cb_count[i];
+    }
+    return total;
+}
+
+u64 CpuProfile::total_cycles() const {
+    u64 total = 0;
+    for (int i = 0; i < 256; i++) {
+        total += cycles[i] + cb_cycles[i];
+    }
+    return total;
+}
+
+void CpuProfile::type_totals(u64* type_count, u64* type_cycles) const {
+    memset(type_count, 0, sizeof(u64) * TYPE_COUNT);
+    memset(type_cycles, 0, sizeof(u64) * TYPE_COUNT);
+
+    for (int i = 0; i < 256; i++) {
+        int type = static_cast<int>(instruction_by_opcode(static_cast<u8>(i))->type);
+        type_count[type] += count[i];
+        type_cycles[type] += cycles[i];
+
+        int cb = static_cast<int>(cb_type(static_cast<u8>(i)));
+        type_count[cb] += cb_count[i];
+        type_cycles[cb] += cb_cycles[i];
+    }
+}
+
+// ===== OUTPUT =====
+
+bool CpuProfile::write(const char* path) const {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+
+    size_t len = strlen(path);
+    bool json = len >= 5 && !strcmp(path + len - 5, ".json");
+    bool ok = json ? write_json(fp) : write_csv(fp);
+
+    fclose(fp);
+    if (ok) {
+        printf("CPU profile written to %s\n", path);
+    }
+    return ok;
+}
+
+bool CpuProfile::write_csv(FILE* fp) const {
+    u64 total = total_cycles();
+    auto row = [&](const char* table, int opcode, const char* name, u64 n, u64 m_cycles) {
+        char op[8] = "";
+        if (opcode >= 0) {
+            snprintf(op, sizeof(op), "0x%02X", opcode);
+        }
+        fprintf(fp, "%s,%s,%s,%llu,%llu,%.3f,%.3f\n", table, op, name,
+                (unsigned long long)n, (unsigned long long)m_cycles,
+                n ? (double)m_cycles / n : 0.0, total ? m_cycles * 100.0 / total : 0.0);
+    };
+
+    fprintf(fp, "table,opcode,name,count,m_cycles,avg_m_cycles,cycle_pct\n");
+    for (int i = 0; i < 256; i++) {
+        if (count[i]) {
+            row("main", i, inst_name(instruction_by_opcode(static_cast<u8>(i))->type), count[i], cycles[i]);
+        }
+    }
+    for (int i = 0; i < 256; i++) {
+        if (cb_count[i]) {
+            row("cb", i, inst_name(cb_type(static_cast<u8>(i))), cb_count[i], cb_cycles[i]);
+        }
+    }
+
+    u64 type_count[TYPE_COUNT];
+    u64 type_cycles[TYPE_COUNT];
+    type_totals(type_count, type_cycles);
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        if (type_count[i]) {
+            row("type", -1, inst_name(static_cast<InType>(i)), type_count[i], type_cycles[i]);
+        }
+    }
+
+    row("halt", -1, "HALT idle", 0, halt_cycles);
+    row("interrupt", -1, "dispatch", interrupts, interrupt_cycles);
+    return !ferror(fp);
+}
+
+bool CpuProfile::write_json(FILE* fp) const {
+    auto entries = [&](const char* key, const u64* n, const u64* m_cycles, bool cb, const char* tail) {
+        fprintf(fp, "  \"%s\": [", key);
+        const char* sep = "\n";
+        for (int i = 0; i < 256; i++) {
+            if (!n[i]) {
+                continue;
+            }
+            InType type = cb ? cb_type(static_cast<u8>(i)) : instruction_by_opcode(static_cast<u8>(i))->type;
+            fprintf(fp, "%s    {\"opcode\": \"0x%02X\", \"name\": \"%s\", \"count\": %llu, \"m_cycles\": %llu}",
+                    sep, i, inst_name(type), (unsigned long long)n[i], (unsigned long long)m_cycles[i]);
+            sep = ",\n";
+        }
+        fprintf(fp, "\n  ]%s\n", tail);
+    };
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"instructions\": %llu,\n", (unsigned long long)total_instructions());
+    fprintf(fp, "  \"m_cycles\": %llu,\n", (unsigned long long)total_cycles());
+    fprintf(fp, "  \"halt_m_cycles\": %llu,\n", (unsigned long long)halt_cycles);
+    fprintf(fp, "  \"interrupts\": %llu,\n", (unsigned long long)interrupts);
+    fprintf(fp, "  \"interrupt_m_cycles\": %llu,\n", (unsigned long long)interrupt_cycles);
+    entries("opcodes", count, cycles, false, ",");
+    entries("cb_opcodes", cb_count, cb_cycles, true, ",");
+
+    u64 type_count[TYPE_COUNT];
+    u64 type_cycles[TYPE_COUNT];
+    type_totals(type_count, type_cycles);
+    fprintf(fp, "  \"types\": [");
+    const char* sep = "\n";
+    for (int i = 0; i < TYPE_COUNT; i++) {
+        if (!type_count[i]) {
+            continue;
+        }
+        fprintf(fp, "%s    {\"name\": \"%s\", \"count\": %llu, \"m_cycles\": %llu}", sep,
+                inst_name(static_cast<InType>(i)), (unsigned long long)type_count[i],
+                (unsigned long long)type_cycles[i]);
+        sep = ",\n";
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    return !ferror(fp);
+}
@@ -20,6 +20,7 @@ u16 CPU::cpu_read_reg(RegType reg) {
         case RegType::L:
             return regs.l;
         case RegType::AF:
+            sync_flags();
             return (regs.a << 8) | regs.f;
         case RegType::BC:
             return (regs.b << 8) | regs.c;
@@ -62,10 +63,12 @@ void CPU::cpu_set_reg(RegType reg, u16 value) {
             regs.l = value & 0xFF;
             break;
         case RegType::F:
+            flag_op = FlagOp::NONE;
             regs.f = value & 0xFF;
             break;
         case RegType::AF:
             regs.a = (value >> 8) & 0xFF;
+            flag_op = FlagOp::NONE;
             regs.f = value & 0xF0;  // Clear lower nibble - flags should always be zero
             break;
         case RegType::BC:
@@ -96,6 +99,7 @@ void CPU::cpu_set_reg(RegType reg, u16 value) {
 // ===== FLAG OPERATIONS =====
 
 void CPU::set_flags(u8 z, u8 n, u8 h, u8 c) {
+    sync_flags();
     if (z != 0xFF) set_flag(FLAG_Z, z);
     if (n != 0xFF) set_flag(FLAG_N, n);
     if (h != 0xFF) set_flag(FLAG_H, h);
@@ -103,6 +107,7 @@ void CPU::set_flags(u8 z, u8 n, u8 h, u8 c) {
 }
 
 void CPU::set_flag(u8 flag, bool value) {
+    sync_flags();
     if (value)
         regs.f |= flag;
     
@@ -110,10 +115,57 @@ void CPU::set_flag(u8 flag, bool value) {
         regs.f &= ~flag;
 }
 
-bool CPU::get_flag(u8 flag) const {
+bool CPU::get_flag(u8 flag) {
+    sync_flags();
     return (regs.f & flag) != 0;
 }
 
+void CPU::materialize_flags() {
+    u32 a = flag_lhs;
+    u32 b = flag_rhs;
+    u32 c = flag_carry;
+    u8 f = regs.f & 0x0F;
+
+    // Same conditions the handlers used to evaluate eagerly
+    switch (flag_op) {
+        case FlagOp::ADD:
+            f |= ((a + b + c) & 0xFF) == 0 ? FLAG_Z : 0;
+            f |= (a & 0xF) + (b & 0xF) + c > 0xF ? FLAG_H : 0;
+            f |= a + b + c > 0xFF ? FLAG_C : 0;
+            break;
+        case FlagOp::SUB:
+            f |= FLAG_N;
+            f |= ((a - b - c) & 0xFF) == 0 ? FLAG_Z : 0;
+            f |= (a & 0xF) < (b & 0xF) + c ? FLAG_H : 0;
+            f |= a < b + c ? FLAG_C : 0;
+            break;
+        case FlagOp::INC:
+            f |= regs.f & FLAG_C;
+            f |= a == 0 ? FLAG_Z : 0;
+            f |= (a & 0xF) == 0 ? FLAG_H : 0;
+            break;
+        case FlagOp::DEC:
+            f |= (regs.f & FLAG_C) | FLAG_N;
+            f |= a == 1 ? FLAG_Z : 0;
+            f |= (a & 0xF) == 0 ? FLAG_H : 0;
+            break;
+        case FlagOp::ADD16:
+            f |= regs.f & FLAG_Z;
+            f |= (a & 0xFFF) + (b & 0xFFF) > 0xFFF ? FLAG_H : 0;
+            f |= a + b > 0xFFFF ? FLAG_C : 0;
+            break;
+        case FlagOp::ADD_SP:
+            f |= (a & 0xF) + (b & 0xF) > 0xF ? FLAG_H : 0;
+            f |= (a & 0xFF) + (b & 0xFF) > 0xFF ? FLAG_C : 0;
+            break;
+        case FlagOp::NONE:
+            return;
+    }
+
+    regs.f = f;
+    flag_op = FlagOp::NONE;
+}
+
 // ===== UTILITY FUNCTIONS =====
 
 u16 CPU::little_to_big_endian(u16 little_endian) {
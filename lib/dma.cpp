@@ -1,13 +1,37 @@
 #include "dma.hpp"
 #include "bus.hpp"
+#include "cpu.hpp"
 #include "ppu.hpp"
-#include <unistd.h>
+#include <cstring>
+
+// Machine cycles before the first byte moves, and for the whole transfer
+constexpr u64 DMA_START_DELAY = 2;
+constexpr u64 DMA_LENGTH = DMA_START_DELAY + 0xA0;
+
+DMA::DMA() : active(false), copied(0), start_tick(0), source(nullptr), ppu(nullptr), bus(nullptr), cpu(nullptr),
+    hash(nullptr) {
+}
 
 void DMA::start(u8 start) {
+    // A restart abandons the rest of the running transfer
+    sync(cpu->get_ticks());
+
     active = true;
-    byte = 0;
-    start_delay = 2;
-    value = start;
+    copied = 0;
+    start_tick = cpu->get_ticks();
+
+    source = bus->dma_source(start);
+    if (!source) {
+        // Registers or banked RAM behind the slow path. The CPU cannot write
+        // anywhere but 0xFF00-0xFFFF until the transfer ends, so the source
+        // is stable and can be read up front.
+        for (int i = 0; i < 0xA0; i++) {
+            snapshot[i] = bus->read_device(start * 0x100 + i);
+        }
+        source = snapshot;
+    }
+
+    bus->lock_dma(start_tick + DMA_LENGTH * 4);
 }
 
 void DMA::set_ppu(PPU* ppu) {
@@ -18,22 +42,48 @@ void DMA::set_bus(Bus* bus) {
     this->bus = bus;
 }
 
-void DMA::tick() {
+void DMA::set_cpu(CPU* cpu) {
+    this->cpu = cpu;
+}
+
+// A direct source stays valid in the copy: it points into shared pages,
+// which nothing can write until the transfer is over
+void DMA::fork_from(const DMA& parent) {
+    *this = parent;
+    hash = nullptr;
+    if (parent.source == parent.snapshot) {
+        source = snapshot;
+    }
+}
+
+void DMA::sync(u64 now) {
     if (!active) {
         return;
     }
 
-    if (start_delay) {
-        start_delay--;
-        return;
+    // Machine cycles fully completed since the start write
+    u64 elapsed = now > start_tick ? (now - start_tick - 1) / 4 : 0;
+    u64 target = elapsed > DMA_START_DELAY ? elapsed - DMA_START_DELAY : 0;
+    if (target > 0xA0) {
+        target = 0xA0;
     }
 
-    ppu->oam_write(byte, bus->read(value* 0x100 + byte));
+    if (target > copied) {
+        if (hash) {
+            for (u32 i = copied; i < target; i++) {
+                hash->update(OAM_LOCATION + i, ppu->oam_data()[i], source[i]);
+            }
+        }
+        memcpy(ppu->oam_data() + copied, source + copied, target - copied);
+        copied = target;
+    }
+    active = copied < 0xA0;
+}
 
-    byte++;
-    active = byte < 0xA0;
+void DMA::finish() {
+    sync(~0ull);
 }
 
 bool DMA::transferring() {
     return active;
-}
\ No newline at end of file
+}
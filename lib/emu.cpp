@@ -1,13 +1,47 @@
 #include "emu.hpp"
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 #include <thread>
 #include <SDL.h>
 
+// Pauses at the end of the instruction that hit
+static void pause_on_hit(const WatchHit& hit, void* user) {
+    const char* kind = hit.kind == WATCH_EXEC ? "Breakpoint" : hit.kind == WATCH_READ ? "Read" : "Write";
+    printf("%s %04X = %02X by PC %04X at tick %llu, paused\n", kind, hit.address, hit.value, hit.pc,
+           static_cast<unsigned long long>(hit.ticks));
+    static_cast<EmuContext*>(user)->paused = true;
+}
+
+// ADDR or FIRST-LAST, in hex
+static bool parse_range(const char* text, u16& first, u16& last) {
+    char* end = nullptr;
+    unsigned long a = strtoul(text, &end, 16);
+    unsigned long b = a;
+    if (*end == '-') {
+        b = strtoul(end + 1, &end, 16);
+    }
+    if (end == text || *end || a > b || b > 0xFFFF) {
+        printf("Bad address range: %s\n", text);
+        return false;
+    }
+    first = static_cast<u16>(a);
+    last = static_cast<u16>(b);
+    return true;
+}
+
 Emulator::Emulator() {
     ctx.paused = false;
     ctx.running = false;
     ctx.die = false;
     ctx.ticks = 0;
+    ctx.profile_dump = false;
+    ctx.trace_toggle = false;
+    ctx.search_step = 0;
+    folded_path = nullptr;
+    trace_path = "trace.bin";
+    ram_search = nullptr;
 }
 
 Emulator::~Emulator() {
@@ -19,28 +53,43 @@ Emulator::~Emulator() {
     if (cpu_thread.joinable()) {
         cpu_thread.join();
     }
+    delete ram_search;
 }
 
 void Emulator::cpu_run() {
     printf("CPU thread started\n");
     
-    // Initialize CPU
-    cpu.init();
-    cpu.set_bus(&bus);
-    cpu.set_timer(&timer);
-    
     ctx.running = true;
     ctx.paused = false;
     ctx.die = false;
     ctx.ticks = 0;
 
     while(ctx.running && !ctx.die) {
+#if CPU_PROFILE
+        if (ctx.profile_dump.exchange(false)) {
+            write_profile();
+        }
+#endif
+
+        if (ctx.trace_toggle.exchange(false)) {
+            if (machine.is_tracing()) {
+                machine.pause_trace();
+                printf("Trace paused\n");
+            } else {
+                machine.start_trace(trace_path);
+            }
+        }
+
+        if (u8 step = ctx.search_step.exchange(0)) {
+            run_search_step(static_cast<SearchStep>(step));
+        }
+
         if (ctx.paused) {
             std::this_thread::sleep_for(std::chrono::milliseconds(10));
             continue;
         }
 
-        if (!cpu.step()) {
+        if (!machine.step()) {
             printf("CPU Stopped\n");
             ctx.running = false;
             break;
@@ -54,51 +103,74 @@ void Emulator::cpu_run() {
 
 int Emulator::run(int argc, char** argv) {
     if (argc < 2) {
-        printf("Usage: emu <rom_file>\n");
+        printf("Usage: emu <rom_file> [--trace FILE] [--sample FILE] [--sym FILE] [--sample-period N]\n"
+               "           [--break ADDR] [--watch ADDR[-ADDR]] [--watch-read ADDR[-ADDR]]\n");
         return -1;
     }
 
-    if (!cartridge.load(argv[1])) {
-        printf("Failed to load ROM file: %s\n", argv[1]);
+    const char* sym_path = nullptr;
+    bool trace = false;
+    u32 sample_period = Profiler::DEFAULT_PERIOD;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_path = argv[++i];
+            trace = true;
+        } else if (!strcmp(argv[i], "--sample") && i + 1 < argc) {
+            folded_path = argv[++i];
+        } else if (!strcmp(argv[i], "--sym") && i + 1 < argc) {
+            sym_path = argv[++i];
+        } else if (!strcmp(argv[i], "--sample-period") && i + 1 < argc) {
+            sample_period = static_cast<u32>(atol(argv[++i]));
+        } else if ((!strcmp(argv[i], "--break") || !strcmp(argv[i], "--watch") ||
+                    !strcmp(argv[i], "--watch-read")) && i + 1 < argc) {
+            u8 kind = !strcmp(argv[i], "--break") ? WATCH_EXEC : !strcmp(argv[i], "--watch") ? WATCH_WRITE : WATCH_READ;
+            u16 first, last;
+            if (!parse_range(argv[++i], first, last)) {
+                return -1;
+            }
+            watchpoints.add(first, last, kind);
+        }
+    }
+
+    // Load the cartridge and wire up all components
+    if (!machine.load(argv[1])) {
         return -2;
     }
 
+    if (folded_path) {
+        // RGBDS writes game.sym next to game.gb
+        std::string default_sym = argv[1];
+        size_t dot = default_sym.find_last_of('.');
+        default_sym = default_sym.substr(0, dot) + ".sym";
+        FILE* fp = sym_path ? nullptr : fopen(default_sym.c_str(), "r");
+        if (fp) {
+            fclose(fp);
+            sym_path = default_sym.c_str();
+        }
+        machine.start_profiler(sample_period, sym_path);
+    }
+
+    if (trace && !machine.start_trace(trace_path)) {
+        return -2;
+    }
+
+    if (watchpoints.count()) {
+        watchpoints.set_callback(pause_on_hit, &ctx);
+        machine.set_watchpoints(&watchpoints);
+    }
+
     printf("Cart loaded..\n");
 
-    // Connect bus to cartridge
-    bus.set_cartridge(&cartridge);
-    bus.set_ram(&ram);
-    bus.set_cpu(&cpu);
-    bus.set_io(&io);
-    io.set_timer(&timer);
-    io.set_cpu(&cpu);
-    io.set_joypad(&joypad);
-    timer.set_cpu(&cpu);
-    bus.set_ppu(&ppu);
-    dma.set_ppu(&ppu);
-    dma.set_bus(&bus);
-    io.set_dma(&dma);
-    cpu.set_dma(&dma);
-    cpu.set_ppu(&ppu);
-    bus.set_dma(&dma);
-    io.set_lcd(&lcd);
-    lcd.set_dma(&dma);
-    ppu.set_lcd(&lcd);
-    ppu.set_cpu(&cpu);
-    ppu.set_bus(&bus);
-    ppu.set_cart(&cartridge);
     // Set bus reference for UI
-    ui.set_bus(&bus);
-    ui.set_ppu(&ppu);
-    ui.set_joypad(&joypad);
+    ui.set_bus(&machine.bus);
+    ui.set_ppu(&machine.ppu);
+    ui.set_joypad(&machine.joypad);
     // Initialize UI
     if (!ui.init()) {
         printf("Failed to initialize UI\n");
         return -3;
     }
 
-    ppu.init();
-
     printf("SDL window created successfully\n");
 
     // Start CPU thread
@@ -126,10 +198,21 @@ int Emulator::run(int argc, char** argv) {
             break;
         }
         
+        if (ui.take_profile_request()) {
+            ctx.profile_dump = true;
+        }
+        if (ui.take_trace_toggle()) {
+            ctx.trace_toggle = true;
+        }
+        SearchStep search_step = ui.take_search_step();
+        if (search_step != SearchStep::NONE) {
+            ctx.search_step = static_cast<u8>(search_step);
+        }
+
         // Update display if frame has changed
-        if (prev_frame != ppu.current_frame) {
+        if (prev_frame != machine.ppu.current_frame) {
             ui.update();
-            prev_frame = ppu.current_frame;
+            prev_frame = machine.ppu.current_frame;
         }
         
         // Frame rate limiting
@@ -147,10 +230,53 @@ int Emulator::run(int argc, char** argv) {
         cpu_thread.join();
     }
 
+#if CPU_PROFILE
+    write_profile();
+#endif
+    if (folded_path) {
+        machine.profiler.write_folded(folded_path);
+    }
+    machine.stop_trace();
+
     printf("Emulator stopped\n");
     return 0;
 }
 
+// Written from the CPU thread while it runs, or after it has been joined
+void Emulator::write_profile() {
+#if CPU_PROFILE
+    machine.cpu.profile.write("cpu_profile.csv");
+    machine.cpu.profile.write("cpu_profile.json");
+#endif
+}
+
 EmuContext* Emulator::get_context() {
     return &ctx;
-} 
\ No newline at end of file
+}
+
+// Run from the CPU thread between instructions, so the snapshot is consistent
+void Emulator::run_search_step(SearchStep step) {
+    if (step == SearchStep::START) {
+        if (!ram_search) {
+            ram_search = new RamSearch();
+        }
+        ram_search->start(machine);
+        printf("RAM search started over WRAM, HRAM and cartridge RAM\n");
+        ram_search->print(0);
+        return;
+    }
+    if (!ram_search) {
+        printf("No RAM search, press F5 to start one\n");
+        return;
+    }
+
+    ram_search->snapshot(machine);
+    switch (step) {
+        case SearchStep::UNCHANGED: ram_search->filter_previous(SearchCompare::EQUAL); break;
+        case SearchStep::CHANGED:   ram_search->filter_previous(SearchCompare::NOT_EQUAL); break;
+        case SearchStep::DECREASED: ram_search->filter_previous(SearchCompare::LESS); break;
+        case SearchStep::INCREASED: ram_search->filter_previous(SearchCompare::GREATER); break;
+        default: break;
+    }
+    ram_search->print(16);
+}
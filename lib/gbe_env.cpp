@@ -0,0 +1,360 @@
+#include "gbe_env.h"
+#include "batch.hpp"
+#include "machine.hpp"
+#include "ram_search.hpp"
+#include <cstdio>
+#include <exception>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The instances behind a gbe_env handle
+ *
+ * jobs[i] always points at machines[i]; gbe_step() only rewrites the
+ * budgets, so stepping allocates nothing. argb holds the converted frames
+ * for gbe_framebuffer() and is only allocated once that is first called.
+ * searches[i] is instance i's RAM search, nullptr until one is started.
+ */
+struct gbe_env {
+    std::string rom_path;
+    u8 obs_outputs = 0;
+    u32 obs_width = 0;
+    u32 obs_height = 0;
+    std::vector<Machine*> machines;
+    std::vector<BatchJob> jobs;
+    std::vector<u32> argb;
+    std::vector<RamSearch*> searches;
+    BatchRunner runner;
+};
+
+// ===== HELPERS =====
+
+// Runs the body of an entry point. An exception must not unwind into a C
+// caller, so one that escapes (out of memory, no threads for the pool) is
+// reported and the entry point returns its error value instead
+template <typename T, typename Body>
+static T guarded(T error, Body body) {
+    try {
+        return body();
+    } catch (const std::exception& e) {
+        printf("gbe_env: %s\n", e.what());
+    } catch (...) {
+        printf("gbe_env: unknown exception\n");
+    }
+    return error;
+}
+
+static Machine* load_instance(const gbe_env* env) {
+    // Heap allocated, the machine is too large to keep on the stack
+    Machine* machine = new Machine();
+    machine->set_persistent(false);
+    bool ok = guarded<bool>(false, [&] {
+        return machine->load(env->rom_path.c_str()) &&
+               machine->set_observation(env->obs_outputs, env->obs_width, env->obs_height);
+    });
+    if (!ok) {
+        delete machine;
+        return nullptr;
+    }
+    machine->set_throttle(false);
+    return machine;
+}
+
+// ===== LIFETIME =====
+
+gbe_env* gbe_create(const char* rom_path, uint32_t n) {
+    if (!rom_path || n == 0) {
+        return nullptr;
+    }
+
+    // The pool starts its threads in the constructor
+    gbe_env* env = guarded<gbe_env*>(nullptr, [] { return new gbe_env(); });
+    if (!env) {
+        return nullptr;
+    }
+
+    bool ok = guarded<bool>(false, [&] {
+        env->rom_path = rom_path;
+        env->machines.reserve(n);
+        env->jobs.resize(n);
+        env->searches.resize(n, nullptr);
+
+        for (uint32_t i = 0; i < n; i++) {
+            Machine* machine = load_instance(env);
+            if (!machine) {
+                return false;
+            }
+            env->machines.push_back(machine);
+            env->jobs[i].machine = machine;
+        }
+        return true;
+    });
+    if (!ok) {
+        gbe_destroy(env);
+        return nullptr;
+    }
+    return env;
+}
+
+void gbe_destroy(gbe_env* env) {
+    if (!env) {
+        return;
+    }
+    for (Machine* machine : env->machines) {
+        delete machine;
+    }
+    for (RamSearch* search : env->searches) {
+        delete search;
+    }
+    delete env;
+}
+
+int gbe_reset(gbe_env* env, const uint32_t* ids, uint32_t count) {
+    return guarded<int>(-1, [&]() -> int {
+        uint32_t n = static_cast<uint32_t>(env->machines.size());
+        if (!ids) {
+            count = n;
+        }
+
+        int result = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t id = ids ? ids[i] : i;
+            if (id >= n) {
+                result = -1;
+                continue;
+            }
+
+            // Loading again from scratch is the only way back to power-on state.
+            // The ROM image itself is shared, so this costs the arena and a copy
+            // of the header
+            Machine* machine = load_instance(env);
+            if (!machine) {
+                result = -1;
+                continue;
+            }
+            delete env->machines[id];
+            env->machines[id] = machine;
+            env->jobs[id].machine = machine;
+        }
+        return result;
+    });
+}
+
+// The instance's search, nullptr for a bad id or before gbe_search_start()
+static RamSearch* find_search(gbe_env* env, uint32_t id) {
+    return id < env->searches.size() ? env->searches[id] : nullptr;
+}
+
+// GBE_CMP_* match the SearchCompare order
+static bool to_compare(int compare, SearchCompare& op) {
+    if (compare < GBE_CMP_EQ || compare > GBE_CMP_GE) {
+        return false;
+    }
+    op = static_cast<SearchCompare>(compare);
+    return true;
+}
+
+// ===== STEPPING =====
+
+int gbe_step(gbe_env* env, const uint8_t* actions, uint32_t frames_per_action) {
+    return gbe_step_repeat(env, actions, frames_per_action, GBE_REDUCE_ALL);
+}
+
+int gbe_step_repeat(gbe_env* env, const uint8_t* actions, uint32_t frames_per_action, int reduce) {
+    return guarded<int>(-1, [&]() -> int {
+        uint32_t n = static_cast<uint32_t>(env->machines.size());
+
+        FrameReduce mode = FrameReduce::ALL;
+        if (reduce == GBE_REDUCE_LAST) {
+            mode = FrameReduce::LAST;
+        } else if (reduce == GBE_REDUCE_MAX_LAST_TWO) {
+            mode = FrameReduce::MAX_LAST_TWO;
+        }
+
+        // GBE_BUTTON_* match the Joypad::set_buttons layout
+        for (uint32_t i = 0; i < n; i++) {
+            if (actions) {
+                env->machines[i]->joypad.set_buttons(actions[i]);
+            }
+            env->jobs[i].frame_budget = frames_per_action;
+            env->jobs[i].cycle_budget = 0;
+            env->jobs[i].reduce = mode;
+        }
+
+        return static_cast<int>(n - env->runner.run(env->jobs.data(), n));
+    });
+}
+
+// ===== STATE =====
+
+uint32_t gbe_num_envs(const gbe_env* env) {
+    return guarded<uint32_t>(0, [&]() -> uint32_t {
+        return static_cast<uint32_t>(env->machines.size());
+    });
+}
+
+uint32_t gbe_num_workers(const gbe_env* env) {
+    return guarded<uint32_t>(0, [&]() -> uint32_t {
+        return env->runner.get_workers();
+    });
+}
+
+const uint8_t* gbe_frame(gbe_env* env, uint32_t id) {
+    return guarded<const uint8_t*>(nullptr, [&]() -> const uint8_t* {
+        if (id >= env->machines.size()) {
+            return nullptr;
+        }
+        return env->machines[id]->ppu.frame_buffer;
+    });
+}
+
+const uint32_t* gbe_framebuffer(gbe_env* env, uint32_t id) {
+    return guarded<const uint32_t*>(nullptr, [&]() -> const uint32_t* {
+        if (id >= env->machines.size()) {
+            return nullptr;
+        }
+        if (env->argb.empty()) {
+            env->argb.resize(env->machines.size() * XRES * YRES);
+        }
+
+        u32* argb = env->argb.data() + id * XRES * YRES;
+        frame_to_argb(env->machines[id]->ppu.frame_buffer, DMG_COLORS, argb);
+        return argb;
+    });
+}
+
+int gbe_set_observation(gbe_env* env, uint32_t outputs, uint32_t width, uint32_t height) {
+    return guarded<int>(-1, [&]() -> int {
+        outputs &= GBE_OBS_SHADE | GBE_OBS_GRAY | GBE_OBS_RESIZED;
+        // Checked once up front, so a bad size changes nothing
+        if (!Observation::supports(static_cast<u8>(outputs), width, height)) {
+            return -1;
+        }
+        for (Machine* machine : env->machines) {
+            if (!machine->set_observation(static_cast<u8>(outputs), width, height)) {
+                // Out of memory part way: put every instance back as it was
+                for (Machine* m : env->machines) {
+                    m->set_observation(env->obs_outputs, env->obs_width, env->obs_height);
+                }
+                return -1;
+            }
+        }
+
+        env->obs_outputs = static_cast<u8>(outputs);
+        env->obs_width = width;
+        env->obs_height = height;
+        return 0;
+    });
+}
+
+const uint8_t* gbe_observation(gbe_env* env, uint32_t id, uint32_t output) {
+    return guarded<const uint8_t*>(nullptr, [&]() -> const uint8_t* {
+        if (id >= env->machines.size()) {
+            return nullptr;
+        }
+
+        // GBE_OBS_* match the OBS_* flags
+        const Observation& obs = env->machines[id]->observation;
+        switch (output) {
+            case GBE_OBS_SHADE:   return obs.shade();
+            case GBE_OBS_GRAY:    return obs.gray();
+            case GBE_OBS_RESIZED: return obs.resized();
+            default:              return nullptr;
+        }
+    });
+}
+
+uint8_t* gbe_wram(gbe_env* env, uint32_t id) {
+    return guarded<uint8_t*>(nullptr, [&]() -> uint8_t* {
+        if (id >= env->machines.size()) {
+            return nullptr;
+        }
+        return env->machines[id]->ram.wram_data();
+    });
+}
+
+// ===== RAM SEARCH =====
+
+int gbe_search_start(gbe_env* env, uint32_t id, uint32_t regions) {
+    return guarded<int>(-1, [&]() -> int {
+        if (id >= env->machines.size()) {
+            return -1;
+        }
+        if (!env->searches[id]) {
+            // About 136 KB, only allocated for instances that are searched
+            env->searches[id] = new (std::nothrow) RamSearch();
+            if (!env->searches[id]) {
+                return -1;
+            }
+        }
+
+        // GBE_SEARCH_* match the SEARCH_* flags
+        RamSearch* search = env->searches[id];
+        search->start(*env->machines[id], static_cast<u8>(regions & SEARCH_ALL));
+        return static_cast<int>(search->count());
+    });
+}
+
+int gbe_search_snapshot(gbe_env* env, uint32_t id) {
+    return guarded<int>(-1, [&]() -> int {
+        RamSearch* search = find_search(env, id);
+        if (!search) {
+            return -1;
+        }
+        search->snapshot(*env->machines[id]);
+        return 0;
+    });
+}
+
+int gbe_search_previous(gbe_env* env, uint32_t id, int compare) {
+    return guarded<int>(-1, [&]() -> int {
+        RamSearch* search = find_search(env, id);
+        SearchCompare op;
+        if (!search || !to_compare(compare, op)) {
+            return -1;
+        }
+        return static_cast<int>(search->filter_previous(op));
+    });
+}
+
+int gbe_search_value(gbe_env* env, uint32_t id, int compare, uint8_t value) {
+    return guarded<int>(-1, [&]() -> int {
+        RamSearch* search = find_search(env, id);
+        SearchCompare op;
+        if (!search || !to_compare(compare, op)) {
+            return -1;
+        }
+        return static_cast<int>(search->filter_value(op, value));
+    });
+}
+
+int gbe_search_delta(gbe_env* env, uint32_t id, int delta) {
+    return guarded<int>(-1, [&]() -> int {
+        RamSearch* search = find_search(env, id);
+        if (!search) {
+            return -1;
+        }
+        return static_cast<int>(search->filter_delta(delta));
+    });
+}
+
+int gbe_search_results(gbe_env* env, uint32_t id, uint16_t* addresses, uint8_t* values, uint32_t max) {
+    return guarded<int>(-1, [&]() -> int {
+        RamSearch* search = find_search(env, id);
+        if (!search) {
+            return -1;
+        }
+        if (!addresses) {
+            max = 0;
+        }
+
+        u32 total = search->results(addresses, max);
+        if (values) {
+            for (u32 i = 0; i < total && i < max; i++) {
+                values[i] = search->value(addresses[i]);
+            }
+        }
+        return static_cast<int>(total);
+    });
+}
@@ -1,11 +1,10 @@
 #include "instructions.hpp"
 #include <array>
 
-// Static array to store all instructions indexed by opcode
-static std::array<Instruction, 256> instruction_table = {};
+// Builds the decode table; evaluated at compile time
+static constexpr std::array<Instruction, 256> make_instruction_table() {
+    std::array<Instruction, 256> instruction_table = {};
 
-// Initialize the instruction table
-static void init_instruction_table() {
     // Initialize all to error instruction
     for (int i = 0; i < 256; i++) {
         instruction_table[i] = {
@@ -159,8 +158,8 @@ static void init_instruction_table() {
     // 0x0F - RRCA
     instruction_table[0x0F] = {InType::RRCA, AddrMode::IMP, RegType::NONE, RegType::NONE, CondType::NONE, 0};
     
-    // // 0x10 - STOP
-    // instruction_table[0x10] = {InType::STOP, AddrMode::IMP, RegType::NONE, RegType::NONE, CondType::NONE, 0};
+    // 0x10 - STOP (two bytes, the second one is ignored)
+    instruction_table[0x10] = {InType::STOP, AddrMode::D8, RegType::NONE, RegType::NONE, CondType::NONE, 0};
     
     // // 0x11 - LD DE, d16
     instruction_table[0x11] = {InType::LD, AddrMode::R_D16, RegType::DE, RegType::NONE, CondType::NONE, 0};
@@ -597,17 +596,15 @@ static void init_instruction_table() {
     instruction_table[0xF7] = {InType::RST, AddrMode::IMP, RegType::NONE, RegType::NONE, CondType::NONE, 0};
     // 0xFF - RST 38H
     instruction_table[0xFF] = {InType::RST, AddrMode::IMP, RegType::NONE, RegType::NONE, CondType::NONE, 0};
+
+    return instruction_table;
 }
 
+// Shared read-only by every CPU in the process
+static constexpr std::array<Instruction, 256> instruction_table = make_instruction_table();
+
 // Function to get instruction by opcode
-Instruction* instruction_by_opcode(u8 opcode) {
-    // Initialize table on first call
-    static bool initialized = false;
-    if (!initialized) {
-        init_instruction_table();
-        initialized = true;
-    }
-    
+const Instruction* instruction_by_opcode(u8 opcode) {
     return &instruction_table[opcode];
 }
 
@@ -1,5 +1,4 @@
 #include "joypad.hpp"
-#include <SDL.h>
 
 Joypad::Joypad() : button_state(0xFF), select_buttons(0), select_dpad(0) {
     // Initialize with all buttons released (active low, so 0xFF means all released)
@@ -40,31 +39,8 @@ void Joypad::set_button_state(u8 button, bool pressed) {
     }
 }
 
-void Joypad::update_from_sdl_key(int sdl_key, bool pressed) {
-    switch (sdl_key) {
-        case SDLK_a:        // A button
-            set_button_state(BUTTON_A, pressed);
-            break;
-        case SDLK_s:        // B button
-            set_button_state(BUTTON_B, pressed);
-            break;
-        case SDLK_RETURN:   // Start button
-            set_button_state(BUTTON_START, pressed);
-            break;
-        case SDLK_SPACE:    // Select button
-            set_button_state(BUTTON_SELECT, pressed);
-            break;
-        case SDLK_UP:       // Up arrow
-            set_button_state(BUTTON_UP << 4, pressed);
-            break;
-        case SDLK_DOWN:     // Down arrow
-            set_button_state(BUTTON_DOWN << 4, pressed);
-            break;
-        case SDLK_LEFT:     // Left arrow
-            set_button_state(BUTTON_LEFT << 4, pressed);
-            break;
-        case SDLK_RIGHT:    // Right arrow
-            set_button_state(BUTTON_RIGHT << 4, pressed);
-            break;
+void Joypad::set_buttons(u8 mask) {
+    for (int bit = 0; bit < 8; bit++) {
+        set_button_state(1 << bit, mask & (1 << bit));
     }
-} 
\ No newline at end of file
+}
\ No newline at end of file
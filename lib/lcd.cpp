@@ -1,8 +1,6 @@
 #include "lcd.hpp"
 #include "dma.hpp"
 
-constexpr unsigned long colors_default[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000};
-
 void LCD::init() {
     lcdc = 0x91;
     scroll_x = 0;
@@ -16,28 +14,28 @@ void LCD::init() {
     win_x = 0;
 
     for (int i=0; i<4; i++) {
-        bg_colors[i] = colors_default[i];
-        sp1_colors[i] = colors_default[i];
-        sp2_colors[i] = colors_default[i];
+        bg_shades[i] = i;
+        sp1_shades[i] = i;
+        sp2_shades[i] = i;
     }
 }
 
 void LCD::update_palette(u8 palette_data, u8 pal) {
-    u32 *p_colors = bg_colors;
+    u8 *p_shades = bg_shades;
 
     switch(pal) {
         case 1:
-            p_colors = sp1_colors;
+            p_shades = sp1_shades;
             break;
         case 2:
-            p_colors = sp2_colors;
+            p_shades = sp2_shades;
             break;
     }
 
-    p_colors[0] = colors_default[palette_data & 0b11];
-    p_colors[1] = colors_default[(palette_data >> 2) & 0b11];
-    p_colors[2] = colors_default[(palette_data >> 4) & 0b11];
-    p_colors[3] = colors_default[(palette_data >> 6) & 0b11];
+    p_shades[0] = palette_data & 0b11;
+    p_shades[1] = (palette_data >> 2) & 0b11;
+    p_shades[2] = (palette_data >> 4) & 0b11;
+    p_shades[3] = (palette_data >> 6) & 0b11;
 }
 
 u8 LCD::read(u16 address) {
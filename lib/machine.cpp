@@ -0,0 +1,294 @@
+#include "machine.hpp"
+#include <new>
+
+// ===== INITIALIZATION =====
+
+void Machine::connect() {
+    bus.set_cartridge(&cartridge);
+    cartridge.set_cpu(&cpu);
+    bus.set_ram(&ram);
+    bus.set_cpu(&cpu);
+    bus.set_io(&io);
+    io.set_timer(&timer);
+    io.set_cpu(&cpu);
+    io.set_joypad(&joypad);
+    timer.set_cpu(&cpu);
+    bus.set_ppu(&ppu);
+    dma.set_ppu(&ppu);
+    dma.set_bus(&bus);
+    dma.set_cpu(&cpu);
+    io.set_dma(&dma);
+    cpu.set_ppu(&ppu);
+    bus.set_dma(&dma);
+    io.set_lcd(&lcd);
+    lcd.set_dma(&dma);
+    ppu.set_lcd(&lcd);
+    ppu.set_cpu(&cpu);
+    ppu.set_bus(&bus);
+    ppu.set_cart(&cartridge);
+    ppu.set_dma(&dma);
+}
+
+bool Machine::load(const char* rom_path) {
+    if (!cartridge.load(rom_path)) {
+        printf("Failed to load ROM file: %s\n", rom_path);
+        return false;
+    }
+
+    // Guest RAM in the page store, all other variable-size state in one
+    // block; nothing is allocated after this
+    u32 page_count = CART_RAM_PAGE + cartridge.ram_pages();
+    size_t frame_storage = with_frame_buffer ? PPU::STORAGE_SIZE : 0;
+    size_t storage = PageStore::table_size(page_count) + cartridge.storage_size() + frame_storage;
+    if (!arena.reserve(storage) || !pages.init(arena, page_count)) {
+        return false;
+    }
+    ram.set_pages(&pages);
+    ppu.set_pages(&pages);
+    if (!cartridge.setup_banking(arena, pages)) {
+        return false;
+    }
+
+    connect();
+
+    ppu.init(arena, with_frame_buffer);
+    cpu.init();
+    cpu.set_bus(&bus);
+    cpu.set_timer(&timer);
+
+    instructions = 0;
+    return true;
+}
+
+// ===== FORKING =====
+
+Machine* Machine::fork() {
+    Machine* child = new (std::nothrow) Machine();
+    if (!child) {
+        return nullptr;
+    }
+
+    // The child's arena holds its slot tables, mapper and frame buffer
+    size_t frame_storage = ppu.frame_buffer ? PPU::STORAGE_SIZE : 0;
+    size_t storage = PageStore::table_size(pages.size()) + Cartridge::fork_storage_size() + frame_storage;
+    if (!child->arena.reserve(storage) || !child->pages.share(child->arena, pages) ||
+        !child->cartridge.fork_from(cartridge, child->arena, child->pages)) {
+        delete child;
+        return nullptr;
+    }
+
+    // Registers, HRAM and OAM are small enough to copy outright
+    child->cpu = cpu;
+    child->cpu.set_profiler(nullptr);
+    child->cpu.set_trace(nullptr);
+    child->timer = timer;
+    child->lcd = lcd;
+    child->io = io;
+    child->joypad = joypad;
+    child->ram = ram;
+    child->ram.set_pages(&child->pages);
+    child->ppu.fork_from(ppu, child->arena, child->pages);
+    child->dma.fork_from(dma);
+    child->instructions = instructions;
+    child->with_frame_buffer = with_frame_buffer;
+
+    child->connect();
+    child->cpu.set_bus(&child->bus);
+    child->cpu.set_timer(&child->timer);
+    child->bus.fork_from(bus);
+    bool observed = child->set_observation(observation.get_outputs(), observation.get_width(), observation.get_height());
+    child->memory_hash = memory_hash;
+    child->connect_state_hash(bus_hashing);
+
+    // Every page is shared now, so this machine's stores must fault too
+    bus.remap();
+    if (!observed) {
+        delete child;
+        return nullptr;
+    }
+    return child;
+}
+
+// ===== CONFIGURATION =====
+
+bool Machine::set_observation(u8 outputs, u32 width, u32 height) {
+    bool ok = observation.configure(outputs, width, height);
+    ppu.set_observation(observation.get_outputs() ? &observation : nullptr);
+    return ok;
+}
+
+// ===== STATE HASH =====
+
+void Machine::connect_state_hash(bool enabled) {
+    StateHash* hash = enabled ? &memory_hash : nullptr;
+    ram.set_state_hash(hash);
+    ppu.set_state_hash(hash);
+    dma.set_state_hash(hash);
+    cartridge.set_state_hash(hash);
+    bus_hashing = enabled;
+    bus.set_hashing(enabled);
+}
+
+// Bytes a running OAM DMA has yet to copy are hashed as they arrive
+StateHash Machine::hash_memory() {
+    StateHash hash;
+    Pages slots = pages.slots(0);
+    for (u32 slot = 0; slot < pages.size(); slot++) {
+        hash.add(slot * PAGE_SIZE, slots[slot], PAGE_SIZE);
+    }
+    hash.add(OAM_LOCATION, ppu.oam_data(), 0xA0);
+    hash.add(HRAM_LOCATION, ram.hram_data(), 0x7F);
+    return hash;
+}
+
+void Machine::set_state_hash(bool enabled) {
+    memory_hash = enabled ? hash_memory() : StateHash();
+    connect_state_hash(enabled);
+}
+
+u64 Machine::register_hash() {
+    cpu.sync_flags();
+    const Registers& r = cpu.regs;
+    u64 bytes = static_cast<u64>(r.a) | static_cast<u64>(r.f) << 8 | static_cast<u64>(r.b) << 16 |
+                static_cast<u64>(r.c) << 24 | static_cast<u64>(r.d) << 32 | static_cast<u64>(r.e) << 40 |
+                static_cast<u64>(r.h) << 48 | static_cast<u64>(r.l) << 56;
+    u64 words = static_cast<u64>(r.sp) | static_cast<u64>(r.pc) << 16 | static_cast<u64>(cpu.ime) << 32 |
+                static_cast<u64>(cpu.halted) << 33;
+    return StateHash::mix(StateHash::mix(bytes) ^ words);
+}
+
+u64 Machine::state_hash() {
+    return bus_hashing ? memory_hash.get() ^ register_hash() : 0;
+}
+
+u64 Machine::compute_state_hash() {
+    return hash_memory().get() ^ register_hash();
+}
+
+// ===== PROFILING =====
+
+void Machine::start_profiler(u32 period, const char* sym_path) {
+    // Reserves the profiler's stacks; machines that never profile skip this
+    profiler.reset();
+    profiler.set_cartridge(&cartridge);
+    profiler.set_period(period);
+    if (sym_path) {
+        profiler.load_symbols(sym_path);
+    }
+    cpu.set_profiler(&profiler);
+}
+
+// ===== TRACING =====
+
+bool Machine::start_trace(const char* path) {
+    if (!trace.is_open() && !trace.open(path)) {
+        return false;
+    }
+    trace.set_cartridge(&cartridge);
+    cpu.set_trace(&trace);
+    return true;
+}
+
+void Machine::stop_trace() {
+    cpu.set_trace(nullptr);
+    trace.close();
+}
+
+// ===== STATISTICS =====
+
+void Footprint::add(const char* name, size_t bytes) {
+    if (count < MAX_ITEMS) {
+        items[count++] = {name, bytes};
+    }
+    total += bytes;
+}
+
+Footprint Machine::footprint() const {
+    Footprint result;
+
+    const Footprint::Item members[] = {
+        {"arena", sizeof(arena)},
+        {"pages", sizeof(pages)},
+        {"cpu", sizeof(cpu)},
+        {"timer", sizeof(timer)},
+        {"lcd", sizeof(lcd)},
+        {"ppu", sizeof(ppu)},
+        {"bus", sizeof(bus)},
+        {"dma", sizeof(dma)},
+        {"io", sizeof(io)},
+        {"joypad", sizeof(joypad)},
+        {"ram", sizeof(ram)},
+        {"cartridge", sizeof(cartridge)},
+        {"profiler", sizeof(profiler)},
+        {"trace", sizeof(trace)},
+        {"observation", sizeof(observation)},
+        {"state hash", sizeof(memory_hash)},
+    };
+    size_t listed = 0;
+    for (const Footprint::Item& item : members) {
+        result.add(item.name, item.bytes);
+        listed += item.bytes;
+    }
+    // Cache line alignment and the counters
+    result.add("padding", sizeof(Machine) - listed);
+
+    size_t frame_storage = ppu.frame_buffer ? PPU::STORAGE_SIZE : 0;
+    size_t tables = PageStore::table_size(pages.size());
+    result.add("frame buffer", frame_storage);
+    result.add("page tables", tables);
+    result.add("cartridge storage", arena.get_capacity() - frame_storage - tables);
+    result.add("observation planes", observation.get_storage());
+    result.add("ram pages", pages.amortized_bytes());
+    return result;
+}
+
+// ===== MAIN EXECUTION =====
+
+bool Machine::step() {
+    if (!cpu.halted) {
+        instructions++;
+    }
+    return cpu.step();
+}
+
+void Machine::select_output(u32 remaining, FrameReduce reduce) {
+    PixelOutput output = PixelOutput::WRITE;
+
+    if (reduce == FrameReduce::LAST && remaining > 1) {
+        output = PixelOutput::SKIP;
+    } else if (reduce == FrameReduce::MAX_LAST_TWO) {
+        // The second to last frame is written as usual and the last one is
+        // folded into it. With count 1 that is whatever the previous run
+        // left in the buffer, still the last two frames emulated
+        if (remaining > 2) {
+            output = PixelOutput::SKIP;
+        } else if (remaining == 1) {
+            output = PixelOutput::MAX;
+        }
+    }
+    ppu.set_output(output);
+}
+
+bool Machine::run_frames(u32 count, u8 joypad_mask, FrameReduce reduce) {
+    joypad.set_buttons(joypad_mask);
+
+    bool ok = true;
+    for (u32 remaining = count; remaining > 0 && ok; remaining--) {
+        select_output(remaining, reduce);
+        ok = run_frames(1);
+    }
+
+    ppu.set_output(PixelOutput::WRITE);
+    return ok;
+}
+
+bool Machine::run_frames(u32 count) {
+    u32 target = ppu.current_frame + count;
+
+    while (ppu.current_frame != target) {
+        if (!step()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,338 @@
+#include "mapper.hpp"
+#include "cpu.hpp"
+#include <algorithm>
+#include <new>
+
+// CPU clock in T-cycles per second, used to derive the MBC3 clock
+constexpr u64 CYCLES_PER_SECOND = 4194304;
+constexpr u64 SECONDS_PER_DAY = 86400;
+
+// ===== MAPPER BASE =====
+
+Mapper::Mapper(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : rom_bank0(rom), rom_bankx(rom + 0x4000), ram_bank(nullptr), ram_bank_index(0),
+      ram_mask(0x1FFF), ram_direct_write(true), rom(rom), rom_bank_count(rom_size / 0x4000),
+      ram_banks(ram_banks), ram_bank_count(ram_bank_count), ram_enabled(false), cpu(nullptr) {
+    if (rom_bank_count < 2) {
+        rom_bank_count = 2;
+    }
+}
+
+const u8* Mapper::rom_bank_ptr(u32 bank) const {
+    return rom + (bank % rom_bank_count) * 0x4000;
+}
+
+void Mapper::select_ram(u32 bank) {
+    if (!ram_enabled || !ram_bank_count) {
+        ram_bank = nullptr;
+        return;
+    }
+    ram_bank_index = bank % ram_bank_count;
+    ram_bank = ram_banks[ram_bank_index];
+}
+
+u8 Mapper::read_ram(u16 address) {
+    if (!ram_bank) {
+        return 0xFF;
+    }
+    u16 offset = (address - 0xA000) & ram_mask;
+    return ram_bank[offset >> 8][offset & 0xFF];
+}
+
+// The cartridge makes the page private before calling this
+void Mapper::write_ram(u16 address, u8 value) {
+    if (!ram_bank) {
+        return;
+    }
+    u16 offset = (address - 0xA000) & ram_mask;
+    ram_bank[offset >> 8][offset & 0xFF] = value;
+}
+
+void Mapper::rebind(Pages* banks) {
+    ram_banks = banks;
+    if (ram_bank) {
+        ram_bank = ram_banks[ram_bank_index];
+    }
+}
+
+// ===== NO MBC =====
+
+NoMBC::NoMBC(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : Mapper(rom, rom_size, ram_banks, ram_bank_count) {
+    ram_enabled = true;
+    select_ram(0);
+}
+
+void NoMBC::write(u16 /*address*/, u8 /*value*/) {
+    // No control registers
+}
+
+Mapper* NoMBC::clone(void* storage) const {
+    return new (storage) NoMBC(*this);
+}
+
+// ===== MBC1 =====
+
+MBC1::MBC1(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : Mapper(rom, rom_size, ram_banks, ram_bank_count), bank1(1), bank2(0), banking_mode(0) {
+    update_banks();
+}
+
+void MBC1::update_banks() {
+    // bank2 extends the switchable ROM bank in both modes; mode 1 also
+    // applies it to the fixed area and uses it as the RAM bank
+    rom_bankx = rom_bank_ptr((bank2 << 5) | bank1);
+    rom_bank0 = rom_bank_ptr(banking_mode ? (bank2 << 5) : 0);
+    select_ram(banking_mode ? bank2 : 0);
+}
+
+void MBC1::write(u16 address, u8 value) {
+    if (address < 0x2000) {
+        ram_enabled = (value & 0x0F) == 0x0A;
+    }
+    else if (address < 0x4000) {
+        bank1 = value & 0x1F;
+        if (bank1 == 0) {
+            bank1 = 1;
+        }
+    }
+    else if (address < 0x6000) {
+        bank2 = value & 0x03;
+    }
+    else {
+        banking_mode = value & 0x01;
+    }
+    update_banks();
+}
+
+Mapper* MBC1::clone(void* storage) const {
+    return new (storage) MBC1(*this);
+}
+
+// ===== MBC2 =====
+
+MBC2::MBC2(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : Mapper(rom, rom_size, ram_banks, ram_bank_count) {
+    // 512 half-bytes mirrored across the whole external RAM window
+    ram_mask = 0x1FF;
+    ram_direct_write = false;
+    rom_bankx = rom_bank_ptr(1);
+}
+
+void MBC2::write(u16 address, u8 value) {
+    if (address >= 0x4000) {
+        return;
+    }
+
+    // Address bit 8 selects between RAM enable and ROM bank
+    if (address & 0x100) {
+        u8 bank = value & 0x0F;
+        rom_bankx = rom_bank_ptr(bank ? bank : 1);
+    } else {
+        ram_enabled = (value & 0x0F) == 0x0A;
+        select_ram(0);
+    }
+}
+
+void MBC2::write_ram(u16 address, u8 value) {
+    // Only the low nibble is stored, the upper one always reads back as 1s
+    Mapper::write_ram(address, value | 0xF0);
+}
+
+Mapper* MBC2::clone(void* storage) const {
+    return new (storage) MBC2(*this);
+}
+
+// ===== MBC3 =====
+
+MBC3::MBC3(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : Mapper(rom, rom_size, ram_banks, ram_bank_count), rom_bank(1), ram_select(0), latch_state(0xFF),
+      rtc_base(0), rtc_stamp(0), rtc_halted(false), rtc_carry(false) {
+    for (int i = 0; i < 5; i++) {
+        latched[i] = 0;
+    }
+    update_banks();
+}
+
+void MBC3::update_banks() {
+    rom_bankx = rom_bank_ptr(rom_bank);
+
+    if (ram_select <= 0x03) {
+        select_ram(ram_select);
+    } else {
+        // RTC registers are served by read_ram/write_ram
+        ram_bank = nullptr;
+    }
+}
+
+u64 MBC3::rtc_seconds() const {
+    if (rtc_halted || !cpu) {
+        return rtc_base;
+    }
+    return rtc_base + (cpu->get_ticks() - rtc_stamp) / CYCLES_PER_SECOND;
+}
+
+void MBC3::rtc_set_seconds(u64 seconds) {
+    rtc_base = seconds;
+    rtc_stamp = cpu ? cpu->get_ticks() : 0;
+}
+
+void MBC3::write(u16 address, u8 value) {
+    if (address < 0x2000) {
+        ram_enabled = (value & 0x0F) == 0x0A;
+    }
+    else if (address < 0x4000) {
+        rom_bank = value & 0x7F;
+        if (rom_bank == 0) {
+            rom_bank = 1;
+        }
+    }
+    else if (address < 0x6000) {
+        ram_select = value;
+    }
+    else {
+        // Writing 0 then 1 copies the running clock into the latch
+        if (latch_state == 0x00 && value == 0x01) {
+            u64 seconds = rtc_seconds();
+            u64 days = seconds / SECONDS_PER_DAY;
+
+            latched[0] = seconds % 60;
+            latched[1] = (seconds / 60) % 60;
+            latched[2] = (seconds / 3600) % 24;
+            latched[3] = days & 0xFF;
+            latched[4] = ((days >> 8) & 0x01) | (rtc_halted ? 0x40 : 0) |
+                ((rtc_carry || days >= 512) ? 0x80 : 0);
+        }
+        latch_state = value;
+    }
+    update_banks();
+}
+
+u8 MBC3::read_ram(u16 address) {
+    if (ram_select >= 0x08 && ram_select <= 0x0C) {
+        return ram_enabled ? latched[ram_select - 0x08] : 0xFF;
+    }
+    return Mapper::read_ram(address);
+}
+
+void MBC3::write_ram(u16 address, u8 value) {
+    if (ram_select < 0x08 || ram_select > 0x0C) {
+        Mapper::write_ram(address, value);
+        return;
+    }
+
+    if (!ram_enabled) {
+        return;
+    }
+
+    u64 seconds = rtc_seconds();
+    u64 days = seconds / SECONDS_PER_DAY;
+    if (days >= 512) {
+        rtc_carry = true;
+        days %= 512;
+    }
+
+    u64 s = seconds % 60;
+    u64 m = (seconds / 60) % 60;
+    u64 h = (seconds / 3600) % 24;
+
+    switch (ram_select) {
+        case 0x08: s = value % 60; break;
+        case 0x09: m = value % 60; break;
+        case 0x0A: h = value % 24; break;
+        case 0x0B: days = (days & 0x100) | value; break;
+        case 0x0C:
+            days = (days & 0xFF) | ((value & 0x01) << 8);
+            rtc_carry = value & 0x80;
+            break;
+    }
+
+    rtc_set_seconds(days * SECONDS_PER_DAY + h * 3600 + m * 60 + s);
+    latched[ram_select - 0x08] = value;
+
+    if (ram_select == 0x0C) {
+        // Halting freezes rtc_base, resuming restarts the cycle stamp
+        rtc_halted = value & 0x40;
+    }
+}
+
+Mapper* MBC3::clone(void* storage) const {
+    return new (storage) MBC3(*this);
+}
+
+// ===== MBC5 =====
+
+MBC5::MBC5(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count)
+    : Mapper(rom, rom_size, ram_banks, ram_bank_count), rom_bank(1), ram_bank_value(0) {
+    update_banks();
+}
+
+void MBC5::update_banks() {
+    rom_bankx = rom_bank_ptr(rom_bank);
+    select_ram(ram_bank_value);
+}
+
+void MBC5::write(u16 address, u8 value) {
+    if (address < 0x2000) {
+        ram_enabled = (value & 0x0F) == 0x0A;
+    }
+    else if (address < 0x3000) {
+        rom_bank = (rom_bank & 0x100) | value;
+    }
+    else if (address < 0x4000) {
+        rom_bank = (rom_bank & 0xFF) | ((value & 0x01) << 8);
+    }
+    else if (address < 0x6000) {
+        ram_bank_value = value & 0x0F;
+    }
+    update_banks();
+}
+
+Mapper* MBC5::clone(void* storage) const {
+    return new (storage) MBC5(*this);
+}
+
+// ===== FACTORY =====
+
+Mapper* create_mapper(u8 type, const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count, void* storage) {
+    switch (type) {
+        case 0x00:
+        case 0x08:
+        case 0x09:
+            return new (storage) NoMBC(rom, rom_size, ram_banks, ram_bank_count);
+        case 0x01:
+        case 0x02:
+        case 0x03:
+            return new (storage) MBC1(rom, rom_size, ram_banks, ram_bank_count);
+        case 0x05:
+        case 0x06:
+            return new (storage) MBC2(rom, rom_size, ram_banks, ram_bank_count);
+        case 0x0F:
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            return new (storage) MBC3(rom, rom_size, ram_banks, ram_bank_count);
+        case 0x19:
+        case 0x1A:
+        case 0x1B:
+        case 0x1C:
+        case 0x1D:
+        case 0x1E:
+            return new (storage) MBC5(rom, rom_size, ram_banks, ram_bank_count);
+        default:
+            return nullptr;
+    }
+}
+
+Mapper* create_plain_mapper(const u8* rom, u32 rom_size, Pages* ram_banks, u8 ram_bank_count, void* storage) {
+    return new (storage) NoMBC(rom, rom_size, ram_banks, ram_bank_count);
+}
+
+size_t mapper_storage_size() {
+    return std::max({sizeof(NoMBC), sizeof(MBC1), sizeof(MBC2), sizeof(MBC3), sizeof(MBC5)});
+}
+
+u32 mapper_ram_bank_size(u8 type) {
+    return (type == 0x05 || type == 0x06) ? 0x200 : 0x2000;
+}
@@ -0,0 +1,160 @@
+#include "observation.hpp"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OBS_SSE2 1
+#else
+#define OBS_SSE2 0
+#endif
+
+constexpr u32 PIXELS = XRES * YRES;
+
+// ===== CONFIGURATION =====
+
+bool Observation::configure(u8 enabled, u32 w, u32 h) {
+    if (!supports(enabled, w, h)) {
+        printf("Observation: resize to %ux%u is not supported\n", w, h);
+        return false;
+    }
+
+    arena.release();
+    outputs = 0;
+    width = 0;
+    height = 0;
+    gray_plane = shade_plane = resized_plane = nullptr;
+
+    if (!enabled) {
+        return true;
+    }
+
+    size_t bytes = Arena::round_up(PIXELS);
+    if (enabled & OBS_SHADE) {
+        bytes += Arena::round_up(PIXELS);
+    }
+    if (enabled & OBS_RESIZED) {
+        // A source interval of XRES / w pixels touches at most two more
+        x_taps = XRES / w + 2 < XRES ? XRES / w + 2 : XRES;
+        y_taps = YRES / h + 2 < YRES ? YRES / h + 2 : YRES;
+        bytes += Arena::round_up(w * h);
+        bytes += Arena::round_up(w * sizeof(u16)) + Arena::round_up(w * x_taps * sizeof(u16));
+        bytes += Arena::round_up(h * sizeof(u16)) + Arena::round_up(h * y_taps * sizeof(u16));
+        bytes += Arena::round_up(XRES * sizeof(u16));
+    }
+    if (!arena.reserve(bytes)) {
+        return false;
+    }
+
+    gray_plane = arena.alloc_array<u8>(PIXELS);
+    if (enabled & OBS_SHADE) {
+        shade_plane = arena.alloc_array<u8>(PIXELS);
+    }
+    if (enabled & OBS_RESIZED) {
+        width = w;
+        height = h;
+        resized_plane = arena.alloc_array<u8>(w * h);
+        x_start = arena.alloc_array<u16>(w);
+        x_weights = arena.alloc_array<u16>(w * x_taps);
+        y_start = arena.alloc_array<u16>(h);
+        y_weights = arena.alloc_array<u16>(h * y_taps);
+        row_sum = arena.alloc_array<u16>(XRES);
+        make_taps(XRES, w, x_taps, x_start, x_weights);
+        make_taps(YRES, h, y_taps, y_start, y_weights);
+    }
+
+    outputs = enabled;
+    return true;
+}
+
+// Output pixel i covers [i * src, (i + 1) * src) and source pixel j covers
+// [j * dst, (j + 1) * dst), both in units of 1/dst source pixels. Weights
+// are the overlaps scaled to 256, rounded on the running total so that
+// every output pixel's weights sum to exactly 256. Every output pixel gets
+// the same number of taps, the window is shifted left at the far edge and
+// taps outside the area weigh 0, so the filter loops have fixed lengths.
+void Observation::make_taps(u32 src, u32 dst, u32 taps, u16* start, u16* weights) {
+    for (u32 i = 0; i < dst; i++) {
+        u32 lo = i * src;
+        u32 hi = lo + src;
+        u32 first = lo / dst < src - taps ? lo / dst : src - taps;
+        start[i] = static_cast<u16>(first);
+
+        u32 covered = 0;
+        u32 assigned = 0;
+        for (u32 t = 0; t < taps; t++) {
+            u32 j = first + t;
+            u32 a = lo > j * dst ? lo : j * dst;
+            u32 b = hi < (j + 1) * dst ? hi : (j + 1) * dst;
+            covered += b > a ? b - a : 0;
+
+            u32 total = (covered * 256 + src / 2) / src;
+            weights[i * taps + t] = static_cast<u16>(total - assigned);
+            assigned = total;
+        }
+    }
+}
+
+// ===== CAPTURE =====
+
+// Luma (77 R + 150 G + 29 B) / 256 of DMG_COLORS
+constexpr u8 SHADE_LUMA[4] = {255, 170, 85, 0};
+constexpr u8 SHADE_INDEX[4] = {0, 1, 2, 3};
+
+void Observation::capture(const u8* frame) {
+    if (!outputs) {
+        return;
+    }
+
+    frame_to_bytes(frame, SHADE_LUMA, gray_plane);
+    if (shade_plane) {
+        frame_to_bytes(frame, SHADE_INDEX, shade_plane);
+    }
+    if (resized_plane) {
+        resize();
+    }
+}
+
+// Vertical pass into row_sum, then the horizontal pass. Both weight sets
+// sum to 256, so a column sum is at most 255 * 256 and fits 16 bits, and
+// the result is >> 16
+void Observation::resize() {
+    for (u32 y = 0; y < height; y++) {
+        const u16* wy = y_weights + y * y_taps;
+        const u8* rows = gray_plane + y_start[y] * XRES;
+
+        u32 x = 0;
+#if OBS_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= XRES; x += 16) {
+            __m128i lo = zero;
+            __m128i hi = zero;
+            for (u32 t = 0; t < y_taps; t++) {
+                __m128i w = _mm_set1_epi16(static_cast<short>(wy[t]));
+                __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + t * XRES + x));
+                lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), w));
+                hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), w));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row_sum + x), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row_sum + x + 8), hi);
+        }
+#endif
+        for (; x < XRES; x++) {
+            u32 sum = 0;
+            for (u32 t = 0; t < y_taps; t++) {
+                sum += rows[t * XRES + x] * wy[t];
+            }
+            row_sum[x] = static_cast<u16>(sum);
+        }
+
+        u8* out = resized_plane + y * width;
+        for (x = 0; x < width; x++) {
+            const u16* wx = x_weights + x * x_taps;
+            const u16* sums = row_sum + x_start[x];
+            u32 acc = 1 << 15;
+            for (u32 t = 0; t < x_taps; t++) {
+                acc += sums[t] * wx[t];
+            }
+            out[x] = static_cast<u8>(acc >> 16);
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#include "pages.hpp"
+#include <cstring>
+#include <new>
+
+/**
+ * @brief One allocation holding count pages: this header, the Page records,
+ * then the page data
+ */
+struct alignas(16) PageStore::Block {
+    std::atomic<u32> live;  // pages of this block still referenced
+    u32 count;
+
+    Page* records() { return reinterpret_cast<Page*>(this + 1); }
+    u8* bytes() { return reinterpret_cast<u8*>(records() + count); }
+};
+
+// ===== SETUP =====
+
+PageStore::Block* PageStore::alloc_block(u32 count) {
+    size_t size = sizeof(Block) + count * (sizeof(Page) + PAGE_SIZE);
+    void* memory = ::operator new(size, std::nothrow);
+    if (!memory) {
+        printf("PageStore: out of memory for %u pages\n", count);
+        return nullptr;
+    }
+
+    Block* block = new (memory) Block();
+    block->live.store(count, std::memory_order_relaxed);
+    block->count = count;
+    for (u32 i = 0; i < count; i++) {
+        Page* page = new (block->records() + i) Page();
+        page->refs.store(1, std::memory_order_relaxed);
+        page->block = block;
+    }
+    return block;
+}
+
+bool PageStore::init(Arena& arena, u32 slot_count) {
+    release();
+
+    data = arena.alloc_array<u8*>(slot_count);
+    pages = arena.alloc_array<Page*>(slot_count);
+    Block* block = alloc_block(slot_count);
+    if (!data || !pages || !block) {
+        return false;
+    }
+
+    memset(block->bytes(), 0, slot_count * PAGE_SIZE);
+    for (u32 i = 0; i < slot_count; i++) {
+        pages[i] = block->records() + i;
+        data[i] = block->bytes() + i * PAGE_SIZE;
+    }
+    count = slot_count;
+    return true;
+}
+
+bool PageStore::share(Arena& arena, const PageStore& parent) {
+    release();
+
+    data = arena.alloc_array<u8*>(parent.count);
+    pages = arena.alloc_array<Page*>(parent.count);
+    if (!data || !pages) {
+        return false;
+    }
+
+    for (u32 i = 0; i < parent.count; i++) {
+        parent.pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+        pages[i] = parent.pages[i];
+        data[i] = parent.data[i];
+    }
+    count = parent.count;
+    return true;
+}
+
+// The slot tables stay in the arena, only the references are dropped
+void PageStore::release() {
+    for (u32 i = 0; i < count; i++) {
+        drop(pages[i]);
+    }
+    count = 0;
+}
+
+void PageStore::drop(Page* page) {
+    if (page->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    Block* block = page->block;
+    if (block->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        block->~Block();
+        ::operator delete(block);
+    }
+}
+
+// ===== COPY ON WRITE =====
+
+u8* PageStore::unshare(u32 slot) {
+    Block* block = alloc_block(1);
+    if (!block) {
+        return nullptr;
+    }
+
+    // Nobody writes a shared page, so it can be read while others hold it
+    memcpy(block->bytes(), data[slot], PAGE_SIZE);
+    drop(pages[slot]);
+    pages[slot] = block->records();
+    data[slot] = block->bytes();
+    return data[slot];
+}
+
+u8* PageStore::contiguous(u32 first, u32 slot_count) const {
+    for (u32 i = 0; i < slot_count; i++) {
+        if (shared(first + i) || data[first + i] != data[first] + i * PAGE_SIZE) {
+            return nullptr;
+        }
+    }
+    return data[first];
+}
+
+// ===== STATISTICS =====
+
+u32 PageStore::shared_count() const {
+    u32 result = 0;
+    for (u32 i = 0; i < count; i++) {
+        result += shared(i) ? 1 : 0;
+    }
+    return result;
+}
+
+size_t PageStore::amortized_bytes() const {
+    size_t result = 0;
+    for (u32 i = 0; i < count; i++) {
+        result += (PAGE_SIZE + sizeof(Page)) / pages[i]->refs.load(std::memory_order_relaxed);
+    }
+    return result;
+}
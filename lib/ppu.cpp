@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // ===== CONSTRUCTORS & DESTRUCTORS =====
 
@@ -16,17 +17,17 @@ PPU::~PPU() {
 
 // ===== INITIALIZATION =====
 
-void PPU::init() {
+void PPU::init(Arena& arena, bool with_frame_buffer) {
     // Initialize PPU registers and state
     current_frame = 0;
     line_ticks = 0;
-    video_buffer = static_cast<u32*>(malloc(YRES * XRES * sizeof(u32)));
+    frame_buffer = with_frame_buffer ? arena.alloc_array<u8>(FRAME_BYTES) : nullptr;
+    set_output(PixelOutput::WRITE);
 
     pf.line_x = 0;
     pf.pushed_x = 0;
     pf.fetch_x = 0;
-    pf.pixel_fifo.head = nullptr;
-    pf.pixel_fifo.tail = nullptr;
+    pf.pixel_fifo.head = 0;
     pf.pixel_fifo.size = 0;
     pf.cur_fetch_state = FS_TILE;
 
@@ -43,12 +44,38 @@ void PPU::init() {
         oam[i] = {0, 0, 0, 0};
     }
     memset(oam, 0, sizeof(oam));
-    memset(video_buffer, 0, YRES * XRES * sizeof(u32));
+    if (frame_buffer) {
+        memset(frame_buffer, 0, FRAME_BYTES);
+    }
 
     ppu_sm.set_ppu(this);
     ppu_sm.set_cpu(cpu);
 }
 
+void PPU::fork_from(const PPU& parent, Arena& arena, PageStore& pages) {
+    u8* frame = parent.frame_buffer ? arena.alloc_array<u8>(FRAME_BYTES) : nullptr;
+
+    *this = parent;
+    set_pages(&pages);
+    frame_buffer = frame;
+    if (frame_buffer) {
+        memcpy(frame_buffer, parent.frame_buffer, FRAME_BYTES);
+    }
+    observation = nullptr;
+    hash = nullptr;
+
+    // The line sprite list links entries of line_entry_array
+    auto relocate = [&](const oam_line_entry* entry) -> oam_line_entry* {
+        return entry ? line_entry_array + (entry - parent.line_entry_array) : nullptr;
+    };
+    line_sprites = relocate(parent.line_sprites);
+    for (int i = 0; i < 10; i++) {
+        line_entry_array[i].next = relocate(parent.line_entry_array[i].next);
+    }
+
+    ppu_sm.set_ppu(this);
+}
+
 // ===== MAIN EXECUTION =====
 
 void PPU::tick() {
@@ -4,38 +4,27 @@
 
 // ===== PIXEL FIFO OPERATIONS =====
 
-void PPU::pixel_fifo_push(u32 value) {
-    fifo_entry* entry = new fifo_entry;
-    entry->value = value;
-    entry->next = nullptr;
-
-    if (pf.pixel_fifo.head == nullptr) {
-        pf.pixel_fifo.head = pf.pixel_fifo.tail = entry;
-    } else {
-        pf.pixel_fifo.tail->next = entry;
-        pf.pixel_fifo.tail = entry;
-    }
-    pf.pixel_fifo.size++;
+void PPU::pixel_fifo_push(u8 shade) {
+    fifo& q = pf.pixel_fifo;
+    q.data[(q.head + q.size) % FIFO_CAPACITY] = shade;
+    q.size++;
 }
 
-u32 PPU::pixel_fifo_pop() {
+u8 PPU::pixel_fifo_pop() {
     if (pf.pixel_fifo.size <= 0) {
         fprintf(stderr, "ERR IN PIXEL FIFO!\n");
         exit(-8);
     }
-    fifo_entry* popped = pf.pixel_fifo.head;
-    u32 value = popped->value;
-    pf.pixel_fifo.head = popped->next;
-    delete popped;
-    pf.pixel_fifo.size--;
+    fifo& q = pf.pixel_fifo;
+    u8 value = q.data[q.head];
+    q.head = (q.head + 1) % FIFO_CAPACITY;
+    q.size--;
     return value;
 }
 
 void PPU::pipeline_fifo_reset() {
-    while (pf.pixel_fifo.size > 0) {
-        pixel_fifo_pop();
-    }
-    pf.pixel_fifo.head = nullptr;
+    pf.pixel_fifo.head = 0;
+    pf.pixel_fifo.size = 0;
 }
 
 bool PPU::pipeline_fifo_add() {
@@ -46,21 +35,30 @@ bool PPU::pipeline_fifo_add() {
 
     int x = pf.fetch_x - (8 - (lcd->scroll_x % 8));
 
+    // Same occupancy as below, without computing shades nobody will see
+    if (output == PixelOutput::SKIP) {
+        if (x >= 0) {
+            pf.pixel_fifo.size += 8;
+            pf.fifo_x += 8;
+        }
+        return true;
+    }
+
     for (int i=0; i<8; i++) {
         int bit = 7 - i;
         u8 hi = !!(pf.bgw_fetch_data[1] & (1 << bit));
         u8 lo = !!(pf.bgw_fetch_data[2] & (1 << bit)) << 1;
-        u32 color = lcd->bg_colors[hi | lo];
+        u8 shade = lcd->bg_shades[hi | lo];
 
         if (!lcd->lcdc_bgw_enable()) {
-            color = lcd->bg_colors[0];
+            shade = lcd->bg_shades[0];
         }
 
         if (lcd->lcdc_obj_enable()) {
-            color = fetch_sprite_pixels(bit, color, hi | lo);
+            shade = fetch_sprite_pixels(bit, shade, hi | lo);
         }
         if (x >= 0) {
-            pixel_fifo_push(color);
+            pixel_fifo_push(shade);
             pf.fifo_x++;
         }
     }
@@ -0,0 +1,49 @@
+#include "ppu.hpp"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAME_SSE2 1
+#else
+#define FRAME_SSE2 0
+#endif
+
+// ===== FRAME CONVERSION =====
+
+// A packed byte is four pixels, so both conversions go through a table
+// indexed by the byte: 256 entries of four outputs, built from the mapping
+// on every call. For ARGB that is one 16 byte load and store per four
+// pixels, with no per pixel shifting or masking.
+
+void frame_to_argb(const u8* frame, const u32 palette[4], u32* argb) {
+    alignas(16) u32 table[256][4];
+    for (u32 v = 0; v < 256; v++) {
+        for (u32 p = 0; p < 4; p++) {
+            table[v][p] = palette[(v >> (p * 2)) & 0b11];
+        }
+    }
+
+    for (u32 i = 0; i < FRAME_BYTES; i++) {
+#if FRAME_SSE2
+        __m128i px = _mm_load_si128(reinterpret_cast<const __m128i*>(table[frame[i]]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(argb + i * 4), px);
+#else
+        memcpy(argb + i * 4, table[frame[i]], sizeof(table[0]));
+#endif
+    }
+}
+
+void frame_to_bytes(const u8* frame, const u8 values[4], u8* out) {
+    u32 table[256];
+    for (u32 v = 0; v < 256; v++) {
+        u8 bytes[4];
+        for (u32 p = 0; p < 4; p++) {
+            bytes[p] = values[(v >> (p * 2)) & 0b11];
+        }
+        memcpy(&table[v], bytes, sizeof(bytes));
+    }
+
+    for (u32 i = 0; i < FRAME_BYTES; i++) {
+        memcpy(out + i * 4, &table[frame[i]], sizeof(table[0]));
+    }
+}
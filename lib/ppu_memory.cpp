@@ -9,6 +9,9 @@ void PPU::oam_write(u16 address, u8 value) {
     }
     // Convert oam to a byte array for direct access
     u8* oam_bytes = reinterpret_cast<u8*>(oam);
+    if (hash) {
+        hash->update(OAM_LOCATION + address, oam_bytes[address], value);
+    }
     oam_bytes[address] = value;
 }
 
@@ -24,11 +27,20 @@ u8 PPU::oam_read(u16 address) {
 // ===== VRAM OPERATIONS =====
 
 void PPU::vram_write(u16 address, u8 value) {
-    vram[address - 0x8000] = value;
+    u16 offset = address - 0x8000;
+    u8* page = store->writable(VRAM_PAGE + (offset >> 8));
+    if (!page) {
+        return;
+    }
+    if (hash) {
+        hash->update(VRAM_PAGE * PAGE_SIZE + offset, page[offset & 0xFF], value);
+    }
+    page[offset & 0xFF] = value;
 }
 
 u8 PPU::vram_read(u16 address) {
-    return vram[address - 0x8000];
+    u16 offset = address - 0x8000;
+    return vram[offset >> 8][offset & 0xFF];
 }
 
 // ===== LCD OPERATIONS =====
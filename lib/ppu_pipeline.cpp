@@ -17,10 +17,18 @@ void PPU::pipeline_process() {
 
 void PPU::pipeline_push_pixel() {
     if (pf.pixel_fifo.size > 8) {
-        u32 pixel_data = pixel_fifo_pop();
+        u8 shade = pixel_fifo_pop();
 
         if (pf.line_x >= (lcd->scroll_x % 8)) {
-            video_buffer[pf.pushed_x + (lcd->ly * XRES)] = pixel_data;
+            if (output != PixelOutput::SKIP) {
+                u8* dst = &frame_buffer[lcd->ly * FRAME_STRIDE + pf.pushed_x / 4];
+                u32 shift = (pf.pushed_x % 4) * 2;
+                u8 old = (*dst >> shift) & 0b11;
+                // Lower shades are lighter, so MAX keeps the smaller one
+                if (output == PixelOutput::WRITE || shade < old) {
+                    *dst = static_cast<u8>((*dst & ~(0b11 << shift)) | (shade << shift));
+                }
+            }
             pf.pushed_x++;
         }
         pf.line_x++;
@@ -34,8 +42,15 @@ void PPU::pipeline_fetch() {
         case FS_TILE: {
             fetched_entry_count = 0;
 
+            // Nothing below affects timing, only the colors
+            if (output == PixelOutput::SKIP) {
+                pf.cur_fetch_state = FS_DATA0;
+                pf.fetch_x += 8;
+                break;
+            }
+
             if (lcd->lcdc_bgw_enable()) {
-                pf.bgw_fetch_data[0] = bus->read(lcd->lcdc_bg_map_area() + 
+                pf.bgw_fetch_data[0] = vram_read(lcd->lcdc_bg_map_area() + 
                     (pf.map_x / 8) + 
                     (((pf.map_y / 8)) * 32));
             
@@ -54,7 +69,12 @@ void PPU::pipeline_fetch() {
         } break;
 
         case FS_DATA0: {
-            pf.bgw_fetch_data[1] = bus->read(lcd->lcdc_bgw_data_area() +
+            if (output == PixelOutput::SKIP) {
+                pf.cur_fetch_state = FS_DATA1;
+                break;
+            }
+
+            pf.bgw_fetch_data[1] = vram_read(lcd->lcdc_bgw_data_area() +
                 (pf.bgw_fetch_data[0] * 16) + 
                 pf.tile_y);
             
@@ -64,7 +84,12 @@ void PPU::pipeline_fetch() {
         } break;
 
         case FS_DATA1: {
-            pf.bgw_fetch_data[2] = bus->read(lcd->lcdc_bgw_data_area() +
+            if (output == PixelOutput::SKIP) {
+                pf.cur_fetch_state = FS_IDLE;
+                break;
+            }
+
+            pf.bgw_fetch_data[2] = vram_read(lcd->lcdc_bgw_data_area() +
                 (pf.bgw_fetch_data[0] * 16) + 
                 pf.tile_y + 1);
 
@@ -101,7 +126,7 @@ void PPU::pipeline_load_window_tile() {
         if (lcd->ly >= window_y && lcd->ly < window_y + XRES) {
             u8 w_tile_y = window_line / 8;
 
-            pf.bgw_fetch_data[0] = bus->read(lcd->lcdc_win_map_area() + 
+            pf.bgw_fetch_data[0] = vram_read(lcd->lcdc_win_map_area() + 
                 ((pf.fetch_x + 7 - lcd->win_x) / 8) +
                 (w_tile_y * 32));
 
@@ -1,9 +1,17 @@
 #include "common.hpp"
-#include "SDL.h"
 #include "ppu_sm.hpp"
 #include "ppu.hpp"
 #include "cpu.hpp"
 #include "cart.hpp"
+#include "observation.hpp"
+#include <chrono>
+#include <thread>
+
+// Milliseconds on a monotonic clock; the throttle state lives in each PPU_SM
+static u32 ticks_ms() {
+    using namespace std::chrono;
+    return static_cast<u32>(duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+}
 
 // ===== LINE INCREMENT =====
 
@@ -85,12 +93,16 @@ void PPU_SM::mode_hblank() {
 
             ppu->current_frame++;
 
+            if (ppu->observation && ppu->output != PixelOutput::SKIP) {
+                ppu->observation->capture(ppu->frame_buffer);
+            }
+
             //calc FPS...
-            u32 end = SDL_GetTicks();
+            u32 end = ticks_ms();
             u32 frame_time = end - prev_frame_time;
 
-            if (frame_time < target_frame_time) {
-                delay((target_frame_time - frame_time));
+            if (throttle && frame_time < target_frame_time) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(target_frame_time - frame_time));
             }
 
             if (end - start_timer >= 1000) {
@@ -98,7 +110,9 @@ void PPU_SM::mode_hblank() {
                 start_timer = end;
                 frame_count = 0;
 
-                printf("FPS: %d\n", fps);
+                if (throttle) {
+                    printf("FPS: %d\n", fps);
+                }
 
                 if (ppu->cart->get_need_save()) {
                     ppu->cart->battery_save();
@@ -106,7 +120,7 @@ void PPU_SM::mode_hblank() {
             }
 
             frame_count++;
-            prev_frame_time = SDL_GetTicks();
+            prev_frame_time = ticks_ms();
 
         } else {
             ppu->lcd->lcds_mode_set(MODE_OAM);
@@ -1,4 +1,6 @@
 #include "ppu.hpp"
+#include "cpu.hpp"
+#include "dma.hpp"
 #include <cstdio>
 #include <cstring>
 
@@ -41,13 +43,13 @@ void PPU::pipeline_load_sprite_data(u8 offset) {
         }
 
         pf.fetch_entry_data[(i * 2) + offset] = 
-            bus->read(0x8000 + (tile_index * 16) + ty + offset);
+            vram_read(0x8000 + (tile_index * 16) + ty + offset);
     }
 }
 
 // ===== SPRITE PIXEL FETCHING =====
 
-u32 PPU::fetch_sprite_pixels(u8 bit, u32 color, u8 bg_color) {
+u8 PPU::fetch_sprite_pixels(u8 bit, u8 shade, u8 bg_color) {
     for (int i = 0; i < fetched_entry_count; i++) {
         int sp_x = (fetched_entries[i].x - 8) + ((lcd->scroll_x % 8));
         
@@ -80,8 +82,8 @@ u32 PPU::fetch_sprite_pixels(u8 bit, u32 color, u8 bg_color) {
         }
 
         if (!bg_priority || bg_color == 0) {
-            color = (fetched_entries[i].f_pn) ? 
-                lcd->sp2_colors[hi|lo] : lcd->sp1_colors[hi|lo];
+            shade = (fetched_entries[i].f_pn) ? 
+                lcd->sp2_shades[hi|lo] : lcd->sp1_shades[hi|lo];
 
             if (hi|lo) {
                 break;
@@ -89,7 +91,7 @@ u32 PPU::fetch_sprite_pixels(u8 bit, u32 color, u8 bg_color) {
         }
     }
 
-    return color;
+    return shade;
 }
 
 // ===== SPRITE LINE LOADING =====
@@ -100,6 +102,9 @@ void PPU_SM::load_line_sprites() {
     u8 sprite_height = ppu->lcd->lcdc_obj_height();
     memset(ppu->line_entry_array, 0, sizeof(ppu->line_entry_array));
 
+    // Bring OAM up to date with a transfer that may still be running
+    ppu->dma->sync(ppu->cpu->get_ticks());
+
     for (int i = 0; i < 40; i++) {
         oam_entry e = ppu->oam[i];
         if (!e.x) {
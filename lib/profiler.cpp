@@ -0,0 +1,159 @@
+#include "profiler.hpp"
+#include "cart.hpp"
+#include <algorithm>
+#include <cstring>
+
+// ===== SETUP =====
+
+// Allocates nothing, every machine has one whether or not it profiles
+Profiler::Profiler() : cart(nullptr), period(DEFAULT_PERIOD), next_sample(0), samples(0) {
+}
+
+void Profiler::reset() {
+    next_sample = 0;
+    samples = 0;
+    frames.clear();
+    stacks.clear();
+
+    // Sampling itself should not grow these
+    frames.reserve(MAX_DEPTH);
+    key.reserve(MAX_DEPTH + 1);
+}
+
+bool Profiler::load_symbols(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        printf("Failed to open symbol file: %s\n", path);
+        return false;
+    }
+
+    // RGBDS format, one "BB:AAAA Name" per line, ';' starts a comment
+    char line[512];
+    symbols.clear();
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned bank;
+        unsigned address;
+        char label[256];
+        if (line[0] == ';' || sscanf(line, "%x:%x %255s", &bank, &address, label) != 3) {
+            continue;
+        }
+        symbols.push_back({(bank & 0xFF) << 16 | (address & 0xFFFF), label});
+    }
+    fclose(fp);
+
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [](const Symbol& a, const Symbol& b) { return a.address < b.address; });
+    printf("Profiler: %zu symbols loaded from %s\n", symbols.size(), path);
+    return true;
+}
+
+// ===== CPU EVENTS =====
+
+void Profiler::on_call(u16 target, u16 sp) {
+    push(qualify(target), sp);
+}
+
+void Profiler::on_interrupt(u16 vector, u16 sp) {
+    push(INTERRUPT_FRAME | vector, sp);
+}
+
+void Profiler::push(u32 address, u16 sp) {
+    // Frames whose return slot is at or above the new one are dead
+    unwind(static_cast<u32>(sp) + 1);
+
+    if (frames.size() == MAX_DEPTH) {
+        frames.erase(frames.begin());
+    }
+    frames.push_back({address, sp});
+}
+
+// Drops frames whose return address lies below sp, i.e. has been popped
+void Profiler::unwind(u32 sp) {
+    while (!frames.empty() && frames.back().sp < sp) {
+        frames.pop_back();
+    }
+}
+
+void Profiler::record(u16 pc, u16 sp) {
+    unwind(sp);
+
+    key.clear();
+    for (const Frame& frame : frames) {
+        key.push_back(frame.address);
+    }
+    key.push_back(qualify(pc));
+
+    stacks[key]++;
+    samples++;
+}
+
+// ===== ADDRESS RESOLUTION =====
+
+// Memory region of an address, so a label never spans e.g. ROM and HRAM
+static int region(u32 address) {
+    static const u8 REGIONS[16] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6};
+    return REGIONS[(address >> 12) & 0x0F];
+}
+
+u32 Profiler::qualify(u16 address) const {
+    u32 bank = 0;
+    if (address >= 0x4000 && address < 0x8000) {
+        bank = cart ? cart->get_rom_bank() : 1;
+    } else if (address >= 0xD000 && address < 0xE000) {
+        bank = 1;
+    }
+    return (bank & 0xFF) << 16 | address;
+}
+
+std::string Profiler::name(u32 address) const {
+    std::string prefix = address & INTERRUPT_FRAME ? "irq@" : "";
+    address &= ~INTERRUPT_FRAME;
+
+    // Nearest symbol at or below the address in the same bank and region
+    auto it = std::upper_bound(symbols.begin(), symbols.end(), address,
+                               [](u32 a, const Symbol& s) { return a < s.address; });
+    if (it != symbols.begin()) {
+        u32 symbol = (it - 1)->address;
+        if ((symbol >> 16) == (address >> 16) && region(symbol) == region(address)) {
+            return prefix + (it - 1)->name;
+        }
+    }
+
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%02X:%04X", address >> 16, address & 0xFFFF);
+    return prefix + buffer;
+}
+
+// ===== OUTPUT =====
+
+bool Profiler::write_folded(const char* path) const {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+
+    // Stacks that differ only below symbol granularity are merged here
+    std::map<std::string, u64> folded;
+    for (const auto& entry : stacks) {
+        std::string line;
+        for (size_t i = 0; i < entry.first.size(); i++) {
+            if (i) {
+                line += ';';
+            }
+            line += name(entry.first[i]);
+        }
+        folded[line] += entry.second;
+    }
+
+    for (const auto& entry : folded) {
+        fprintf(fp, "%s %llu\n", entry.first.c_str(), (unsigned long long)entry.second);
+    }
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+    if (ok) {
+        printf("Profiler: %llu samples written to %s\n", (unsigned long long)samples, path);
+    }
+    return ok;
+}
@@ -2,16 +2,28 @@
 
 
 u8 RAM::read_wram(u16 address){
-    return wram[address - 0xC000];
+    u16 offset = address - 0xC000;
+    return wram[offset >> 8][offset & 0xFF];
 }
 
 u8 RAM::read_hram(u16 address){
     return hram[address - 0xFF80];
 }
 void RAM::write_wram(u16 address, u8 value){
-    wram[address - 0xC000] = value;
+    u16 offset = address - 0xC000;
+    u8* page = store->writable(WRAM_PAGE + (offset >> 8));
+    if (!page) {
+        return;
+    }
+    if (hash) {
+        hash->update(WRAM_PAGE * PAGE_SIZE + offset, page[offset & 0xFF], value);
+    }
+    page[offset & 0xFF] = value;
 }
 
 void RAM::write_hram(u16 address, u8 value){
+    if (hash) {
+        hash->update(HRAM_LOCATION + address - 0xFF80, hram[address - 0xFF80], value);
+    }
     hram[address - 0xFF80] = value;
 }
\ No newline at end of file
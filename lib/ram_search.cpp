@@ -0,0 +1,241 @@
+#include "ram_search.hpp"
+#include "machine.hpp"
+#include <bitset>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SEARCH_SSE2 1
+#else
+#define SEARCH_SSE2 0
+#endif
+
+// ===== HELPERS =====
+
+static u32 popcount(u64 bits) {
+    return static_cast<u32>(std::bitset<64>(bits).count());
+}
+
+static void add_range(u64* bits, u32 first, u32 count) {
+    for (u32 address = first; address < first + count; address++) {
+        bits[address >> 6] |= 1ull << (address & 63);
+    }
+}
+
+// One bit per byte, bit i set when lhs[i] OP rhs[i] + bias
+template <SearchCompare OP>
+static u32 compare16(const u8* lhs, const u8* rhs, u8 bias) {
+#if SEARCH_SSE2
+    __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(lhs));
+    __m128i b = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs)),
+                             _mm_set1_epi8(static_cast<char>(bias)));
+
+    // SSE2 only compares signed bytes for order, so unsigned a >= b is
+    // max(a, b) == a and a <= b is min(a, b) == a; the strict and not
+    // equal tests are the complements
+    __m128i pass;
+    if (OP == SearchCompare::EQUAL || OP == SearchCompare::NOT_EQUAL) {
+        pass = _mm_cmpeq_epi8(a, b);
+    } else if (OP == SearchCompare::LESS || OP == SearchCompare::GREATER_EQUAL) {
+        pass = _mm_cmpeq_epi8(_mm_max_epu8(a, b), a);
+    } else {
+        pass = _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+    }
+    u32 bits = static_cast<u32>(_mm_movemask_epi8(pass));
+    bool inverted = OP == SearchCompare::NOT_EQUAL || OP == SearchCompare::LESS || OP == SearchCompare::GREATER;
+    return inverted ? bits ^ 0xFFFF : bits;
+#else
+    u32 bits = 0;
+    for (u32 i = 0; i < 16; i++) {
+        u8 a = lhs[i];
+        u8 b = static_cast<u8>(rhs[i] + bias);
+        bool pass;
+        switch (OP) {
+            case SearchCompare::EQUAL:         pass = a == b; break;
+            case SearchCompare::NOT_EQUAL:     pass = a != b; break;
+            case SearchCompare::LESS:          pass = a < b; break;
+            case SearchCompare::GREATER:       pass = a > b; break;
+            case SearchCompare::LESS_EQUAL:    pass = a <= b; break;
+            default:                           pass = a >= b; break;
+        }
+        bits |= static_cast<u32>(pass) << i;
+    }
+    return bits;
+#endif
+}
+
+// Compares the 64 addresses of each word that still has candidates with
+// operand plus bias; operand advances with the addresses by step, 0 for a
+// constant
+template <SearchCompare OP>
+static u32 narrow_words(u64* candidates, const u8* current, const u8* operand, u32 step, u8 bias) {
+    u32 remaining = 0;
+    for (u32 word = 0; word < RamSearch::WORDS; word++) {
+        u64 bits = candidates[word];
+        if (!bits) {
+            continue;
+        }
+
+        u32 base = word * 64;
+        u64 pass = 0;
+        for (u32 i = 0; i < 64; i += 16) {
+            pass |= static_cast<u64>(compare16<OP>(current + base + i, operand + (base + i) * step, bias)) << i;
+        }
+        bits &= pass;
+        candidates[word] = bits;
+        remaining += popcount(bits);
+    }
+    return remaining;
+}
+
+// ===== SEARCH =====
+
+void RamSearch::start(Machine& machine, u8 search_regions) {
+    regions = search_regions;
+    capture(machine);
+    memcpy(previous, current, SPACE);
+
+    memset(candidates, 0, sizeof(candidates));
+    if (regions & SEARCH_ROM) {
+        add_range(candidates, 0x0000, 0x8000);
+    }
+    if (regions & SEARCH_VRAM) {
+        add_range(candidates, 0x8000, 0x2000);
+    }
+    if (regions & SEARCH_CART_RAM) {
+        add_range(candidates, 0xA000, 0x2000);
+    }
+    if (regions & SEARCH_WRAM) {
+        add_range(candidates, 0xC000, 0x2000);
+    }
+    if (regions & SEARCH_OAM) {
+        add_range(candidates, 0xFE00, 0xA0);
+    }
+    if (regions & SEARCH_HRAM) {
+        add_range(candidates, 0xFF80, 0x7F);
+    }
+}
+
+void RamSearch::snapshot(Machine& machine) {
+    u8* swap = previous;
+    previous = current;
+    current = swap;
+    capture(machine);
+}
+
+// Straight from the backing memory, so nothing is blocked by the PPU or a
+// DMA and no register is read
+void RamSearch::capture(Machine& machine) {
+    auto cartridge_pages = [&](u8 first, u8 last) {
+        for (u32 page = first; page <= last; page++) {
+            u8* dst = current + (page << 8);
+            const u8* src = machine.cartridge.read_page(static_cast<u8>(page));
+            if (src) {
+                memcpy(dst, src, PAGE_SIZE);
+                continue;
+            }
+            // Disabled RAM, MBC2's nibbles or an RTC register
+            for (u32 i = 0; i < PAGE_SIZE; i++) {
+                dst[i] = machine.cartridge.read(static_cast<u16>((page << 8) | i));
+            }
+        }
+    };
+
+    if (regions & SEARCH_ROM) {
+        cartridge_pages(0x00, 0x7F);
+    }
+    if (regions & SEARCH_VRAM) {
+        for (u32 i = 0; i < 0x2000 / PAGE_SIZE; i++) {
+            memcpy(current + 0x8000 + i * PAGE_SIZE, machine.ppu.vram_page(i), PAGE_SIZE);
+        }
+    }
+    if (regions & SEARCH_CART_RAM) {
+        cartridge_pages(0xA0, 0xBF);
+    }
+    if (regions & SEARCH_WRAM) {
+        for (u32 i = 0; i < 0x2000 / PAGE_SIZE; i++) {
+            memcpy(current + 0xC000 + i * PAGE_SIZE, machine.ram.wram_page(i), PAGE_SIZE);
+        }
+    }
+    if (regions & SEARCH_OAM) {
+        memcpy(current + 0xFE00, machine.ppu.oam_data(), 0xA0);
+    }
+    if (regions & SEARCH_HRAM) {
+        memcpy(current + 0xFF80, machine.ram.hram_data(), 0x7F);
+    }
+}
+
+// ===== FILTERS =====
+
+u32 RamSearch::filter_previous(SearchCompare op) {
+    return narrow(op, previous, false, 0);
+}
+
+u32 RamSearch::filter_value(SearchCompare op, u8 value) {
+    u8 splat[16];
+    memset(splat, value, sizeof(splat));
+    return narrow(op, splat, true, 0);
+}
+
+u32 RamSearch::filter_delta(int delta) {
+    return narrow(SearchCompare::EQUAL, previous, false, static_cast<u8>(delta));
+}
+
+// One instantiation per compare, so the inner loop does not branch on it
+u32 RamSearch::narrow(SearchCompare op, const u8* operand, bool splat, u8 bias) {
+    u32 step = splat ? 0 : 1;
+    switch (op) {
+        case SearchCompare::EQUAL:
+            return narrow_words<SearchCompare::EQUAL>(candidates, current, operand, step, bias);
+        case SearchCompare::NOT_EQUAL:
+            return narrow_words<SearchCompare::NOT_EQUAL>(candidates, current, operand, step, bias);
+        case SearchCompare::LESS:
+            return narrow_words<SearchCompare::LESS>(candidates, current, operand, step, bias);
+        case SearchCompare::GREATER:
+            return narrow_words<SearchCompare::GREATER>(candidates, current, operand, step, bias);
+        case SearchCompare::LESS_EQUAL:
+            return narrow_words<SearchCompare::LESS_EQUAL>(candidates, current, operand, step, bias);
+        default:
+            return narrow_words<SearchCompare::GREATER_EQUAL>(candidates, current, operand, step, bias);
+    }
+}
+
+// ===== RESULTS =====
+
+u32 RamSearch::count() const {
+    u32 total = 0;
+    for (u32 word = 0; word < WORDS; word++) {
+        total += popcount(candidates[word]);
+    }
+    return total;
+}
+
+u32 RamSearch::results(u16* out, u32 max) const {
+    u32 total = 0;
+    for (u32 word = 0; word < WORDS; word++) {
+        u64 bits = candidates[word];
+        while (bits) {
+            if (total < max) {
+                // Index of the lowest set bit
+                out[total] = static_cast<u16>(word * 64 + popcount((bits & (~bits + 1)) - 1));
+            }
+            total++;
+            bits &= bits - 1;
+        }
+    }
+    return total;
+}
+
+void RamSearch::print(u32 limit) const {
+    u16 addresses[64];
+    limit = limit < 64 ? limit : 64;
+    u32 total = results(addresses, limit);
+    printf("RAM search: %u candidates\n", total);
+    for (u32 i = 0; i < total && i < limit; i++) {
+        u16 address = addresses[i];
+        printf("  %04X: %02X (was %02X)\n", address, current[address], previous[address]);
+    }
+    if (total > limit) {
+        printf("  ...\n");
+    }
+}
@@ -0,0 +1,158 @@
+#include "rom_image.hpp"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Carts smaller than the fixed 32 KiB ROM window are copied and padded so
+// reads anywhere in 0x0000-0x7FFF stay inside the image.
+constexpr u32 MIN_ROM_SIZE = 0x8000;
+
+static std::mutex registry_mutex;
+static std::vector<RomImage*> registry;
+
+// ===== CONSTRUCTORS & DESTRUCTORS =====
+
+RomImage::RomImage() : bytes(nullptr), length(0), map_length(0), dev(0), ino(0), refs(0) {
+}
+
+RomImage::~RomImage() {
+    if (!bytes) {
+        return;
+    }
+#ifndef _WIN32
+    if (map_length) {
+        munmap(const_cast<u8*>(bytes), map_length);
+        return;
+    }
+#endif
+    delete[] bytes;
+}
+
+// ===== LOADING =====
+
+static u8* read_padded(FILE* fp, u32 size, u32 alloc_size) {
+    u8* buffer = new u8[alloc_size];
+    memset(buffer, 0xFF, alloc_size);
+
+    if (fread(buffer, 1, size, fp) != size) {
+        delete[] buffer;
+        return nullptr;
+    }
+    return buffer;
+}
+
+// file_size comes from the stat() acquire() looked the image up with
+bool RomImage::open_file(const char* path, u64 file_size) {
+    length = static_cast<u32>(file_size);
+
+#ifndef _WIN32
+    if (length >= MIN_ROM_SIZE) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            printf("Failed to open: %s\n", path);
+            return false;
+        }
+
+        void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (map == MAP_FAILED) {
+            printf("Failed to map: %s\n", path);
+            return false;
+        }
+
+        bytes = static_cast<const u8*>(map);
+        map_length = length;
+        return true;
+    }
+#endif
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+
+    u32 alloc_size = length < MIN_ROM_SIZE ? MIN_ROM_SIZE : length;
+    bytes = read_padded(fp, length, alloc_size);
+    fclose(fp);
+
+    if (!bytes) {
+        printf("Failed to read: %s\n", path);
+        return false;
+    }
+
+    length = alloc_size;
+    return true;
+}
+
+// ===== REGISTRY =====
+
+const RomImage* RomImage::acquire(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || st.st_size <= 0) {
+        printf("Failed to stat: %s\n", path);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (RomImage* image : registry) {
+        if (image->dev == static_cast<u64>(st.st_dev) && image->ino == static_cast<u64>(st.st_ino)) {
+            image->refs++;
+            return image;
+        }
+    }
+
+    RomImage* image = new RomImage();
+    image->dev = st.st_dev;
+    image->ino = st.st_ino;
+    if (!image->open_file(path, static_cast<u64>(st.st_size))) {
+        delete image;
+        return nullptr;
+    }
+
+    image->refs = 1;
+    registry.push_back(image);
+    return image;
+}
+
+const RomImage* RomImage::retain(const RomImage* image) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (RomImage* entry : registry) {
+        if (entry == image) {
+            entry->refs++;
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+void RomImage::release(const RomImage* image) {
+    if (!image) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    for (size_t i = 0; i < registry.size(); i++) {
+        if (registry[i] != image) {
+            continue;
+        }
+
+        if (--registry[i]->refs == 0) {
+            delete registry[i];
+            registry.erase(registry.begin() + i);
+        }
+        return;
+    }
+}
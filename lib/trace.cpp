@@ -0,0 +1,129 @@
+#include "trace.hpp"
+#include "cart.hpp"
+#include "cpu.hpp"
+#include <cstring>
+
+// ===== CONSTRUCTORS & DESTRUCTORS =====
+
+Trace::Trace() : fp(nullptr), cart(nullptr), ring(nullptr), head(0), fill(0), records(0),
+                 tail(0), pending(0), stopping(false) {
+}
+
+Trace::~Trace() {
+    close();
+}
+
+// ===== LIFETIME =====
+
+bool Trace::open(const char* path) {
+    close();
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open trace file: %s\n", path);
+        return false;
+    }
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "GBTRACE", 7);
+    header.version = VERSION;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, fp);
+
+    ring = new TraceRecord[CHUNK_RECORDS * CHUNK_COUNT];
+    head = 0;
+    fill = 0;
+    records = 0;
+    tail = 0;
+    pending = 0;
+    stopping = false;
+    writer = std::thread(&Trace::run, this);
+
+    printf("Trace: writing to %s\n", path);
+    return true;
+}
+
+void Trace::close() {
+    if (!fp) {
+        return;
+    }
+
+    // The writer drains every submitted chunk before it exits
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+
+    // The partially filled head chunk is written here
+    fwrite(ring + head * CHUNK_RECORDS, sizeof(TraceRecord), fill, fp);
+    if (fclose(fp) != 0) {
+        printf("Failed to write trace file\n");
+    }
+    fp = nullptr;
+
+    delete[] ring;
+    ring = nullptr;
+    printf("Trace: %llu instructions recorded\n", (unsigned long long)records);
+}
+
+// ===== CPU THREAD INTERFACE =====
+
+void Trace::record(const Registers& regs, u64 ticks, const u8* pcmem) {
+    if (fill == CHUNK_RECORDS) {
+        submit();
+    }
+
+    TraceRecord& r = ring[head * CHUNK_RECORDS + fill++];
+    r.cycles = static_cast<u32>(ticks / 4);
+    r.pc = regs.pc;
+    r.sp = regs.sp;
+    r.a = regs.a;
+    r.f = regs.f;
+    r.b = regs.b;
+    r.c = regs.c;
+    r.d = regs.d;
+    r.e = regs.e;
+    r.h = regs.h;
+    r.l = regs.l;
+    memcpy(r.pcmem, pcmem, 4);
+    r.bank = (regs.pc >= 0x4000 && regs.pc < 0x8000 && cart) ? static_cast<u8>(cart->get_rom_bank()) : 0;
+    memset(r.reserved, 0, sizeof(r.reserved));
+    records++;
+}
+
+// Hands the full head chunk to the writer and moves on to the next one
+void Trace::submit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    pending++;
+    wake.notify_one();
+
+    space.wait(lock, [this] { return pending < CHUNK_COUNT; });
+    head = (head + 1) % CHUNK_COUNT;
+    fill = 0;
+}
+
+// ===== WRITER THREAD =====
+
+void Trace::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this] { return pending > 0 || stopping; });
+        if (pending == 0) {
+            return;
+        }
+
+        // The CPU thread never touches a pending chunk, so write unlocked
+        const TraceRecord* chunk = ring + tail * CHUNK_RECORDS;
+        lock.unlock();
+        fwrite(chunk, sizeof(TraceRecord), CHUNK_RECORDS, fp);
+        lock.lock();
+
+        tail = (tail + 1) % CHUNK_COUNT;
+        pending--;
+        space.notify_one();
+    }
+}
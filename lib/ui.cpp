@@ -6,7 +6,23 @@
 constexpr int SCREEN_WIDTH = 160 * 4;
 constexpr int SCREEN_HEIGHT = 144 * 4;
 
-UI::UI() : initialized(false), debug_enabled(DEBUG_MODE), window(nullptr), renderer(nullptr), debug_window(nullptr), debug_renderer(nullptr), debug_texture(nullptr), scale(4), bus(nullptr) {
+// Joypad button for a key, in the Joypad::set_buttons layout; 0 for other
+// keys, which set_button_state() then ignores
+static u8 button_for_key(SDL_Keycode key) {
+    switch (key) {
+        case SDLK_a:        return 0x01;  // A
+        case SDLK_s:        return 0x02;  // B
+        case SDLK_SPACE:    return 0x04;  // Select
+        case SDLK_RETURN:   return 0x08;  // Start
+        case SDLK_RIGHT:    return 0x10;
+        case SDLK_LEFT:     return 0x20;
+        case SDLK_UP:       return 0x40;
+        case SDLK_DOWN:     return 0x80;
+        default:            return 0;
+    }
+}
+
+UI::UI() : initialized(false), debug_enabled(DEBUG_MODE), profile_requested(false), trace_toggled(false), search_step(SearchStep::NONE), last_frame_time(0), window(nullptr), renderer(nullptr), debug_window(nullptr), debug_renderer(nullptr), debug_texture(nullptr), scale(4), bus(nullptr) {
 }
 
 UI::~UI() {
@@ -181,10 +197,6 @@ void UI::delay(u32 ms) {
     SDL_Delay(ms);
 }
 
-void delay(u32 ms) {
-    SDL_Delay(ms);
-}
-
 bool UI::is_initialized() const {
     return initialized;
 }
@@ -207,10 +219,35 @@ bool UI::handle_events(std::atomic<bool>& running, std::atomic<bool>& paused) {
                         paused = !paused;
                         printf("Pause toggled: %s\n", paused ? "Paused" : "Running");
                         break;
+                    case SDLK_F3:
+                        search_step = SearchStep::DECREASED;
+                        break;
+                    case SDLK_F4:
+                        search_step = SearchStep::INCREASED;
+                        break;
+                    case SDLK_F5:
+                        search_step = SearchStep::START;
+                        break;
+                    case SDLK_F6:
+                        search_step = SearchStep::UNCHANGED;
+                        break;
+                    case SDLK_F7:
+                        search_step = SearchStep::CHANGED;
+                        break;
+                    case SDLK_F8:
+                        trace_toggled = true;
+                        break;
+                    case SDLK_F9:
+#if CPU_PROFILE
+                        profile_requested = true;
+#else
+                        printf("CPU profiling not compiled in, configure with -DGBEMU_CPU_PROFILE=ON\n");
+#endif
+                        break;
                     default:
                         // Handle joypad input
                         if (joypad) {
-                            joypad->update_from_sdl_key(event.key.keysym.sym, true);
+                            joypad->set_button_state(button_for_key(event.key.keysym.sym), true);
                         }
                         break;
                 }
@@ -218,7 +255,7 @@ bool UI::handle_events(std::atomic<bool>& running, std::atomic<bool>& paused) {
             case SDL_KEYUP:
                 // Handle joypad input release
                 if (joypad) {
-                    joypad->update_from_sdl_key(event.key.keysym.sym, false);
+                    joypad->set_button_state(button_for_key(event.key.keysym.sym), false);
                 }
                 break;
         }
@@ -226,6 +263,24 @@ bool UI::handle_events(std::atomic<bool>& running, std::atomic<bool>& paused) {
     return true;
 }
 
+bool UI::take_profile_request() {
+    bool requested = profile_requested;
+    profile_requested = false;
+    return requested;
+}
+
+bool UI::take_trace_toggle() {
+    bool toggled = trace_toggled;
+    trace_toggled = false;
+    return toggled;
+}
+
+SearchStep UI::take_search_step() {
+    SearchStep step = search_step;
+    search_step = SearchStep::NONE;
+    return step;
+}
+
 void UI::render_frame() {
     if (!renderer) return;
     
@@ -239,7 +294,6 @@ void UI::render_frame() {
 }
 
 void UI::limit_frame_rate(int target_fps) {
-    static u32 last_frame_time = 0;
     const int frame_delay = 1000 / target_fps;
     
     u32 current_time = SDL_GetTicks();
@@ -259,7 +313,7 @@ void UI::update() {
     rc.w = 2048;
     rc.h = 2048;
 
-    u32* video_buffer = ppu->video_buffer;
+    frame_to_argb(ppu->frame_buffer, tile_colors, frame_argb);
 
     for (int line_num = 0; line_num < YRES; line_num++) {
         for (int x=0; x<XRES; x++) {
@@ -268,7 +322,7 @@ void UI::update() {
             rc.w = scale;
             rc.h = scale;
             
-            u32 color = video_buffer[line_num * XRES + x];
+            u32 color = frame_argb[line_num * XRES + x];
             SDL_FillRect(screen, &rc, color);
         }
     }
@@ -0,0 +1,63 @@
+#include "watch.hpp"
+#include "bus.hpp"
+#include <cstring>
+
+Watchpoints::~Watchpoints() {
+    if (bus) {
+        bus->set_watchpoints(nullptr);
+    }
+}
+
+// ===== CONFIGURATION =====
+
+void Watchpoints::add(u16 first, u16 last, u8 kinds) {
+    if (first > last || !(kinds & (WATCH_READ | WATCH_WRITE | WATCH_EXEC))) {
+        printf("Watchpoints: ignoring empty watch %04X-%04X\n", first, last);
+        return;
+    }
+    ranges.push_back({first, last, kinds});
+    update_pages();
+}
+
+void Watchpoints::remove(u16 first, u16 last, u8 kinds) {
+    for (size_t i = 0; i < ranges.size();) {
+        const Range& r = ranges[i];
+        if (r.first == first && r.last == last && r.kinds == kinds) {
+            ranges.erase(ranges.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    update_pages();
+}
+
+void Watchpoints::clear() {
+    ranges.clear();
+    update_pages();
+}
+
+void Watchpoints::update_pages() {
+    memset(pages, 0, sizeof(pages));
+    for (const Range& r : ranges) {
+        for (u32 page = r.first >> 8; page <= static_cast<u32>(r.last >> 8); page++) {
+            pages[page] |= r.kinds;
+        }
+    }
+    if (bus) {
+        bus->remap();
+    }
+}
+
+// ===== BUS INTERFACE =====
+
+void Watchpoints::check(u8 kind, u16 address, u8 value, u16 pc, u64 ticks) {
+    for (const Range& r : ranges) {
+        if ((r.kinds & kind) && address >= r.first && address <= r.last) {
+            hits++;
+            if (callback) {
+                callback({ticks, pc, address, value, kind}, user);
+            }
+            return;
+        }
+    }
+}
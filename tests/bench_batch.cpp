@@ -0,0 +1,253 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "batch.hpp"
+#include "machine.hpp"
+
+#ifndef GBEMU_ROM_DIR
+#define GBEMU_ROM_DIR "roms"
+#endif
+
+/**
+ * Batch throughput benchmark.
+ *
+ * Loads a set of machines, round-robin over the given ROMs, and runs all of
+ * them for a fixed frame budget on BatchRunner pools of 1, 2, 4, ... workers
+ * up to --max-workers. Every pool size starts from freshly loaded machines,
+ * so each one emulates the same frames, and the total cycles run must match
+ * across pool sizes or the benchmark fails. Reports aggregate emulated
+ * frames per second for each pool size, the speedup over one worker and the
+ * parallel efficiency, and the bytes each instance occupies, broken down by
+ * component.
+ *
+ *   bench_batch [--instances N] [--frames N] [--max-workers N] [--no-frame-buffer]
+ *               [--json FILE] [rom ...]
+ *
+ * --no-frame-buffer loads the machines without a frame buffer, as a host
+ * that only reads memory would.
+ *
+ * Pool sizes beyond the host's hardware threads are still measured but
+ * oversubscribe the cores, so they show scheduling cost rather than scaling.
+ */
+
+// ===== CONFIGURATION =====
+
+constexpr u32 DEFAULT_INSTANCES = 64;
+constexpr u32 DEFAULT_FRAMES = 300;
+constexpr u32 DEFAULT_MAX_WORKERS = 64;
+
+static const char* DEFAULT_ROMS[] = {
+    "cpu_instrs.gb",
+    "dmg-acid2.gb",
+    "mem_timing.gb",
+};
+
+// ===== RESULTS =====
+
+struct ScalingResult {
+    u32 workers;
+    u32 frames;
+    u64 cycles;
+    double seconds;
+    u64 steals;
+
+    double fps() const { return frames / seconds; }
+};
+
+// ===== BENCHMARK =====
+
+static bool run_batch(std::vector<Machine*>& machines, u32 workers, u32 frames, ScalingResult& result) {
+    std::vector<BatchJob> jobs(machines.size());
+    for (size_t i = 0; i < machines.size(); i++) {
+        jobs[i].machine = machines[i];
+        jobs[i].frame_budget = frames;
+    }
+
+    BatchRunner runner(workers);
+
+    auto start = std::chrono::steady_clock::now();
+    u32 ok = runner.run(jobs.data(), static_cast<u32>(jobs.size()));
+    auto end = std::chrono::steady_clock::now();
+
+    result.workers = workers;
+    result.frames = 0;
+    result.cycles = 0;
+    for (const BatchJob& job : jobs) {
+        result.frames += job.frames;
+        result.cycles += job.cycles;
+    }
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.steals = runner.get_steals();
+
+    if (ok != jobs.size()) {
+        printf("%u of %zu machines stopped early\n", static_cast<u32>(jobs.size()) - ok, jobs.size());
+    }
+    return result.frames > 0;
+}
+
+static void delete_machines(std::vector<Machine*>& machines) {
+    for (Machine* m : machines) {
+        delete m;
+    }
+    machines.clear();
+}
+
+static bool load_machines(std::vector<Machine*>& machines, const std::vector<std::string>& roms, u32 instances,
+                          bool frame_buffer) {
+    for (u32 i = 0; i < instances; i++) {
+        // Heap allocated, the machine is too large to keep on the stack
+        Machine* machine = new Machine();
+        machine->set_frame_buffer(frame_buffer);
+        if (!machine->load(roms[i % roms.size()].c_str())) {
+            delete machine;
+            delete_machines(machines);
+            return false;
+        }
+        machine->set_throttle(false);
+        machines.push_back(machine);
+    }
+    return true;
+}
+
+// ===== OUTPUT =====
+
+static void print_footprint(const std::vector<Machine*>& machines, const std::vector<std::string>& roms) {
+    // Machines differ only in cartridge storage, so show one per ROM
+    size_t total = 0;
+    for (const Machine* m : machines) {
+        total += m->footprint().total;
+    }
+
+    for (size_t i = 0; i < roms.size() && i < machines.size(); i++) {
+        Footprint f = machines[i]->footprint();
+        printf("\nPer-instance footprint, %s: %zu bytes\n", roms[i].c_str(), f.total);
+        for (u32 j = 0; j < f.count; j++) {
+            printf("%20s %8zu\n", f.items[j].name, f.items[j].bytes);
+        }
+    }
+    printf("\n%zu machines: %.1f KiB, %.0f bytes each on average\n", machines.size(), total / 1024.0,
+           static_cast<double>(total) / machines.size());
+}
+
+static bool write_json(const char* path, const std::vector<ScalingResult>& results, u32 instances, u32 frames,
+                       const Footprint& footprint) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+
+    double base = results.empty() ? 0.0 : results[0].fps();
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"instances\": %u,\n", instances);
+    fprintf(fp, "  \"frames\": %u,\n", frames);
+    fprintf(fp, "  \"hardware_threads\": %u,\n", BatchRunner::default_workers());
+    fprintf(fp, "  \"footprint\": {\"total\": %zu", footprint.total);
+    for (u32 i = 0; i < footprint.count; i++) {
+        fprintf(fp, ", \"%s\": %zu", footprint.items[i].name, footprint.items[i].bytes);
+    }
+    fprintf(fp, "},\n");
+    fprintf(fp, "  \"runs\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScalingResult& r = results[i];
+        fprintf(fp, "    {\"workers\": %u, \"seconds\": %.6f, \"fps\": %.2f, \"speedup\": %.3f, \"steals\": %llu}%s\n",
+                r.workers, r.seconds, r.fps(), base > 0.0 ? r.fps() / base : 0.0,
+                static_cast<unsigned long long>(r.steals), i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    fclose(fp);
+    return true;
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    u32 instances = DEFAULT_INSTANCES;
+    u32 frames = DEFAULT_FRAMES;
+    u32 max_workers = DEFAULT_MAX_WORKERS;
+    const char* json_path = nullptr;
+    bool frame_buffer = true;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--instances") && i + 1 < argc) {
+            instances = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--max-workers") && i + 1 < argc) {
+            max_workers = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--no-frame-buffer")) {
+            frame_buffer = false;
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            printf("Usage: bench_batch [--instances N] [--frames N] [--max-workers N] [--no-frame-buffer] "
+                   "[--json FILE] [rom ...]\n");
+            return 2;
+        } else {
+            roms.push_back(argv[i]);
+        }
+    }
+
+    if (roms.empty()) {
+        for (const char* name : DEFAULT_ROMS) {
+            roms.push_back(std::string(GBEMU_ROM_DIR) + "/" + name);
+        }
+    }
+    if (instances == 0 || frames == 0 || max_workers == 0) {
+        printf("--instances, --frames and --max-workers must be positive\n");
+        return 2;
+    }
+
+#ifndef NDEBUG
+    printf("Warning: benchmarking a debug build\n");
+#endif
+
+    u32 hardware = BatchRunner::default_workers();
+    std::vector<Machine*> machines;
+    std::vector<ScalingResult> results;
+    for (u32 workers = 1; workers <= max_workers; workers *= 2) {
+        // Reloaded for every pool size, so all of them run the same frames
+        delete_machines(machines);
+        if (!load_machines(machines, roms, instances, frame_buffer)) {
+            return 1;
+        }
+        ScalingResult result;
+        if (run_batch(machines, workers, frames, result)) {
+            results.push_back(result);
+        }
+    }
+
+    print_footprint(machines, roms);
+    Footprint footprint = machines[0]->footprint();
+    delete_machines(machines);
+
+    // Same machines and budgets, so any difference is a scheduling bug
+    for (const ScalingResult& r : results) {
+        if (r.cycles != results[0].cycles) {
+            printf("%u workers ran %llu cycles, %u ran %llu\n", r.workers, static_cast<unsigned long long>(r.cycles),
+                   results[0].workers, static_cast<unsigned long long>(results[0].cycles));
+            return 1;
+        }
+    }
+
+    printf("\n%u machines x %u frames, %u hardware threads\n", instances, frames, hardware);
+    printf("%8s %12s %10s %10s %8s\n", "workers", "fps", "speedup", "effic.", "steals");
+    double base = results.empty() ? 0.0 : results[0].fps();
+    for (const ScalingResult& r : results) {
+        double speedup = r.fps() / base;
+        printf("%8u %12.1f %9.2fx %9.0f%% %8llu%s\n", r.workers, r.fps(), speedup, 100.0 * speedup / r.workers,
+               static_cast<unsigned long long>(r.steals), r.workers > hardware ? "  (oversubscribed)" : "");
+    }
+
+    if (json_path && !write_json(json_path, results, instances, frames, footprint)) {
+        return 1;
+    }
+    return 0;
+}
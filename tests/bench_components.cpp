@@ -0,0 +1,344 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "bench_harness.hpp"
+#include "machine.hpp"
+#include "ram_search.hpp"
+
+/**
+ * Component microbenchmarks.
+ *
+ * Times the hot paths of the Bus, CPU, PPU, Timer, DMA and RAM search on a
+ * minimal headless machine built around a generated 32 KiB ROM, so no SDL
+ * window or ROM files are needed.
+ *
+ *   bench_components [--reps N] [--warmup N] [filter]
+ *
+ * CPU cases include the PPU and timer work the CPU clocks on every machine
+ * cycle, which is what CPU::step costs in practice.
+ */
+
+volatile u64 bench_sink;
+
+static const char* ROM_PATH = "bench_components.gb";
+
+// ===== MACHINE SETUP =====
+
+static bool write_rom() {
+    std::vector<u8> rom(0x8000, 0x00);
+
+    // 0x0100: JP 0x0150, 0x0150: JR -2
+    rom[0x100] = 0xC3;
+    rom[0x101] = 0x50;
+    rom[0x102] = 0x01;
+    rom[0x150] = 0x18;
+    rom[0x151] = 0xFE;
+
+    memcpy(&rom[0x134], "BENCH", 5);
+    rom[0x147] = 0x02;  // MBC1+RAM, no battery so RAM is mapped directly
+    rom[0x148] = 0x00;  // 32 KiB
+    rom[0x149] = 0x02;  // 8 KiB RAM
+
+    FILE* fp = fopen(ROM_PATH, "wb");
+    if (!fp) {
+        printf("Failed to create: %s\n", ROM_PATH);
+        return false;
+    }
+    bool ok = fwrite(rom.data(), 1, rom.size(), fp) == rom.size();
+    fclose(fp);
+    return ok;
+}
+
+static Machine* create_machine() {
+    Machine* machine = new Machine();
+    if (!machine->load(ROM_PATH)) {
+        delete machine;
+        return nullptr;
+    }
+    machine->set_throttle(false);
+
+    // External RAM on, interrupts off
+    machine->bus.write(0x0000, 0x0A);
+    machine->bus.write(0xFFFF, 0x00);
+    machine->cpu.ime = false;
+    return machine;
+}
+
+// ===== BUS =====
+
+struct Region {
+    const char* read_name;
+    const char* write_name;
+    u16 base;
+    u16 mask;
+};
+
+static const Region REGIONS[] = {
+    {"bus read rom bank 0", nullptr, 0x0000, 0x3FFF},
+    {"bus read rom bank x", nullptr, 0x4000, 0x3FFF},
+    {"bus read vram", "bus write vram", 0x8000, 0x1FFF},
+    {"bus read external ram", "bus write external ram", 0xA000, 0x1FFF},
+    {"bus read wram", "bus write wram", 0xC000, 0x1FFF},
+    {"bus read oam", "bus write oam", 0xFE00, 0x007F},
+    {"bus read lcd registers", nullptr, 0xFF40, 0x0007},
+    {"bus read hram", "bus write hram", 0xFF80, 0x003F},
+};
+
+static void bench_bus(const BenchConfig& config) {
+    Machine* m = create_machine();
+    if (!m) {
+        return;
+    }
+
+    const u64 ops = 1 << 16;
+    for (const Region& region : REGIONS) {
+        bench_run(config, region.read_name, ops, [&] {
+            u64 sum = 0;
+            for (u64 i = 0; i < ops; i++) {
+                sum += m->bus.read(region.base + (i & region.mask));
+            }
+            bench_sink += sum;
+        });
+    }
+
+    for (const Region& region : REGIONS) {
+        if (!region.write_name) {
+            continue;
+        }
+        bench_run(config, region.write_name, ops, [&] {
+            for (u64 i = 0; i < ops; i++) {
+                m->bus.write(region.base + (i & region.mask), static_cast<u8>(i));
+            }
+        });
+    }
+
+    bench_run(config, "bus write mbc bank select", ops, [&] {
+        for (u64 i = 0; i < ops; i++) {
+            m->bus.write(0x2000, 1);
+        }
+    });
+
+    delete m;
+}
+
+// ===== CPU =====
+
+// Writes a loop body into WRAM at 0xC000 as many times as fits in 1 KiB,
+// followed by JP 0xC000
+static void load_stream(Machine* m, const std::vector<u8>& body) {
+    u16 address = 0xC000;
+    while (address + body.size() <= 0xC000 + 0x400) {
+        for (u8 byte : body) {
+            m->bus.write(address++, byte);
+        }
+    }
+    m->bus.write(address++, 0xC3);
+    m->bus.write(address++, 0x00);
+    m->bus.write(address++, 0xC0);
+
+    // Subroutine used by the branch stream: RET
+    m->bus.write(0xC800, 0xC9);
+
+    m->cpu.regs.pc = 0xC000;
+    m->cpu.regs.sp = 0xDFF0;
+    m->cpu.regs.h = 0xD0;
+    m->cpu.regs.l = 0x00;
+}
+
+struct Stream {
+    const char* name;
+    std::vector<u8> body;
+};
+
+static void bench_cpu(const BenchConfig& config) {
+    const Stream streams[] = {
+        // ADD A,B  SUB C  AND D  XOR E  OR H  CP L  INC A  DEC B  ADC A,C  SBC A,E
+        {"cpu step alu", {0x80, 0x91, 0xA2, 0xAB, 0xB4, 0xBD, 0x3C, 0x05, 0x89, 0x9B}},
+        // LD B,C  LD (HL),A  LD A,(HL)  LD D,E  LD B,d8  LD (HL+),A  DEC HL  LD A,(HL-)  INC HL
+        {"cpu step loads", {0x41, 0x77, 0x7E, 0x53, 0x06, 0x12, 0x22, 0x2B, 0x3A, 0x23}},
+        // JR +0  JR NZ,+0  CALL 0xC800
+        {"cpu step branches", {0x18, 0x00, 0x20, 0x00, 0xCD, 0x00, 0xC8}},
+        // RLC B  BIT 0,A  SET 0,A  SWAP A  SRL A  RL C  RES 7,(HL)
+        {"cpu step cb ops", {0xCB, 0x00, 0xCB, 0x47, 0xCB, 0xC7, 0xCB, 0x37, 0xCB, 0x3F, 0xCB, 0x11, 0xCB, 0xBE}},
+    };
+
+    const u64 ops = 100000;
+    for (const Stream& stream : streams) {
+        Machine* m = create_machine();
+        if (!m) {
+            return;
+        }
+        load_stream(m, stream.body);
+
+        bench_run(config, stream.name, ops, [&] {
+            for (u64 i = 0; i < ops; i++) {
+                m->cpu.step();
+            }
+        });
+        delete m;
+    }
+}
+
+// ===== PPU =====
+
+struct PpuScene {
+    const char* name;
+    u8 lcdc;
+    bool sprites;
+};
+
+static void setup_scene(Machine* m, const PpuScene& scene) {
+    // Varied tile data and maps so the fetcher and mixer see real pixels
+    for (u16 i = 0; i < 0x1800; i++) {
+        m->bus.write(0x8000 + i, static_cast<u8>(i * 37));
+    }
+    for (u16 i = 0; i < 0x800; i++) {
+        m->bus.write(0x9800 + i, static_cast<u8>(i));
+    }
+
+    // 40 tall sprites in 4 rows of 10, so 64 lines carry the 10 sprite limit
+    for (int i = 0; i < 40; i++) {
+        u16 oam = 0xFE00 + i * 4;
+        m->bus.write(oam + 0, scene.sprites ? 16 + (i / 10) * 16 : 0);
+        m->bus.write(oam + 1, scene.sprites ? 8 + (i % 10) * 16 : 0);
+        m->bus.write(oam + 2, static_cast<u8>(i));
+        m->bus.write(oam + 3, (i & 1) ? 0x20 : 0x00);
+    }
+
+    m->bus.write(0xFF47, 0xE4);  // BGP
+    m->bus.write(0xFF48, 0xE4);  // OBP0
+    m->bus.write(0xFF49, 0x1B);  // OBP1
+    m->bus.write(0xFF4A, 72);    // WY
+    m->bus.write(0xFF4B, 87);    // WX
+    m->bus.write(0xFF40, scene.lcdc);
+}
+
+static void bench_ppu(const BenchConfig& config) {
+    const PpuScene scenes[] = {
+        {"ppu frame background", 0x91, false},
+        {"ppu frame background+window", 0xF1, false},
+        {"ppu frame 10 sprites per line", 0x97, true},
+        {"ppu frame window+sprites", 0xF7, true},
+    };
+
+    // One full frame of dots
+    const u64 ops = 154 * 456;
+    for (const PpuScene& scene : scenes) {
+        Machine* m = create_machine();
+        if (!m) {
+            return;
+        }
+        setup_scene(m, scene);
+
+        bench_run(config, scene.name, ops, [&] {
+            for (u64 i = 0; i < ops; i++) {
+                m->ppu.tick();
+            }
+        });
+        delete m;
+    }
+}
+
+// ===== TIMER & DMA =====
+
+static void bench_timer_dma(const BenchConfig& config) {
+    Machine* m = create_machine();
+    if (!m) {
+        return;
+    }
+
+    // Fastest timer clock, so TIMA overflows regularly
+    m->bus.write(0xFF07, 0x05);
+
+    const u64 ops = 1 << 20;
+    bench_run(config, "timer tick", ops, [&] {
+        for (u64 i = 0; i < ops; i++) {
+            m->timer.tick();
+        }
+    });
+
+    // DMA only does work when started and observed; the lock it puts on the
+    // bus is never released here because the CPU does not run
+    const u64 transfers = 1 << 12;
+    bench_run(config, "dma transfer wram to oam", transfers, [&] {
+        for (u64 i = 0; i < transfers; i++) {
+            m->dma.start(0xC0);
+            m->dma.finish();
+        }
+    });
+
+    delete m;
+}
+
+// ===== RAM SEARCH =====
+
+static void bench_ram_search(const BenchConfig& config) {
+    Machine* m = create_machine();
+    if (!m) {
+        return;
+    }
+    RamSearch* search = new RamSearch();
+
+    for (u32 i = 0; i < 0x2000; i++) {
+        m->bus.write(0xC000 + i, static_cast<u8>(i * 7));
+    }
+    search->start(*m, SEARCH_ALL);
+    bench_run(config, "ram search snapshot all", 1, [&] {
+        search->snapshot(*m);
+        bench_sink += search->value(0xC000);
+    });
+
+    // Unchanged memory passes, so every address of every region stays a
+    // candidate and each repetition compares the whole set
+    bench_run(config, "ram search filter all", 1, [&] {
+        bench_sink += search->filter_previous(SearchCompare::EQUAL);
+    });
+
+    // A narrowed set only visits the words that still have candidates
+    search->start(*m, SEARCH_WRAM);
+    search->filter_value(SearchCompare::EQUAL, 0x15);
+    bench_run(config, "ram search filter narrowed", 1, [&] {
+        bench_sink += search->filter_previous(SearchCompare::EQUAL);
+    });
+
+    delete search;
+    delete m;
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+            config.reps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            config.warmup = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            printf("Usage: bench_components [--reps N] [--warmup N] [filter]\n");
+            return 2;
+        } else {
+            config.filter = argv[i];
+        }
+    }
+
+    if (!write_rom()) {
+        return 2;
+    }
+
+#ifndef NDEBUG
+    printf("Warning: benchmarking a debug build\n");
+#endif
+
+    bench_header();
+    bench_bus(config);
+    bench_cpu(config);
+    bench_ppu(config);
+    bench_timer_dma(config);
+    bench_ram_search(config);
+
+    remove(ROM_PATH);
+    return 0;
+}
@@ -0,0 +1,510 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "machine.hpp"
+#include "alu_tables.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef GBEMU_ROM_DIR
+#define GBEMU_ROM_DIR "roms"
+#endif
+
+#ifndef GBEMU_STRESS_DIR
+#define GBEMU_STRESS_DIR "stress"
+#endif
+
+/**
+ * Headless throughput benchmark.
+ *
+ * Runs each ROM unthrottled for a fixed number of emulated frames and
+ * reports emulated frames per second, guest clock in MHz, host time per
+ * guest instruction and the peak resident set size of the process. On Linux
+ * it also counts L1 data cache read misses per emulated frame, when the
+ * kernel exposes hardware counters (perf_event_paranoid <= 2, not in most
+ * containers); the column shows "-" otherwise.
+ *
+ *   bench_emu [--frames N] [--json FILE] [--baseline FILE] [--threshold PCT] [--stress]
+ *             [--profile FILE] [--state-hash] [rom ...]
+ *
+ * Without ROM arguments the bundled test ROMs are used. --stress runs the
+ * synthetic ROMs assembled from tools/stress instead, each of which isolates
+ * one expensive path: sprites, window, mid-line scrolling, HALT, bank
+ * switching and OAM DMA. --profile writes per-opcode counts and cycles
+ * summed over all ROMs (CSV, or JSON for a .json path); it needs a build
+ * configured with -DGBEMU_CPU_PROFILE=ON. --baseline compares frames per
+ * second against a file written earlier with --json and exits with 1 when
+ * any ROM is slower than the threshold allows. --state-hash runs every ROM
+ * again with Machine::set_state_hash(true) and reports the slowdown, next
+ * to the cost of hashing the same state from scratch.
+ */
+
+// ===== CONFIGURATION =====
+
+constexpr u32 DEFAULT_FRAMES = 600;
+constexpr double DEFAULT_THRESHOLD = 10.0;
+
+static const char* DEFAULT_ROMS[] = {
+    "cpu_instrs.gb",
+    "dmg-acid2.gb",
+    "mem_timing.gb",
+    "01-special.gb",
+    "02-interrupts.gb",
+    "03-op sp,hl.gb",
+    "04-op r,imm.gb",
+    "05-op rp.gb",
+    "06-ld r,r.gb",
+    "07-jr,jp,call,ret,rst.gb",
+    "08-misc instrs.gb",
+    "09-op r,r.gb",
+    "10-bit ops.gb",
+    "11-op a,(hl).gb",
+};
+
+static const char* STRESS_ROMS[] = {
+    "sprites.gb",
+    "window.gb",
+    "raster.gb",
+    "halt.gb",
+    "mbc.gb",
+    "dma.gb",
+};
+
+// How the 8 bit ALU produces flags in this build; L1D misses are only
+// comparable between runs of the same mode
+#if CPU_ALU_TABLES
+static const char* ALU_MODE = "tables";
+#elif CPU_LAZY_FLAGS
+static const char* ALU_MODE = "lazy";
+#else
+static const char* ALU_MODE = "eager";
+#endif
+
+// ===== RESULTS =====
+
+struct BenchResult {
+    std::string name;
+    u32 frames;
+    double seconds;
+    u64 cycles;
+    u64 instructions;
+    u64 l1d_misses;        // ~0 when unavailable
+
+    double fps() const { return frames / seconds; }
+    double guest_mhz() const { return cycles / seconds / 1e6; }
+    double ns_per_instr() const { return instructions ? seconds * 1e9 / instructions : 0.0; }
+    bool has_l1d() const { return l1d_misses != NO_COUNTER; }
+    double l1d_per_frame() const { return has_l1d() && frames ? double(l1d_misses) / frames : 0.0; }
+
+    static constexpr u64 NO_COUNTER = ~0ULL;
+};
+
+// ===== HARDWARE COUNTERS =====
+
+/**
+ * L1 data cache read misses of this thread, user space only
+ */
+class L1dCounter {
+public:
+    L1dCounter() : fd(-1) {
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~L1dCounter() {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Count since start(), BenchResult::NO_COUNTER without a counter
+    u64 stop() {
+#ifdef __linux__
+        u64 count;
+        if (fd >= 0 && ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(fd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+#endif
+        return BenchResult::NO_COUNTER;
+    }
+
+private:
+    int fd;
+};
+
+static long peak_rss_kb() {
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static const char* base_name(const char* path) {
+    const char* name = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+    return name;
+}
+
+// ===== BENCHMARK =====
+
+#if CPU_PROFILE
+static CpuProfile total_profile;
+#endif
+
+static bool run_rom(const char* path, u32 frames, BenchResult& result) {
+    // Heap allocated, the machine is too large to keep on the stack
+    Machine* machine = new Machine();
+    if (!machine->load(path)) {
+        delete machine;
+        return false;
+    }
+    machine->set_throttle(false);
+
+    u64 start_cycles = machine->cpu.get_ticks();
+    u32 start_frame = machine->ppu.current_frame;
+
+    L1dCounter l1d;
+    auto start = std::chrono::steady_clock::now();
+    l1d.start();
+    machine->run_frames(frames);
+    result.l1d_misses = l1d.stop();
+    auto end = std::chrono::steady_clock::now();
+
+    result.name = base_name(path);
+    result.frames = machine->ppu.current_frame - start_frame;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.cycles = machine->cpu.get_ticks() - start_cycles;
+    result.instructions = machine->get_instructions();
+#if CPU_PROFILE
+    total_profile.merge(machine->cpu.profile);
+#endif
+
+    delete machine;
+    return result.frames > 0;
+}
+
+// Frames per second with the incremental state hash on, and the time one
+// compute_state_hash() takes at the end of the run
+struct HashResult {
+    std::string name;
+    double fps = 0.0;
+    double full_hash_us = 0.0;
+};
+
+constexpr u32 FULL_HASH_CALLS = 1000;
+
+static bool run_state_hash(const char* path, u32 frames, HashResult& result) {
+    Machine* machine = new Machine();
+    if (!machine->load(path)) {
+        delete machine;
+        return false;
+    }
+    machine->set_throttle(false);
+    machine->set_state_hash(true);
+
+    u32 start_frame = machine->ppu.current_frame;
+    auto start = std::chrono::steady_clock::now();
+    machine->run_frames(frames);
+    auto end = std::chrono::steady_clock::now();
+    u32 ran = machine->ppu.current_frame - start_frame;
+
+    u64 full = 0;
+    auto hash_start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < FULL_HASH_CALLS; i++) {
+        full = machine->compute_state_hash();
+    }
+    auto hash_end = std::chrono::steady_clock::now();
+    bool consistent = full == machine->state_hash();
+
+    result.name = base_name(path);
+    result.fps = ran / std::chrono::duration<double>(end - start).count();
+    result.full_hash_us = std::chrono::duration<double, std::micro>(hash_end - hash_start).count() / FULL_HASH_CALLS;
+
+    delete machine;
+    if (!consistent) {
+        printf("%s: incremental and full state hash differ\n", path);
+    }
+    return ran > 0 && consistent;
+}
+
+// ===== OUTPUT =====
+
+static bool write_json(const char* path, const std::vector<BenchResult>& results, u32 frames) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"frames\": %u,\n", frames);
+#ifdef NDEBUG
+    fprintf(fp, "  \"build\": \"release\",\n");
+#else
+    fprintf(fp, "  \"build\": \"debug\",\n");
+#endif
+    fprintf(fp, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+    fprintf(fp, "  \"alu\": \"%s\",\n", ALU_MODE);
+    fprintf(fp, "  \"roms\": [\n");
+
+    // One ROM per line, read_baseline() relies on it
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char l1d[32];
+        if (r.has_l1d()) {
+            snprintf(l1d, sizeof(l1d), "%.1f", r.l1d_per_frame());
+        } else {
+            snprintf(l1d, sizeof(l1d), "null");
+        }
+        fprintf(fp, "    {\"name\": \"%s\", \"frames\": %u, \"seconds\": %.6f, \"fps\": %.2f, "
+                    "\"guest_mhz\": %.3f, \"ns_per_instr\": %.2f, \"instructions\": %llu, "
+                    "\"l1d_misses_per_frame\": %s}%s\n",
+                r.name.c_str(), r.frames, r.seconds, r.fps(), r.guest_mhz(), r.ns_per_instr(),
+                (unsigned long long)r.instructions, l1d, i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    return true;
+}
+
+// ===== BASELINE COMPARISON =====
+
+struct BaselineEntry {
+    std::string name;
+    double fps;
+};
+
+static bool read_baseline(const char* path, std::vector<BaselineEntry>& entries) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        printf("Failed to open baseline: %s\n", path);
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* fps = strstr(line, "\"fps\": ");
+        if (!name || !fps) {
+            continue;
+        }
+
+        name += strlen("\"name\": \"");
+        const char* name_end = strchr(name, '"');
+        if (!name_end) {
+            continue;
+        }
+
+        BaselineEntry entry;
+        entry.name.assign(name, name_end - name);
+        entry.fps = atof(fps + strlen("\"fps\": "));
+        entries.push_back(entry);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+static bool compare_baseline(const std::vector<BenchResult>& results,
+                             const std::vector<BaselineEntry>& baseline, double threshold) {
+    bool ok = true;
+
+    printf("\n%-28s %10s %10s %8s\n", "ROM", "fps", "baseline", "change");
+    for (const BenchResult& r : results) {
+        const BaselineEntry* base = nullptr;
+        for (const BaselineEntry& e : baseline) {
+            if (e.name == r.name) {
+                base = &e;
+                break;
+            }
+        }
+
+        if (!base || base->fps <= 0.0) {
+            printf("%-28s %10.1f %10s %8s\n", r.name.c_str(), r.fps(), "-", "-");
+            continue;
+        }
+
+        double change = (r.fps() - base->fps) / base->fps * 100.0;
+        bool regressed = change < -threshold;
+        printf("%-28s %10.1f %10.1f %+7.1f%%%s\n", r.name.c_str(), r.fps(), base->fps, change,
+               regressed ? "  REGRESSION" : "");
+        ok = ok && !regressed;
+    }
+    return ok;
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    u32 frames = DEFAULT_FRAMES;
+    double threshold = DEFAULT_THRESHOLD;
+    const char* json_path = nullptr;
+    const char* baseline_path = nullptr;
+    const char* profile_path = nullptr;
+    bool stress = false;
+    bool state_hash = false;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (!strcmp(argv[i], "--stress")) {
+            stress = true;
+        } else if (!strcmp(argv[i], "--state-hash")) {
+            state_hash = true;
+        } else if (argv[i][0] == '-') {
+            printf("Usage: bench_emu [--frames N] [--json FILE] [--baseline FILE] [--threshold PCT] [--stress] [--profile FILE] "
+                   "[--state-hash] [rom ...]\n");
+            return 2;
+        } else {
+            roms.push_back(argv[i]);
+        }
+    }
+
+    if (roms.empty() && stress) {
+        for (const char* name : STRESS_ROMS) {
+            roms.push_back(std::string(GBEMU_STRESS_DIR) + "/" + name);
+        }
+    } else if (roms.empty()) {
+        for (const char* name : DEFAULT_ROMS) {
+            roms.push_back(std::string(GBEMU_ROM_DIR) + "/" + name);
+        }
+    }
+
+#ifndef NDEBUG
+    printf("Warning: benchmarking a debug build\n");
+#endif
+#if CPU_PROFILE
+    printf("Warning: CPU profiling is compiled in, timings include its overhead\n");
+#else
+    if (profile_path) {
+        printf("--profile needs a build configured with -DGBEMU_CPU_PROFILE=ON\n");
+        return 2;
+    }
+#endif
+
+    std::vector<BenchResult> results;
+    std::vector<std::string> measured;
+    for (const std::string& rom : roms) {
+        BenchResult result;
+        if (!run_rom(rom.c_str(), frames, result)) {
+            printf("Skipping %s\n", rom.c_str());
+            continue;
+        }
+        results.push_back(result);
+        measured.push_back(rom);
+    }
+
+    double total_seconds = 0.0;
+    u32 total_frames = 0;
+
+    printf("\n%-28s %8s %10s %10s %10s %12s\n", "ROM", "frames", "fps", "guest MHz", "ns/instr", "L1D miss/fr");
+    for (const BenchResult& r : results) {
+        printf("%-28s %8u %10.1f %10.2f %10.2f", r.name.c_str(), r.frames, r.fps(), r.guest_mhz(), r.ns_per_instr());
+        if (r.has_l1d()) {
+            printf(" %12.0f\n", r.l1d_per_frame());
+        } else {
+            printf(" %12s\n", "-");
+        }
+        total_seconds += r.seconds;
+        total_frames += r.frames;
+    }
+    if (total_seconds > 0.0) {
+        printf("%-28s %8u %10.1f\n", "total", total_frames, total_frames / total_seconds);
+    }
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+#if CPU_ALU_TABLES
+    printf("ALU flags: %s, %zu bytes read-only\n", ALU_MODE, sizeof(AluTables));
+#else
+    printf("ALU flags: %s\n", ALU_MODE);
+#endif
+
+    if (state_hash) {
+        printf("\n%-28s %10s %10s %10s %14s\n", "State hash", "fps", "hashed", "overhead", "full hash us");
+        for (size_t i = 0; i < results.size(); i++) {
+            HashResult h;
+            if (!run_state_hash(measured[i].c_str(), frames, h)) {
+                return 1;
+            }
+            printf("%-28s %10.1f %10.1f %9.1f%% %14.2f\n", h.name.c_str(), results[i].fps(), h.fps,
+                   100.0 * (results[i].fps() / h.fps - 1.0), h.full_hash_us);
+        }
+    }
+
+    if (json_path && !write_json(json_path, results, frames)) {
+        return 2;
+    }
+
+#if CPU_PROFILE
+    if (profile_path && !total_profile.write(profile_path)) {
+        return 2;
+    }
+#endif
+
+    if (baseline_path) {
+        std::vector<BaselineEntry> baseline;
+        if (!read_baseline(baseline_path, baseline)) {
+            return 2;
+        }
+        if (!compare_baseline(results, baseline, threshold)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
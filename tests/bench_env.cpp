@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "gbe_env.h"
+
+#ifndef GBEMU_ROM_DIR
+#define GBEMU_ROM_DIR "roms"
+#endif
+
+/**
+ * gbe_env stepping benchmark.
+ *
+ * Creates one environment through the C interface and times gbe_step()
+ * with a budget of 0 frames, which measures only the per-step cost of
+ * applying actions and handing the batch to the workers and back. It then
+ * times one agent step of --frames-per-action frames done four ways: one
+ * gbe_step() call per frame, a single gbe_step(), and gbe_step_repeat()
+ * rendering only the last frame or the max of the last two. Actions are
+ * random button masks, as in training.
+ *
+ * --observation W H turns on the area-averaged W x H grayscale observation,
+ * so its cost shows up in every variant.
+ *
+ *   bench_env [--instances N] [--steps N] [--frames-per-action N] [--observation W H] [rom]
+ */
+
+// ===== CONFIGURATION =====
+
+constexpr uint32_t DEFAULT_INSTANCES = 64;
+constexpr uint32_t DEFAULT_STEPS = 100;
+constexpr uint32_t DEFAULT_FRAMES_PER_ACTION = 4;
+constexpr uint32_t OVERHEAD_STEPS = 2000;
+
+// ===== BENCHMARK =====
+
+// Median wall time of one agent step in microseconds, made of calls
+// gbe_step_repeat() calls of frames frames each
+static double time_steps(gbe_env* env, uint32_t steps, uint32_t calls, uint32_t frames, int reduce,
+                         std::vector<uint8_t>& actions) {
+    std::vector<double> samples;
+    samples.reserve(steps);
+
+    for (uint32_t s = 0; s < steps; s++) {
+        for (uint8_t& a : actions) {
+            a = static_cast<uint8_t>(rand());
+        }
+
+        int failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t c = 0; c < calls; c++) {
+            failed += gbe_step_repeat(env, actions.data(), frames, reduce);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        if (failed) {
+            printf("%d instances stopped early\n", failed);
+        }
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    uint32_t instances = DEFAULT_INSTANCES;
+    uint32_t steps = DEFAULT_STEPS;
+    uint32_t frames = DEFAULT_FRAMES_PER_ACTION;
+    uint32_t obs_width = 0;
+    uint32_t obs_height = 0;
+    std::string rom = std::string(GBEMU_ROM_DIR) + "/cpu_instrs.gb";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--instances") && i + 1 < argc) {
+            instances = static_cast<uint32_t>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+            steps = static_cast<uint32_t>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--frames-per-action") && i + 1 < argc) {
+            frames = static_cast<uint32_t>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--observation") && i + 2 < argc) {
+            obs_width = static_cast<uint32_t>(atol(argv[++i]));
+            obs_height = static_cast<uint32_t>(atol(argv[++i]));
+        } else if (argv[i][0] == '-') {
+            printf("Usage: bench_env [--instances N] [--steps N] [--frames-per-action N] [--observation W H] [rom]\n");
+            return 2;
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (instances == 0 || steps == 0 || frames == 0) {
+        printf("--instances, --steps and --frames-per-action must be positive\n");
+        return 2;
+    }
+
+#ifndef NDEBUG
+    printf("Warning: benchmarking a debug build\n");
+#endif
+
+    gbe_env* env = gbe_create(rom.c_str(), instances);
+    if (!env) {
+        printf("Failed to create %u instances of %s\n", instances, rom.c_str());
+        return 1;
+    }
+
+    if (obs_width && gbe_set_observation(env, GBE_OBS_RESIZED, obs_width, obs_height) != 0) {
+        gbe_destroy(env);
+        return 2;
+    }
+
+    std::vector<uint8_t> actions(instances);
+    srand(1);
+
+    // Warm up, so neither measurement includes the first frames after load
+    gbe_step(env, nullptr, 60);
+
+    double overhead_us = time_steps(env, OVERHEAD_STEPS, 1, 0, GBE_REDUCE_ALL, actions);
+
+    printf("\n%u instances of %s, %u workers\n", instances, rom.c_str(), gbe_num_workers(env));
+    if (obs_width) {
+        printf("%ux%u grayscale observation\n", obs_width, obs_height);
+    }
+    printf("%-32s %10.2f us\n", "step overhead (0 frames)", overhead_us);
+    printf("%-32s %10.2f us\n", "per instance", overhead_us / instances);
+
+    struct Variant {
+        const char* name;
+        uint32_t calls;
+        uint32_t frames;
+        int reduce;
+    };
+    const Variant variants[] = {
+        {"gbe_step(1) per frame", frames, 1, GBE_REDUCE_ALL},
+        {"gbe_step(k)", 1, frames, GBE_REDUCE_ALL},
+        {"gbe_step_repeat(k, LAST)", 1, frames, GBE_REDUCE_LAST},
+        {"gbe_step_repeat(k, MAX_LAST_TWO)", 1, frames, GBE_REDUCE_MAX_LAST_TWO},
+    };
+
+    printf("\nAgent step of k = %u frames\n", frames);
+    printf("%-34s %12s %12s %10s\n", "", "us/step", "fps", "overhead");
+    for (const Variant& v : variants) {
+        double step_us = time_steps(env, steps, v.calls, v.frames, v.reduce, actions);
+        printf("%-34s %12.1f %12.1f %9.2f%%\n", v.name, step_us, instances * frames / (step_us / 1e6),
+               100.0 * v.calls * overhead_us / step_us);
+    }
+
+    gbe_destroy(env);
+    return 0;
+}
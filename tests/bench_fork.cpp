@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "machine.hpp"
+
+#ifndef GBEMU_ROM_DIR
+#define GBEMU_ROM_DIR "roms"
+#endif
+
+/**
+ * Machine::fork() benchmark.
+ *
+ * Runs one machine past the boot frames, then branches it into --children
+ * copies two ways: fork() alone, which shares every RAM page with the
+ * parent, and fork() followed by a private copy of every page, which is
+ * what a full snapshot of the mutable state costs. For each it reports the
+ * median fork latency and the bytes a child owns, right after the fork and
+ * after stepping every child --frames frames with random buttons, as a tree
+ * search would.
+ *
+ *   bench_fork [--children N] [--frames N] [--warmup N] [rom]
+ */
+
+// ===== CONFIGURATION =====
+
+constexpr u32 DEFAULT_CHILDREN = 256;
+constexpr u32 DEFAULT_FRAMES = 60;
+constexpr u32 DEFAULT_WARMUP = 300;
+
+// ===== MEASUREMENT =====
+
+// Object, arenas and the pages nobody else references; the machine has
+// nothing else on the heap unless profiling or tracing
+static size_t owned_bytes(const Machine* m) {
+    u32 private_pages = m->pages.size() - m->pages.shared_count();
+    return sizeof(Machine) + m->arena.get_capacity() + m->observation.get_storage() + private_pages * PAGE_SIZE;
+}
+
+struct ForkResult {
+    double median_us = 0.0;
+    double bytes_forked = 0.0;   // mean per child right after the fork
+    double bytes_stepped = 0.0;  // mean per child after stepping
+    double pages_stepped = 0.0;  // mean private pages per child after stepping
+};
+
+static bool run(Machine* parent, u32 children, u32 frames, bool full_copy, ForkResult& result) {
+    std::vector<Machine*> forks;
+    std::vector<double> samples;
+    forks.reserve(children);
+    samples.reserve(children);
+
+    for (u32 i = 0; i < children; i++) {
+        auto start = std::chrono::steady_clock::now();
+        Machine* child = parent->fork();
+        if (child && full_copy) {
+            for (u32 slot = 0; slot < child->pages.size(); slot++) {
+                child->pages.writable(slot);
+            }
+            child->bus.remap();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        if (!child) {
+            printf("Fork %u failed\n", i);
+            break;
+        }
+        forks.push_back(child);
+        samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    size_t forked = 0;
+    for (const Machine* m : forks) {
+        forked += owned_bytes(m);
+    }
+
+    bool ok = forks.size() == children;
+    size_t stepped = 0;
+    size_t pages = 0;
+    for (Machine* m : forks) {
+        ok = m->run_frames(frames, static_cast<u8>(rand()), FrameReduce::LAST) && ok;
+        stepped += owned_bytes(m);
+        pages += m->pages.size() - m->pages.shared_count();
+    }
+
+    if (!samples.empty()) {
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        result.median_us = samples[samples.size() / 2];
+        result.bytes_forked = static_cast<double>(forked) / forks.size();
+        result.bytes_stepped = static_cast<double>(stepped) / forks.size();
+        result.pages_stepped = static_cast<double>(pages) / forks.size();
+    }
+
+    for (Machine* m : forks) {
+        delete m;
+    }
+    return ok;
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    u32 children = DEFAULT_CHILDREN;
+    u32 frames = DEFAULT_FRAMES;
+    u32 warmup = DEFAULT_WARMUP;
+    std::string rom = std::string(GBEMU_ROM_DIR) + "/cpu_instrs.gb";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--children") && i + 1 < argc) {
+            children = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = static_cast<u32>(atol(argv[++i]));
+        } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            warmup = static_cast<u32>(atol(argv[++i]));
+        } else if (argv[i][0] == '-') {
+            printf("Usage: bench_fork [--children N] [--frames N] [--warmup N] [rom]\n");
+            return 2;
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (children == 0) {
+        printf("--children must be positive\n");
+        return 2;
+    }
+
+#ifndef NDEBUG
+    printf("Warning: benchmarking a debug build\n");
+#endif
+
+    Machine* parent = new Machine();
+    parent->set_persistent(false);
+    if (!parent->load(rom.c_str())) {
+        delete parent;
+        return 1;
+    }
+    parent->set_throttle(false);
+    if (!parent->run_frames(warmup)) {
+        printf("%s stopped during warmup\n", rom.c_str());
+        delete parent;
+        return 1;
+    }
+
+    srand(1);
+    ForkResult cow;
+    ForkResult full;
+    bool ok = run(parent, children, frames, false, cow);
+    ok = run(parent, children, frames, true, full) && ok;
+
+    printf("\n%u children of %s after %u frames, stepped %u frames each\n", children, rom.c_str(), warmup, frames);
+    printf("%u RAM pages of %u bytes, %zu bytes of machine object\n", parent->pages.size(), PAGE_SIZE, sizeof(Machine));
+    printf("%-20s %12s %14s %14s %14s\n", "", "fork us", "bytes forked", "bytes stepped", "pages stepped");
+    printf("%-20s %12.2f %14.0f %14.0f %14.1f\n", "copy on write", cow.median_us, cow.bytes_forked,
+           cow.bytes_stepped, cow.pages_stepped);
+    printf("%-20s %12.2f %14.0f %14.0f %14.1f\n", "full copy", full.median_us, full.bytes_forked,
+           full.bytes_stepped, full.pages_stepped);
+
+    delete parent;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "common.hpp"
+
+/**
+ * @brief Minimal statistics harness for microbenchmarks
+ *
+ * Each case is a callable that performs a fixed number of operations. The
+ * harness runs it a few times untimed to warm caches and branch predictors,
+ * then times a number of repetitions and reports the median cost per
+ * operation together with the median absolute deviation (MAD). The median
+ * and MAD ignore the odd descheduled repetition, so a shift in the median
+ * larger than a few MADs is a real change, not noise.
+ */
+
+// ===== CONFIGURATION =====
+
+struct BenchConfig {
+    int warmup = 3;
+    int reps = 21;
+    const char* filter = nullptr;  // run only cases whose name contains this
+};
+
+struct BenchStats {
+    double median_ns;  // per operation
+    double mad_ns;     // per operation
+    double min_ns;     // per operation
+};
+
+// Results are folded into this so the compiler cannot drop the measured work
+extern volatile u64 bench_sink;
+
+// ===== STATISTICS =====
+
+inline double bench_median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    if (n == 0) {
+        return 0.0;
+    }
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.0;
+}
+
+inline BenchStats bench_stats(const std::vector<double>& samples) {
+    BenchStats stats;
+    stats.median_ns = bench_median(samples);
+
+    std::vector<double> deviations;
+    for (double s : samples) {
+        deviations.push_back(std::fabs(s - stats.median_ns));
+    }
+    stats.mad_ns = bench_median(deviations);
+    stats.min_ns = samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+    return stats;
+}
+
+// ===== RUNNER =====
+
+inline void bench_header() {
+    printf("%-36s %12s %10s %8s %12s\n", "case", "median ns/op", "MAD", "MAD %", "min ns/op");
+}
+
+/**
+ * @brief Time fn, which must perform `ops` operations per call
+ * @return false when the case was skipped by the filter
+ */
+template <typename Fn>
+bool bench_run(const BenchConfig& config, const char* name, u64 ops, Fn fn) {
+    if (config.filter && !strstr(name, config.filter)) {
+        return false;
+    }
+
+    for (int i = 0; i < config.warmup; i++) {
+        fn();
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < config.reps; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / ops);
+    }
+
+    BenchStats stats = bench_stats(samples);
+    printf("%-36s %12.3f %10.3f %7.1f%% %12.3f\n", name, stats.median_ns, stats.mad_ns,
+           stats.median_ns > 0.0 ? stats.mad_ns / stats.median_ns * 100.0 : 0.0, stats.min_ns);
+    return true;
+}
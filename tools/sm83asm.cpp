@@ -0,0 +1,884 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * sm83asm - minimal two-pass assembler for Game Boy ROMs
+ *
+ *   sm83asm input.asm output.gb
+ *
+ * Only what the synthetic workloads in tools/stress need, kept deliberately
+ * small:
+ *
+ * - one instruction, label or directive per line, ';' starts a comment
+ * - labels end with ':'; names starting with '.' are local to the last
+ *   global label
+ * - numbers: $FF, 0xFF, %1010, 255, 'c'
+ * - expressions: + - * / & | << >> over numbers and symbols, left to right
+ *   within each precedence level; no parentheses (they mark memory operands)
+ * - directives:
+ *     NAME equ expr          constant
+ *     org expr               set the current address
+ *     bank n                 place following code in ROM bank n (0x4000-0x7FFF)
+ *     db expr|"text", ...    bytes
+ *     dw expr, ...           little endian words
+ *     ds count[, fill]       repeated bytes
+ *     include "file"         textual include, relative to the current file
+ *     rept count[, var]      repeat the lines up to 'endr'; {var} in those
+ *     endr                   lines is replaced by the iteration index
+ *
+ * The output is padded to a power of two of at least 32 KiB, and the header
+ * and global checksums are filled in.
+ */
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+
+// ===== SOURCE LINES =====
+
+struct Line {
+    std::string text;
+    std::string file;
+    int number;
+};
+
+static bool had_error = false;
+
+static void error(const Line& line, const char* message, const std::string& detail = "") {
+    printf("%s:%d: error: %s%s%s\n", line.file.c_str(), line.number, message,
+           detail.empty() ? "" : ": ", detail.c_str());
+    had_error = true;
+}
+
+static std::string trim(const std::string& s) {
+    size_t start = 0;
+    size_t end = s.size();
+    while (start < end && isspace(static_cast<unsigned char>(s[start]))) {
+        start++;
+    }
+    while (end > start && isspace(static_cast<unsigned char>(s[end - 1]))) {
+        end--;
+    }
+    return s.substr(start, end - start);
+}
+
+static std::string lower(std::string s) {
+    for (char& c : s) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+static std::string strip_comment(const std::string& s) {
+    bool quoted = false;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\'') {
+            quoted = !quoted;
+        } else if (s[i] == ';' && !quoted) {
+            return s.substr(0, i);
+        }
+    }
+    return s;
+}
+
+// Splits operands on commas outside of quotes
+static std::vector<std::string> split_operands(const std::string& s) {
+    std::vector<std::string> parts;
+    std::string current;
+    bool quoted = false;
+
+    for (char c : s) {
+        if (c == '"') {
+            quoted = !quoted;
+        }
+        if (c == ',' && !quoted) {
+            parts.push_back(trim(current));
+            current.clear();
+        } else {
+            current += c;
+        }
+    }
+    if (!trim(current).empty() || !parts.empty()) {
+        parts.push_back(trim(current));
+    }
+    return parts;
+}
+
+static std::string directory_of(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static bool read_lines(const std::string& path, std::vector<Line>& out, const Line* from) {
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp) {
+        if (from) {
+            error(*from, "cannot open include", path);
+        } else {
+            printf("Failed to open: %s\n", path.c_str());
+        }
+        return false;
+    }
+
+    char buffer[1024];
+    int number = 0;
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        number++;
+        Line line;
+        line.text = strip_comment(buffer);
+        line.file = path;
+        line.number = number;
+
+        std::string text = trim(line.text);
+        std::string head = lower(text.substr(0, 8));
+        if (head.compare(0, 8, "include ") == 0) {
+            std::string name = trim(text.substr(8));
+            if (name.size() >= 2 && name.front() == '"' && name.back() == '"') {
+                name = name.substr(1, name.size() - 2);
+            }
+            read_lines(directory_of(path) + name, out, &line);
+            continue;
+        }
+        out.push_back(line);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+// ===== REPT EXPANSION =====
+
+static long parse_plain_number(const std::string& s, bool& ok);
+
+static void replace_all(std::string& s, const std::string& from, const std::string& to) {
+    size_t pos = 0;
+    while ((pos = s.find(from, pos)) != std::string::npos) {
+        s.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+
+// Expands rept/endr blocks; counts must be plain numbers or earlier equs
+// that are plain numbers, since expansion happens before assembly
+static bool expand_rept(const std::vector<Line>& in, size_t& i, std::vector<Line>& out,
+                        std::map<std::string, long>& plain_equs, bool nested) {
+    while (i < in.size()) {
+        const Line& line = in[i];
+        std::string text = trim(line.text);
+        std::string low = lower(text);
+
+        if (low == "endr") {
+            if (!nested) {
+                error(line, "endr without rept");
+            }
+            i++;
+            return true;
+        }
+
+        if (low.compare(0, 5, "rept ") == 0) {
+            std::vector<std::string> args = split_operands(text.substr(5));
+            bool ok = !args.empty();
+            long count = 0;
+            if (ok) {
+                auto equ = plain_equs.find(lower(args[0]));
+                count = equ != plain_equs.end() ? equ->second : parse_plain_number(args[0], ok);
+            }
+            if (!ok || count < 0) {
+                error(line, "rept needs a constant count");
+                count = 0;
+            }
+            std::string var = args.size() > 1 ? "{" + args[1] + "}" : "";
+
+            i++;
+            std::vector<Line> body;
+            if (!expand_rept(in, i, body, plain_equs, true)) {
+                return false;
+            }
+
+            for (long n = 0; n < count; n++) {
+                for (Line copy : body) {
+                    if (!var.empty()) {
+                        replace_all(copy.text, var, std::to_string(n));
+                    }
+                    out.push_back(copy);
+                }
+            }
+            continue;
+        }
+
+        // Remember simple numeric equs so they can be used as rept counts
+        size_t equ_pos = low.find(" equ ");
+        if (equ_pos != std::string::npos) {
+            bool ok = true;
+            long value = parse_plain_number(trim(text.substr(equ_pos + 5)), ok);
+            if (ok) {
+                plain_equs[lower(trim(text.substr(0, equ_pos)))] = value;
+            }
+        }
+
+        out.push_back(line);
+        i++;
+    }
+
+    if (nested) {
+        error(in.back(), "rept without endr");
+        return false;
+    }
+    return true;
+}
+
+// ===== EXPRESSIONS =====
+
+static long parse_plain_number(const std::string& s, bool& ok) {
+    ok = false;
+    if (s.empty()) {
+        return 0;
+    }
+
+    char* end = nullptr;
+    long value = 0;
+    if (s[0] == '$') {
+        value = strtol(s.c_str() + 1, &end, 16);
+    } else if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        value = strtol(s.c_str() + 2, &end, 16);
+    } else if (s[0] == '%') {
+        value = strtol(s.c_str() + 1, &end, 2);
+    } else if (s.size() == 3 && s[0] == '\'' && s[2] == '\'') {
+        ok = true;
+        return static_cast<unsigned char>(s[1]);
+    } else if (isdigit(static_cast<unsigned char>(s[0]))) {
+        value = strtol(s.c_str(), &end, 10);
+    } else {
+        return 0;
+    }
+
+    ok = end && *end == '\0' && end != s.c_str() + (s[0] == '$' || s[0] == '%' ? 1 : 0);
+    return value;
+}
+
+class Assembler {
+public:
+    bool assemble(const std::vector<Line>& lines);
+    bool write(const char* path);
+
+private:
+    // ===== STATE =====
+    std::map<std::string, long> symbols;
+    std::vector<u8> rom;
+    u32 bank = 1;       // ROM bank mapped at 0x4000-0x7FFF
+    u32 pc = 0;
+    int pass = 0;
+    std::string scope;  // last global label, for .local names
+    const Line* line = nullptr;
+
+    // ===== OUTPUT =====
+    void emit(u8 byte);
+    void emit16(long value);
+
+    // ===== EXPRESSIONS =====
+    std::string qualify(const std::string& name) const;
+    bool eval(const std::string& expr, long& value);
+    long value(const std::string& expr);
+    long value8(const std::string& expr);
+
+    // ===== STATEMENTS =====
+    void statement(const std::string& text);
+    bool directive(const std::string& op, const std::string& rest);
+    bool instruction(const std::string& op, const std::vector<std::string>& args);
+};
+
+std::string Assembler::qualify(const std::string& name) const {
+    return name[0] == '.' ? scope + name : name;
+}
+
+bool Assembler::eval(const std::string& expr, long& result) {
+    // Tokenize into operands and operators
+    std::vector<std::string> tokens;
+    std::string s = trim(expr);
+    size_t i = 0;
+    while (i < s.size()) {
+        char c = s[i];
+        if (isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if ((c == '<' || c == '>') && i + 1 < s.size() && s[i + 1] == c) {
+            tokens.push_back(s.substr(i, 2));
+            i += 2;
+        } else if (strchr("+-*/&|", c)) {
+            tokens.push_back(std::string(1, c));
+            i++;
+        } else if (c == '\'' && i + 2 < s.size()) {
+            tokens.push_back(s.substr(i, 3));
+            i += 3;
+        } else {
+            size_t start = i;
+            while (i < s.size() && !isspace(static_cast<unsigned char>(s[i])) && !strchr("+-*/&|<>", s[i])) {
+                i++;
+            }
+            tokens.push_back(s.substr(start, i - start));
+        }
+    }
+
+    // Operands, with unary minus folded in
+    std::vector<long> values;
+    std::vector<std::string> ops;
+    bool expect_value = true;
+    bool negate = false;
+    for (const std::string& t : tokens) {
+        if (expect_value) {
+            if (t == "-") {
+                negate = !negate;
+                continue;
+            }
+            bool ok = false;
+            long v = parse_plain_number(t, ok);
+            if (!ok) {
+                auto it = symbols.find(lower(qualify(t)));
+                if (it != symbols.end()) {
+                    v = it->second;
+                } else if (pass == 2) {
+                    error(*line, "unknown symbol", t);
+                    return false;
+                } else {
+                    v = 0;  // forward reference, resolved in pass 2
+                }
+            }
+            values.push_back(negate ? -v : v);
+            negate = false;
+            expect_value = false;
+        } else {
+            ops.push_back(t);
+            expect_value = true;
+        }
+    }
+    if (values.empty() || expect_value) {
+        error(*line, "bad expression", expr);
+        return false;
+    }
+
+    // Reduce by precedence level: * /, then + -, then << >>, then &, then |
+    const char* levels[][2] = {{"*", "/"}, {"+", "-"}, {"<<", ">>"}, {"&", "&"}, {"|", "|"}};
+    for (auto& level : levels) {
+        for (size_t k = 0; k < ops.size();) {
+            if (ops[k] != level[0] && ops[k] != level[1]) {
+                k++;
+                continue;
+            }
+            long a = values[k];
+            long b = values[k + 1];
+            long r = 0;
+            if (ops[k] == "*") r = a * b;
+            else if (ops[k] == "/") r = b ? a / b : 0;
+            else if (ops[k] == "+") r = a + b;
+            else if (ops[k] == "-") r = a - b;
+            else if (ops[k] == "<<") r = a << b;
+            else if (ops[k] == ">>") r = a >> b;
+            else if (ops[k] == "&") r = a & b;
+            else r = a | b;
+            values[k] = r;
+            values.erase(values.begin() + k + 1);
+            ops.erase(ops.begin() + k);
+        }
+    }
+
+    result = values[0];
+    return true;
+}
+
+long Assembler::value(const std::string& expr) {
+    long v = 0;
+    eval(expr, v);
+    return v;
+}
+
+long Assembler::value8(const std::string& expr) {
+    long v = value(expr);
+    if (pass == 2 && (v < -128 || v > 255)) {
+        error(*line, "value does not fit in a byte", expr);
+    }
+    return v & 0xFF;
+}
+
+// ===== OUTPUT =====
+
+void Assembler::emit(u8 byte) {
+    if (pass == 2) {
+        u32 offset;
+        if (pc < 0x4000) {
+            offset = pc;
+        } else if (pc < 0x8000) {
+            offset = (bank ? bank : 1) * 0x4000 + (pc - 0x4000);
+        } else {
+            error(*line, "code outside of ROM");
+            pc++;
+            return;
+        }
+        if (offset >= rom.size()) {
+            rom.resize(offset + 1, 0xFF);
+        }
+        rom[offset] = byte;
+    }
+    pc++;
+}
+
+void Assembler::emit16(long value) {
+    emit(value & 0xFF);
+    emit((value >> 8) & 0xFF);
+}
+
+// ===== OPERANDS =====
+
+static int reg8(const std::string& s) {
+    static const char* names[] = {"b", "c", "d", "e", "h", "l", "(hl)", "a"};
+    std::string l = lower(s);
+    for (int i = 0; i < 8; i++) {
+        if (l == names[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int reg16(const std::string& s, bool stack) {
+    std::string l = lower(s);
+    if (l == "bc") return 0;
+    if (l == "de") return 1;
+    if (l == "hl") return 2;
+    if (l == (stack ? "af" : "sp")) return 3;
+    return -1;
+}
+
+static int condition(const std::string& s) {
+    std::string l = lower(s);
+    if (l == "nz") return 0;
+    if (l == "z") return 1;
+    if (l == "nc") return 2;
+    if (l == "c") return 3;
+    return -1;
+}
+
+static bool is_memory(const std::string& s) {
+    return s.size() > 2 && s.front() == '(' && s.back() == ')';
+}
+
+static std::string inner(const std::string& s) {
+    return trim(s.substr(1, s.size() - 2));
+}
+
+// ===== STATEMENTS =====
+
+bool Assembler::directive(const std::string& op, const std::string& rest) {
+    if (op == "org") {
+        pc = static_cast<u32>(value(rest));
+    } else if (op == "bank") {
+        bank = static_cast<u32>(value(rest));
+        if (bank == 0) {
+            error(*line, "bank 0 is the fixed bank, use org below $4000");
+        }
+        pc = 0x4000;
+    } else if (op == "db") {
+        for (const std::string& arg : split_operands(rest)) {
+            if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') {
+                for (size_t i = 1; i + 1 < arg.size(); i++) {
+                    emit(static_cast<u8>(arg[i]));
+                }
+            } else {
+                emit(static_cast<u8>(value8(arg)));
+            }
+        }
+    } else if (op == "dw") {
+        for (const std::string& arg : split_operands(rest)) {
+            emit16(value(arg));
+        }
+    } else if (op == "ds") {
+        std::vector<std::string> args = split_operands(rest);
+        long count = args.empty() ? 0 : value(args[0]);
+        u8 fill = args.size() > 1 ? static_cast<u8>(value8(args[1])) : 0;
+        for (long i = 0; i < count; i++) {
+            emit(fill);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool Assembler::instruction(const std::string& op, const std::vector<std::string>& args) {
+    static const char* no_operand_names[] = {"nop", "halt", "di", "ei", "daa", "cpl", "scf", "ccf",
+                                             "rlca", "rrca", "rla", "rra", "reti"};
+    static const u8 no_operand_codes[] = {0x00, 0x76, 0xF3, 0xFB, 0x27, 0x2F, 0x37, 0x3F,
+                                          0x07, 0x0F, 0x17, 0x1F, 0xD9};
+    static const char* alu_names[] = {"add", "adc", "sub", "sbc", "and", "xor", "or", "cp"};
+    static const char* cb_names[] = {"rlc", "rrc", "rl", "rr", "sla", "sra", "swap", "srl"};
+
+    size_t n = args.size();
+    std::string a0 = n > 0 ? lower(args[0]) : "";
+    std::string a1 = n > 1 ? lower(args[1]) : "";
+
+    for (size_t i = 0; i < sizeof(no_operand_codes); i++) {
+        if (op == no_operand_names[i] && n == 0) {
+            emit(no_operand_codes[i]);
+            return true;
+        }
+    }
+
+    if (op == "stop") {
+        emit(0x10);
+        emit(0x00);
+        return true;
+    }
+
+    // ALU operations: "add a, x", "sub x", "add hl, rr", "add sp, e8"
+    for (int k = 0; k < 8; k++) {
+        if (op != alu_names[k]) {
+            continue;
+        }
+        if (k == 0 && n == 2 && a0 == "hl" && reg16(a1, false) >= 0) {
+            emit(0x09 | (reg16(a1, false) << 4));
+            return true;
+        }
+        if (k == 0 && n == 2 && a0 == "sp") {
+            emit(0xE8);
+            emit(static_cast<u8>(value8(args[1])));
+            return true;
+        }
+        std::string src;
+        if (n == 2 && a0 == "a") {
+            src = args[1];
+        } else if (n == 1) {
+            src = args[0];
+        } else {
+            return false;
+        }
+        int r = reg8(src);
+        if (r >= 0) {
+            emit(0x80 | (k << 3) | r);
+        } else {
+            emit(0xC6 | (k << 3));
+            emit(static_cast<u8>(value8(src)));
+        }
+        return true;
+    }
+
+    // CB prefixed shifts and bit operations
+    for (int k = 0; k < 8; k++) {
+        if (op == cb_names[k] && n == 1 && reg8(a0) >= 0) {
+            emit(0xCB);
+            emit((k << 3) | reg8(a0));
+            return true;
+        }
+    }
+    if ((op == "bit" || op == "res" || op == "set") && n == 2 && reg8(a1) >= 0) {
+        long b = value(args[0]);
+        if (b < 0 || b > 7) {
+            error(*line, "bit number out of range");
+        }
+        u8 base = op == "bit" ? 0x40 : op == "res" ? 0x80 : 0xC0;
+        emit(0xCB);
+        emit(base | ((b & 7) << 3) | reg8(a1));
+        return true;
+    }
+
+    if (op == "inc" || op == "dec") {
+        bool dec = op == "dec";
+        if (n == 1 && reg8(a0) >= 0) {
+            emit((dec ? 0x05 : 0x04) | (reg8(a0) << 3));
+            return true;
+        }
+        if (n == 1 && reg16(a0, false) >= 0) {
+            emit((dec ? 0x0B : 0x03) | (reg16(a0, false) << 4));
+            return true;
+        }
+        return false;
+    }
+
+    if (op == "push" || op == "pop") {
+        if (n != 1 || reg16(a0, true) < 0) {
+            return false;
+        }
+        emit((op == "push" ? 0xC5 : 0xC1) | (reg16(a0, true) << 4));
+        return true;
+    }
+
+    if (op == "jp") {
+        if (n == 1 && (a0 == "hl" || a0 == "(hl)")) {
+            emit(0xE9);
+        } else if (n == 1) {
+            emit(0xC3);
+            emit16(value(args[0]));
+        } else if (n == 2 && condition(a0) >= 0) {
+            emit(0xC2 | (condition(a0) << 3));
+            emit16(value(args[1]));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (op == "jr") {
+        std::string target;
+        if (n == 1) {
+            emit(0x18);
+            target = args[0];
+        } else if (n == 2 && condition(a0) >= 0) {
+            emit(0x20 | (condition(a0) << 3));
+            target = args[1];
+        } else {
+            return false;
+        }
+        long offset = value(target) - static_cast<long>(pc + 1);
+        if (pass == 2 && (offset < -128 || offset > 127)) {
+            error(*line, "jr target out of range", target);
+        }
+        emit(static_cast<u8>(offset & 0xFF));
+        return true;
+    }
+
+    if (op == "call") {
+        if (n == 1) {
+            emit(0xCD);
+            emit16(value(args[0]));
+        } else if (n == 2 && condition(a0) >= 0) {
+            emit(0xC4 | (condition(a0) << 3));
+            emit16(value(args[1]));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (op == "ret") {
+        if (n == 0) {
+            emit(0xC9);
+        } else if (n == 1 && condition(a0) >= 0) {
+            emit(0xC0 | (condition(a0) << 3));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (op == "rst" && n == 1) {
+        long vector = value(args[0]);
+        if (vector & ~0x38) {
+            error(*line, "bad rst vector");
+        }
+        emit(0xC7 | (vector & 0x38));
+        return true;
+    }
+
+    if (op == "ldh" && n == 2) {
+        // ldh (n), a / ldh a, (n) with n either $FF00+x or x
+        if (a1 == "a" && is_memory(args[0])) {
+            emit(0xE0);
+            emit(static_cast<u8>(value(inner(args[0])) & 0xFF));
+            return true;
+        }
+        if (a0 == "a" && is_memory(args[1])) {
+            emit(0xF0);
+            emit(static_cast<u8>(value(inner(args[1])) & 0xFF));
+            return true;
+        }
+        return false;
+    }
+
+    if (op == "ld" && n == 2) {
+        int d8 = reg8(a0);
+        int s8 = reg8(a1);
+
+        if (d8 >= 0 && s8 >= 0) {
+            if (d8 == 6 && s8 == 6) {
+                return false;  // that encoding is HALT
+            }
+            emit(0x40 | (d8 << 3) | s8);
+            return true;
+        }
+
+        // Indirect forms through BC, DE, HL+/- and C
+        static const struct { const char* dst; const char* src; u8 code; } forms[] = {
+            {"(bc)", "a", 0x02}, {"(de)", "a", 0x12}, {"(hl+)", "a", 0x22}, {"(hli)", "a", 0x22},
+            {"(hl-)", "a", 0x32}, {"(hld)", "a", 0x32}, {"a", "(bc)", 0x0A}, {"a", "(de)", 0x1A},
+            {"a", "(hl+)", 0x2A}, {"a", "(hli)", 0x2A}, {"a", "(hl-)", 0x3A}, {"a", "(hld)", 0x3A},
+            {"(c)", "a", 0xE2}, {"($ff00+c)", "a", 0xE2}, {"a", "(c)", 0xF2}, {"a", "($ff00+c)", 0xF2},
+            {"sp", "hl", 0xF9},
+        };
+        for (const auto& form : forms) {
+            if (a0 == form.dst && a1 == form.src) {
+                emit(form.code);
+                return true;
+            }
+        }
+
+        if (a0 == "hl" && lower(args[1]).compare(0, 3, "sp+") == 0) {
+            emit(0xF8);
+            emit(static_cast<u8>(value8(args[1].substr(3))));
+            return true;
+        }
+        if (d8 >= 0 && !is_memory(args[1])) {
+            emit(0x06 | (d8 << 3));
+            emit(static_cast<u8>(value8(args[1])));
+            return true;
+        }
+        if (reg16(a0, false) >= 0 && !is_memory(args[1])) {
+            emit(0x01 | (reg16(a0, false) << 4));
+            emit16(value(args[1]));
+            return true;
+        }
+        if (is_memory(args[0]) && a1 == "a") {
+            emit(0xEA);
+            emit16(value(inner(args[0])));
+            return true;
+        }
+        if (is_memory(args[0]) && a1 == "sp") {
+            emit(0x08);
+            emit16(value(inner(args[0])));
+            return true;
+        }
+        if (a0 == "a" && is_memory(args[1])) {
+            emit(0xFA);
+            emit16(value(inner(args[1])));
+            return true;
+        }
+        return false;
+    }
+
+    return false;
+}
+
+void Assembler::statement(const std::string& raw) {
+    std::string text = trim(raw);
+
+    // Labels
+    size_t colon = text.find(':');
+    if (colon != std::string::npos && text.find('"') > colon) {
+        std::string name = trim(text.substr(0, colon));
+        bool valid = !name.empty();
+        for (char c : name) {
+            valid = valid && (isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.');
+        }
+        if (valid) {
+            if (name[0] != '.') {
+                scope = name;
+            }
+            std::string key = lower(qualify(name));
+            if (pass == 1 && symbols.count(key)) {
+                error(*line, "duplicate label", name);
+            }
+            symbols[key] = pc;
+            text = trim(text.substr(colon + 1));
+        }
+    }
+    if (text.empty()) {
+        return;
+    }
+
+    // Constants
+    std::string low = lower(text);
+    size_t equ = low.find(" equ ");
+    if (equ != std::string::npos) {
+        std::string name = lower(trim(text.substr(0, equ)));
+        long v = 0;
+        if (eval(text.substr(equ + 5), v)) {
+            symbols[name] = v;
+        }
+        return;
+    }
+
+    size_t space = text.find_first_of(" \t");
+    std::string op = lower(text.substr(0, space));
+    std::string rest = space == std::string::npos ? "" : trim(text.substr(space));
+
+    if (directive(op, rest)) {
+        return;
+    }
+    if (!instruction(op, split_operands(rest))) {
+        error(*line, "unknown instruction", text);
+    }
+}
+
+bool Assembler::assemble(const std::vector<Line>& lines) {
+    for (pass = 1; pass <= 2; pass++) {
+        bank = 1;
+        pc = 0;
+        scope.clear();
+        for (const Line& l : lines) {
+            line = &l;
+            statement(l.text);
+        }
+        if (had_error) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Assembler::write(const char* path) {
+    // Pad to a power of two, 32 KiB minimum, and fill in the ROM size byte
+    u32 size = 0x8000;
+    while (size < rom.size()) {
+        size <<= 1;
+    }
+    rom.resize(size, 0xFF);
+
+    u8 size_code = 0;
+    while ((0x8000u << size_code) < size) {
+        size_code++;
+    }
+    rom[0x148] = size_code;
+
+    u8 header_sum = 0;
+    for (u32 i = 0x134; i <= 0x14C; i++) {
+        header_sum = header_sum - rom[i] - 1;
+    }
+    rom[0x14D] = header_sum;
+
+    u16 global_sum = 0;
+    for (u32 i = 0; i < size; i++) {
+        if (i != 0x14E && i != 0x14F) {
+            global_sum += rom[i];
+        }
+    }
+    rom[0x14E] = global_sum >> 8;
+    rom[0x14F] = global_sum & 0xFF;
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(rom.data(), 1, rom.size(), fp) == rom.size();
+    fclose(fp);
+    return ok;
+}
+
+// ===== MAIN =====
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: sm83asm <input.asm> <output.gb>\n");
+        return 2;
+    }
+
+    std::vector<Line> source;
+    if (!read_lines(argv[1], source, nullptr)) {
+        return 1;
+    }
+
+    std::vector<Line> lines;
+    std::map<std::string, long> plain_equs;
+    size_t index = 0;
+    expand_rept(source, index, lines, plain_equs, false);
+    if (had_error) {
+        return 1;
+    }
+
+    Assembler assembler;
+    if (!assembler.assemble(lines) || !assembler.write(argv[2])) {
+        return 1;
+    }
+    return 0;
+}
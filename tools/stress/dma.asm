@@ -0,0 +1,92 @@
+; OAM DMA every frame: the main loop moves 40 sprites in a shadow OAM and
+; the VBlank handler copies it into OAM through the HRAM routine.
+
+include "hardware.inc"
+
+    org $40
+    jp vblank
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS DMA"
+    org $147
+    db $00, $00, $00
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+    call clear_shadow_oam
+    call copy_dma_routine
+
+    ; Spread the sprites over the screen
+    ld hl, SHADOW_OAM
+    ld b, 40
+    ld c, 0
+.init:
+    ld a, c
+    add a, 16
+    ld (hl+), a                 ; y
+    ld a, c
+    add a, a
+    add a, 8
+    ld (hl+), a                 ; x
+    ld a, b
+    ld (hl+), a                 ; tile
+    xor a
+    ld (hl+), a
+    ld a, c
+    add a, 3
+    ld c, a
+    dec b
+    jr nz, .init
+
+    ld a, IEF_VBLANK
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_BG8000 | LCDC_OBJON | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    halt
+    nop
+    ; Sprite i moves right by 1 + (i & 3) and down by 1
+    ld hl, SHADOW_OAM
+    ld b, 40
+.move:
+    ld a, (hl)
+    inc a
+    cp 160
+    jr c, .keep_y
+    xor a
+.keep_y:
+    ld (hl+), a
+    ld a, b
+    and 3
+    inc a
+    add a, (hl)
+    ld (hl+), a
+    inc l
+    inc l
+    dec b
+    jr nz, .move
+    jr main
+
+vblank:
+    push af
+    ld a, SHADOW_OAM >> 8
+    call HRAM_DMA
+    pop af
+    reti
+
+include "common.inc"
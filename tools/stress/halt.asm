@@ -0,0 +1,74 @@
+; HALT heavy idle loop: the CPU sleeps between VBlank and timer interrupts
+; that do a few bytes of work each, like a game waiting for the next frame.
+
+include "hardware.inc"
+
+    org $40
+    jp vblank
+    org $50
+    jp timer
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS HALT"
+    org $147
+    db $00, $00, $00
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+
+    ; 16384 Hz timer, overflowing every 64 counts
+    ld a, $C0
+    ldh (rTMA), a
+    ldh (rTIMA), a
+    ld a, %111
+    ldh (rTAC), a
+
+    ld a, IEF_VBLANK | IEF_TIMER
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_BG8000 | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    halt
+    nop
+    ld a, (ticks)
+    and 15
+    jr nz, main
+    ; Occasional main loop work
+    ld hl, $9800
+    inc (hl)
+    jr main
+
+vblank:
+    push af
+    ldh a, (rSCX)
+    inc a
+    ldh (rSCX), a
+    pop af
+    reti
+
+timer:
+    push af
+    ld a, (ticks)
+    inc a
+    ld (ticks), a
+    pop af
+    reti
+
+ticks equ $D000
+
+include "common.inc"
@@ -0,0 +1,98 @@
+; MBC bank switching: the main loop walks all 32 ROM banks of an MBC5
+; cartridge, calling a checksum routine in each, and swaps external RAM
+; banks to store the results.
+
+include "hardware.inc"
+
+BANK_CODE equ $4001             ; checksum routine in every switchable bank
+BANK_DATA equ $4100
+
+    org $40
+    jp vblank
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS MBC"
+    org $147
+    db $1A, $00, $03            ; MBC5+RAM, size filled in, 32 KiB RAM
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+
+    ; External RAM on, upper ROM bank bit clear
+    ld a, $0A
+    ld ($0000), a
+    xor a
+    ld ($3000), a
+
+    ld a, IEF_VBLANK
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_BG8000 | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    ld c, 1
+.bank:
+    ld a, c
+    ld ($2000), a               ; ROM bank
+    and 3
+    ld ($4000), a               ; RAM bank
+    call BANK_CODE
+    ; Store the checksum in external RAM, indexed by bank
+    ld h, $A0
+    ld l, c
+    add a, (hl)
+    ld (hl), a
+    inc c
+    ld a, c
+    cp 32
+    jr nz, .bank
+    jr main
+
+vblank:
+    push af
+    ldh a, (rSCX)
+    inc a
+    ldh (rSCX), a
+    pop af
+    reti
+
+include "common.inc"
+
+; Each switchable bank: its number, a checksum routine and 256 bytes of data
+    rept 31, n
+    bank {n} + 1
+bank_{n}:
+    db {n} + 1
+bank_code_{n}:
+    push hl
+    push bc
+    ld hl, BANK_DATA
+    ld b, 0
+    xor a
+.loop:
+    add a, (hl)
+    inc hl
+    dec b
+    jr nz, .loop
+    pop bc
+    pop hl
+    ret
+    org BANK_DATA
+    rept 256, i
+    db {n} * 7 + {i} & 255
+    endr
+    endr
@@ -0,0 +1,93 @@
+; Mid-scanline raster effects: an HBlank handler waits for the next line's
+; pixel transfer and rewrites SCX while it is running, so the PPU sees a
+; scroll change in the middle of almost every line.
+
+include "hardware.inc"
+
+WAVE equ $1000                  ; 256 byte scroll table, page aligned
+
+    org $40
+    jp vblank
+    org $48
+    jp stat
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS RASTER"
+    org $147
+    db $00, $00, $00
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+
+    ld a, STATF_HBLANK
+    ldh (rSTAT), a
+    ld a, IEF_VBLANK | IEF_STAT
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_BG8000 | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    halt
+    nop
+    jr main
+
+; Shift the wave one step per frame
+vblank:
+    push af
+    ld a, (phase)
+    inc a
+    ld (phase), a
+    ldh a, (rSCY)
+    inc a
+    ldh (rSCY), a
+    pop af
+    reti
+
+stat:
+    push af
+    push hl
+    ; Next line's scroll comes from the wave table
+    ldh a, (rLY)
+    ld hl, phase
+    add a, (hl)
+    ld l, a
+    ld h, WAVE >> 8
+    ld h, (hl)
+    ; Wait for mode 3 of the next line, then a little longer
+.wait:
+    ldh a, (rSTAT)
+    and 3
+    cp 3
+    jr nz, .wait
+    nop
+    nop
+    nop
+    nop
+    ld a, h
+    ldh (rSCX), a
+    pop hl
+    pop af
+    reti
+
+phase equ $D000
+
+include "common.inc"
+
+    org WAVE
+    rept 256, i
+    db {i} * 3 & 31
+    endr
@@ -0,0 +1,160 @@
+; Sprite heavy scene: 40 tall sprites in rows of ten. A mid-frame DMA
+; moves the rows down twice per frame, so nearly every line carries the
+; ten sprite limit.
+
+include "hardware.inc"
+
+OAM_ROWS_0 equ $C000            ; sprites covering lines 0-63
+OAM_ROWS_1 equ $C100            ; lines 64-127
+OAM_ROWS_2 equ $C200            ; lines 128-143
+
+    org $40
+    jp vblank
+    org $48
+    jp stat
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS SPRITES"
+    org $147
+    db $00, $00, $00
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+    call copy_dma_routine
+
+    ; Three OAM tables, each holding 4 rows of 10 sprites, 64 lines apart
+    ld hl, OAM_ROWS_0
+    ld c, 16
+    call build_table
+    ld hl, OAM_ROWS_1
+    ld c, 16 + 64
+    call build_table
+    ld hl, OAM_ROWS_2
+    ld c, 16 + 128
+    call build_table
+
+    ld a, OAM_ROWS_0 >> 8
+    call HRAM_DMA
+
+    ld a, STATF_LYC
+    ldh (rSTAT), a
+    ld a, 62
+    ldh (rLYC), a
+    ld a, IEF_VBLANK | IEF_STAT
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_BG8000 | LCDC_OBJ16 | LCDC_OBJON | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    halt
+    nop
+    jr main
+
+; Builds 40 sprites at hl with the first row at y = c
+build_table:
+    ld d, 4                     ; rows
+.row:
+    ld e, 10                    ; sprites per row
+    ld b, 8                     ; x
+.sprite:
+    ld a, c
+    ld (hl+), a
+    ld a, b
+    ld (hl+), a
+    add a, 16
+    ld b, a
+    ld a, e
+    add a, a
+    ld (hl+), a                 ; tile
+    ld a, e
+    and 1
+    swap a
+    add a, a                    ; palette 1 on every other sprite
+    ld (hl+), a
+    dec e
+    jr nz, .sprite
+    ld a, c
+    add a, 16
+    ld c, a
+    dec d
+    jr nz, .row
+    ret
+
+; Scroll the sprites sideways and restart from the top table
+vblank:
+    push af
+    push bc
+    push hl
+    ld hl, frame
+    inc (hl)
+    ld a, (hl)
+    and 7
+    ld b, a
+    ld hl, OAM_ROWS_0 + 1
+    call nudge_x
+    ld hl, OAM_ROWS_1 + 1
+    call nudge_x
+    ld hl, OAM_ROWS_2 + 1
+    call nudge_x
+    ld a, OAM_ROWS_0 >> 8
+    call HRAM_DMA
+    ld a, 62
+    ldh (rLYC), a
+    pop hl
+    pop bc
+    pop af
+    reti
+
+; Adds b to the x coordinate of 40 sprites starting at hl
+nudge_x:
+    ld c, 40
+.loop:
+    ld a, (hl)
+    and %11111000
+    add a, 8
+    add a, b
+    ld (hl+), a
+    inc l
+    inc l
+    inc l
+    dec c
+    jr nz, .loop
+    ret
+
+; LYC: switch to the next table of rows
+stat:
+    push af
+    ldh a, (rLYC)
+    cp 62
+    jr nz, .second
+    ld a, 126
+    ldh (rLYC), a
+    ld a, OAM_ROWS_1 >> 8
+    call HRAM_DMA
+    pop af
+    reti
+.second:
+    ld a, 200                   ; never matches, reset in VBlank
+    ldh (rLYC), a
+    ld a, OAM_ROWS_2 >> 8
+    call HRAM_DMA
+    pop af
+    reti
+
+frame equ $D000
+
+include "common.inc"
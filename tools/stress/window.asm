@@ -0,0 +1,97 @@
+; Window split screen: a status bar at the top and bottom drawn with the
+; window, toggled from LYC interrupts, over a background that scrolls
+; every frame.
+
+include "hardware.inc"
+
+    org $40
+    jp vblank
+    org $48
+    jp stat
+
+    org $100
+    nop
+    jp start
+
+    org $134
+    db "STRESS WINDOW"
+    org $147
+    db $00, $00, $00
+
+    org $150
+start:
+    di
+    ld sp, $DFFF
+    call lcd_off
+    call load_tiles
+    call load_maps
+    call set_palettes
+
+    xor a
+    ldh (rWY), a
+    ld a, 7
+    ldh (rWX), a
+
+    ld a, STATF_LYC
+    ldh (rSTAT), a
+    ld a, 16
+    ldh (rLYC), a
+    ld a, IEF_VBLANK | IEF_STAT
+    ldh (rIE), a
+    xor a
+    ldh (rIF), a
+
+    ld a, LCDC_ON | LCDC_WIN9C | LCDC_WINON | LCDC_BG8000 | LCDC_BGON
+    ldh (rLCDC), a
+    ei
+
+main:
+    halt
+    nop
+    jr main
+
+vblank:
+    push af
+    push hl
+    ; Scroll the playfield diagonally
+    ldh a, (rSCX)
+    inc a
+    ldh (rSCX), a
+    ldh a, (rSCY)
+    inc a
+    ldh (rSCY), a
+    ; Tick a counter in the status bar
+    ld hl, $9C00
+    inc (hl)
+    ; Window on for the top bar
+    ldh a, (rLCDC)
+    or LCDC_WINON
+    ldh (rLCDC), a
+    ld a, 16
+    ldh (rLYC), a
+    pop hl
+    pop af
+    reti
+
+stat:
+    push af
+    ldh a, (rLYC)
+    cp 16
+    jr nz, .bottom
+    ; End of the top bar
+    ldh a, (rLCDC)
+    and $FF - LCDC_WINON
+    ldh (rLCDC), a
+    ld a, 128
+    ldh (rLYC), a
+    pop af
+    reti
+.bottom:
+    ; Bottom bar
+    ldh a, (rLCDC)
+    or LCDC_WINON
+    ldh (rLCDC), a
+    pop af
+    reti
+
+include "common.inc"
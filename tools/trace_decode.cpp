@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "trace.hpp"
+
+/**
+ * Decodes a binary trace written by the emulator (--trace FILE, or F8)
+ * into the Gameboy Doctor log format, one line per instruction:
+ *
+ *   A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,37,06
+ *
+ *   trace_decode [--cycles] [--first N] [--count N] trace.bin
+ *
+ * --cycles appends the M-cycle stamp and ROM bank, which Gameboy Doctor
+ * does not compare. --first/--count select a window of records.
+ */
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    bool cycles = false;
+    unsigned long long first = 0;
+    unsigned long long count = ~0ull;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--cycles")) {
+            cycles = true;
+        } else if (!strcmp(argv[i], "--first") && i + 1 < argc) {
+            first = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+            count = strtoull(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+
+    if (!path) {
+        printf("Usage: trace_decode [--cycles] [--first N] [--count N] trace.bin\n");
+        return 2;
+    }
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        printf("Failed to open: %s\n", path);
+        return 2;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "GBTRACE", 8) != 0) {
+        printf("Not a trace file: %s\n", path);
+        fclose(fp);
+        return 2;
+    }
+    if (header.version != Trace::VERSION || header.record_size != sizeof(TraceRecord)) {
+        printf("Unsupported trace version %u (record size %u)\n", header.version, header.record_size);
+        fclose(fp);
+        return 2;
+    }
+
+    if (first) {
+        fseek(fp, static_cast<long>(first * sizeof(TraceRecord)), SEEK_CUR);
+    }
+
+    static TraceRecord records[4096];
+    char line[128];
+    size_t n;
+    while (count && (n = fread(records, sizeof(TraceRecord), 4096, fp)) > 0) {
+        for (size_t i = 0; i < n && count; i++, count--) {
+            trace_format(records[i], cycles, line, sizeof(line));
+            puts(line);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}